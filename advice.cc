@@ -0,0 +1,556 @@
+//
+// Copyright (c) 2025 Bryan Phillippe
+//
+// This software is free to use for any purpose, provided this copyright
+// notice is preserved.
+//
+
+#include <algorithm>
+#include <cerrno>
+#include <limits>
+#include <vector>
+
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <libposix.hh>
+
+static std::size_t
+page_size()
+{
+    static const std::size_t size = sysconf(_SC_PAGESIZE);
+    return size;
+}
+
+static std::uint64_t
+round_up(std::uint64_t n, std::size_t unit)
+{
+    return (n + unit - 1) / unit * unit;
+}
+
+//
+// Gives advice on a range, throwing on failure; posix_fadvise() returns
+// its error rather than setting errno.
+//
+static void
+advise(int fd, off_t offset, off_t length, int advice)
+{
+    const int r = posix_fadvise(fd, offset, length, advice);
+
+    if (0 != r) {
+        throw std::runtime_error{errno_to_string(r)};
+    }
+}
+
+void
+posixcc::set_access_pattern(int fd, access_pattern p, off_t offset,
+                            off_t length)
+{
+    static const int advice[] = {
+        POSIX_FADV_NORMAL,
+        POSIX_FADV_SEQUENTIAL,
+        POSIX_FADV_RANDOM,
+        POSIX_FADV_NOREUSE
+    };
+
+    advise(fd, offset, length, advice[static_cast<int>(p)]);
+}
+
+void
+posixcc::will_need(int fd, off_t offset, off_t length)
+{
+    advise(fd, offset, length, POSIX_FADV_WILLNEED);
+}
+
+void
+posixcc::dont_need(int fd, off_t offset, off_t length)
+{
+    advise(fd, offset, length, POSIX_FADV_DONTNEED);
+}
+
+void
+posixcc::read_ahead(int fd, off_t offset, std::size_t length)
+{
+    if (-1 == readahead(fd, offset, length)) {
+        throw std::runtime_error{errno_to_string(errno)};
+    }
+}
+
+posixcc::file_scanner::file_scanner(int f) noexcept:
+fd{f}
+{
+}
+
+posixcc::file_scanner&
+posixcc::file_scanner::set_chunk_size(std::size_t size) noexcept
+{
+    chunk = round_up(std::max<std::size_t>(size, 1), page_size());
+    return *this;
+}
+
+posixcc::file_scanner&
+posixcc::file_scanner::set_window(std::size_t size) noexcept
+{
+    window = round_up(std::max<std::size_t>(size, 1), page_size());
+    return *this;
+}
+
+posixcc::file_scanner&
+posixcc::file_scanner::set_drop_behind(bool enabled) noexcept
+{
+    drop_behind = enabled;
+    return *this;
+}
+
+std::size_t
+posixcc::file_scanner::scan(off_t offset, std::size_t length,
+                            const consumer& f)
+{
+    const std::uint64_t stop =
+        (length > std::numeric_limits<std::uint64_t>::max() - offset) ?
+        std::numeric_limits<std::uint64_t>::max() : offset + length;
+    std::vector<char> buffer(chunk);
+    std::uint64_t cursor = offset;
+    std::uint64_t ahead = offset;
+    std::uint64_t dropped = offset - offset % page_size();
+
+    // The caller's advice for the descriptor is left alone, as Linux would
+    // apply any other to the whole open file. Pages brought in by
+    // readahead() are not marked to trigger the kernel's own readahead, so
+    // that only runs past the range on a miss, which the window prevents.
+    while (cursor < stop) {
+        // Keep a window read ahead, topping it up once half of it is used,
+        // so that the device is asked for large runs.
+        if (ahead < stop && ahead - cursor <= window / 2) {
+            const std::uint64_t to = std::min<std::uint64_t>(
+                cursor + window, stop);
+            read_ahead(fd, ahead, to - ahead);
+            ahead = to;
+        }
+
+        const std::size_t n = std::min<std::uint64_t>(chunk, stop - cursor);
+        ssize_t l;
+        do {
+            l = pread(fd, buffer.data(), n, cursor);
+        } while (-1 == l && EINTR == errno);
+
+        if (-1 == l) {
+            throw std::runtime_error{errno_to_string(errno)};
+        }
+        if (0 == l) {
+            break;
+        }
+
+        f(buffer.data(), l);
+        cursor += l;
+
+        // Drop whole pages the consumer is done with.
+        const std::uint64_t done = cursor - cursor % page_size();
+        if (drop_behind && done > dropped) {
+            dont_need(fd, dropped, done - dropped);
+            dropped = done;
+        }
+    }
+
+    // A partial last page is done with too, but is only dropped by a range
+    // covering all of it.
+    if (drop_behind && cursor > dropped) {
+        dont_need(fd, dropped, round_up(cursor, page_size()) - dropped);
+    }
+
+    return cursor - offset;
+}
+
+posixcc::file_writer::file_writer(int f, off_t offset) noexcept:
+fd{f},
+position{offset},
+submitted{static_cast<off_t>(offset - offset % page_size())},
+dropped{submitted},
+allocated{offset}
+{
+}
+
+posixcc::file_writer&
+posixcc::file_writer::set_chunk_size(std::size_t size) noexcept
+{
+    chunk = round_up(std::max<std::size_t>(size, 1), page_size());
+    return *this;
+}
+
+posixcc::file_writer&
+posixcc::file_writer::set_extent_size(std::size_t size) noexcept
+{
+    extent = round_up(size, page_size());
+    return *this;
+}
+
+void
+posixcc::file_writer::write(const void* data, std::size_t length)
+{
+    const char* const p = static_cast<const char*>(data);
+
+    // Extents are allocated ahead of the data, without changing the size
+    // of the file; without support for it, the file system allocates as
+    // it writes.
+    if (extent && position + static_cast<off_t>(length) > allocated) {
+        const off_t from = std::max(allocated, position);
+        const off_t to = round_up(position + length, extent);
+
+        if (-1 == fallocate(fd, FALLOC_FL_KEEP_SIZE, from, to - from)) {
+            if (EOPNOTSUPP != errno) {
+                throw std::runtime_error{errno_to_string(errno)};
+            }
+            extent = 0;
+        }
+        allocated = to;
+    }
+
+    std::size_t done = 0;
+    while (done < length) {
+        const ssize_t l = pwrite(fd, p + done, length - done,
+                                 position + done);
+
+        if (-1 == l) {
+            if (EINTR == errno) {
+                continue;
+            }
+            throw std::runtime_error{errno_to_string(errno)};
+        }
+        done += l;
+    }
+    position += length;
+
+    write_behind();
+}
+
+void
+posixcc::file_writer::write_behind()
+{
+    // Each completed chunk is handed to writeback, and then the one before
+    // it waited for and dropped, so that the device always has the next
+    // one to write.
+    while (position - submitted >= static_cast<off_t>(chunk)) {
+        if (-1 == sync_file_range(fd, submitted, chunk,
+                                  SYNC_FILE_RANGE_WRITE)) {
+            throw std::runtime_error{errno_to_string(errno)};
+        }
+        submitted += chunk;
+
+        if (submitted - dropped > static_cast<off_t>(chunk)) {
+            if (-1 == sync_file_range(fd, dropped, chunk,
+                                      SYNC_FILE_RANGE_WAIT_BEFORE |
+                                      SYNC_FILE_RANGE_WRITE |
+                                      SYNC_FILE_RANGE_WAIT_AFTER)) {
+                throw std::runtime_error{errno_to_string(errno)};
+            }
+            dont_need(fd, dropped, chunk);
+            dropped += chunk;
+        }
+    }
+}
+
+void
+posixcc::file_writer::finish()
+{
+    if (position > dropped) {
+        if (-1 == sync_file_range(fd, dropped, position - dropped,
+                                  SYNC_FILE_RANGE_WAIT_BEFORE |
+                                  SYNC_FILE_RANGE_WRITE |
+                                  SYNC_FILE_RANGE_WAIT_AFTER)) {
+            throw std::runtime_error{errno_to_string(errno)};
+        }
+        dont_need(fd, dropped, round_up(position, page_size()) - dropped);
+        submitted = dropped = position - position % page_size();
+    }
+
+    // Only what lies past the end of the file is released, as the writer
+    // may have been overwriting the middle of it. Truncating to the same
+    // size does that; punching a hole past the end does not, on ext4.
+    if (allocated > position) {
+        struct stat s;
+
+        if (-1 == fstat(fd, &s)) {
+            throw std::runtime_error{errno_to_string(errno)};
+        }
+        if (allocated > s.st_size && -1 == ftruncate(fd, s.st_size)) {
+            throw std::runtime_error{errno_to_string(errno)};
+        }
+        allocated = position;
+    }
+}
+
+off_t
+posixcc::file_writer::get_position() const noexcept
+{
+    return position;
+}
+
+#ifdef ADVICE_TEST
+#include <thread>
+#include <sys/mman.h>
+#include "stfu/stfu.hh"
+
+static const std::size_t file_size = (8 << 20) + 100;
+
+//
+// Creates a file of "file_size" bytes, not cached, returning its path.
+//
+static std::string
+temp_file()
+{
+    char path[] = "/var/tmp/posixcc-advice-XXXXXX";
+    posixcc::auto_fd fd{mkstemp(path)};
+    std::vector<char> data(file_size);
+
+    for (std::size_t i = 0; i < file_size; ++i) {
+        data[i] = static_cast<char>(i % 251);
+    }
+    STFU_ASSERT(static_cast<ssize_t>(file_size) ==
+                write(fd, data.data(), data.size()));
+    fsync(fd);
+    posixcc::dont_need(fd, 0, 0);
+
+    return path;
+}
+
+//
+// Returns the number of pages of the file at "fd" in the page cache.
+//
+static std::size_t
+resident(int fd)
+{
+    const std::size_t page = sysconf(_SC_PAGESIZE);
+    std::vector<unsigned char> pages((file_size + page - 1) / page);
+    void* m = mmap(nullptr, file_size, PROT_READ, MAP_SHARED, fd, 0);
+
+    STFU_ASSERT(MAP_FAILED != m);
+    mincore(m, file_size, pages.data());
+    munmap(m, file_size);
+
+    return std::count_if(pages.begin(), pages.end(),
+                         [](unsigned char r) { return r & 1; });
+}
+
+static void
+advice_tests()
+{
+    const std::string path = temp_file();
+    const posixcc::auto_fd fd{open(path.c_str(), O_RDONLY)};
+    const std::size_t pages = (file_size + 4095) / 4096;
+
+    for (const auto p: {posixcc::access_pattern::normal,
+                        posixcc::access_pattern::sequential,
+                        posixcc::access_pattern::random,
+                        posixcc::access_pattern::no_reuse}) {
+        posixcc::set_access_pattern(fd, p);
+    }
+    STFU_ASSERT(0 == resident(fd));
+
+    // Reading ahead fills the cache, in the background for WILLNEED.
+    posixcc::read_ahead(fd, 0, 1 << 20);
+    posixcc::will_need(fd, 4 << 20, 1 << 20);
+    for (int i = 0; i < 100 && resident(fd) < 512; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    STFU_ASSERT(512 <= resident(fd) && resident(fd) < pages);
+
+    posixcc::dont_need(fd, 0, 0);
+    STFU_ASSERT(0 == resident(fd));
+
+    // Errors are thrown.
+    bool thrown = false;
+    try {
+        posixcc::will_need(-1, 0, 0);
+    } catch (const std::runtime_error&) {
+        thrown = true;
+    }
+
+    unlink(path.c_str());
+    STFU_PASS_IFF(thrown);
+}
+
+static void
+scan_tests()
+{
+    const std::string path = temp_file();
+    const posixcc::auto_fd fd{open(path.c_str(), O_RDONLY)};
+    const std::size_t pages = (file_size + 4095) / 4096;
+    posixcc::file_scanner scanner{fd};
+    std::size_t seen = 0;
+    bool ordered = true;
+
+    // Small chunks and window, so that both turn over many times.
+    scanner.set_chunk_size(100000)
+           .set_window(1 << 20);
+    const auto check = [&](const char* d, std::size_t l) {
+        for (std::size_t i = 0; i < l; ++i, ++seen) {
+            ordered = ordered && static_cast<char>(seen % 251) == d[i];
+        }
+    };
+
+    // Consumed pages are dropped, leaving nothing behind.
+    STFU_ASSERT(file_size == scanner.scan(0, SIZE_MAX, check));
+    STFU_ASSERT(ordered && file_size == seen);
+    STFU_ASSERT(0 == resident(fd));
+
+    // A range, from an unaligned offset; the caller's advice is kept, and
+    // even sequential access reads nothing past the range.
+    posixcc::set_access_pattern(fd, posixcc::access_pattern::sequential);
+    seen = 1000;
+    STFU_ASSERT(3000000 == scanner.scan(1000, 3000000, check));
+    STFU_ASSERT(ordered && 3001000 == seen);
+    STFU_ASSERT(0 == resident(fd));
+
+    // Without dropping, the file stays cached.
+    seen = 0;
+    scanner.set_drop_behind(false);
+    STFU_ASSERT(file_size == scanner.scan(0, SIZE_MAX, check));
+
+    unlink(path.c_str());
+    STFU_PASS_IFF(ordered && pages == resident(fd));
+}
+
+static void
+writer_tests()
+{
+    char path[] = "/var/tmp/posixcc-advice-XXXXXX";
+    const posixcc::auto_fd fd{mkstemp(path)};
+    posixcc::file_writer writer{fd};
+    std::vector<char> data(100000);
+    std::size_t written = 0, most = 0;
+
+    // Small chunks and extents, so that both turn over many times.
+    writer.set_chunk_size(1 << 20)
+          .set_extent_size(4 << 20);
+    while (written < file_size) {
+        const std::size_t n = std::min(data.size(), file_size - written);
+
+        for (std::size_t i = 0; i < n; ++i) {
+            data[i] = static_cast<char>((written + i) % 251);
+        }
+        writer.write(data.data(), n);
+        written += n;
+        most = std::max(most, resident(fd));
+    }
+    STFU_ASSERT(static_cast<off_t>(file_size) == writer.get_position());
+
+    // No more than about two chunks were ever cached, and nothing is left
+    // of the data or the preallocation.
+    writer.finish();
+    struct stat s;
+    STFU_ASSERT(0 == fstat(fd, &s));
+    STFU_ASSERT(static_cast<off_t>(file_size) == s.st_size);
+    STFU_ASSERT(most <= 3 * 256 && 0 == resident(fd));
+    STFU_ASSERT(static_cast<std::size_t>(s.st_blocks) * 512 <
+                file_size + (1 << 20));
+
+    // What was written reads back.
+    std::size_t seen = 0;
+    bool ordered = true;
+    posixcc::file_scanner{fd}.scan(0, SIZE_MAX,
+        [&](const char* d, std::size_t l) {
+            for (std::size_t i = 0; i < l; ++i, ++seen) {
+                ordered = ordered && static_cast<char>(seen % 251) == d[i];
+            }
+        });
+
+    unlink(path);
+    STFU_PASS_IFF(ordered && file_size == seen);
+}
+
+extern "C" std::size_t
+unit_tests()
+{
+    stfu::test_group group{"advice tests",
+        "Tests of access pattern advice, scans and write-behind."};
+    group.add_test(stfu::test{"advice",
+            advice_tests,
+            "Verify access pattern advice, and reading ahead and dropping "
+            "ranges."})
+         .add_test(stfu::test{"scan",
+            scan_tests,
+            "Verify that a scan reads everything in order, and drops it "
+            "behind itself."})
+         .add_test(stfu::test{"write behind",
+            writer_tests,
+            "Verify that a writer keeps little cached, and releases its "
+            "preallocation."})
+         .set_timeout(std::chrono::seconds(30));
+
+    stfu::test_result_summary summary = group();
+    return summary.failed + summary.crashed + summary.timed_out +
+        summary.regressed;
+}
+#endif // ADVICE_TEST
+
+#ifdef ADVICE_BENCH
+#include "stfu/stfu.hh"
+
+static const std::size_t chunk_size = 1 << 20;
+static const std::size_t data_size = 512 << 20;
+
+extern "C" std::size_t
+unit_tests()
+{
+    char path[] = "/var/tmp/posixcc-advice-XXXXXX";
+    const posixcc::auto_fd fd{mkstemp(path)};
+    const std::vector<char> data(chunk_size, 'x');
+    std::size_t pos = 0;
+
+    // Outside of any test, a failure can only be counted.
+    if (!fd) {
+        return 1;
+    }
+
+    // Both start over on an empty file once "data_size" is written.
+    stfu::benchmark buffered{"buffered write", [&](std::size_t n) {
+            for (std::size_t i = 0; i < n; ++i) {
+                if (data_size == pos) {
+                    STFU_ASSERT(0 == ftruncate(fd, 0));
+                    pos = 0;
+                }
+                const ssize_t l = pwrite(fd, data.data(), chunk_size, pos);
+                STFU_ASSERT(static_cast<ssize_t>(chunk_size) == l);
+                pos += l;
+            }
+        },
+        "Write a 512 MiB file 1 MiB at a time, leaving writeback to the "
+        "kernel."
+    };
+
+    std::unique_ptr<posixcc::file_writer> writer;
+    stfu::benchmark behind{"write-behind", [&](std::size_t n) {
+            for (std::size_t i = 0; i < n; ++i) {
+                if (!writer || data_size == pos) {
+                    if (writer) {
+                        writer->finish();
+                    }
+                    STFU_ASSERT(0 == ftruncate(fd, 0));
+                    writer.reset(new posixcc::file_writer{fd});
+                    pos = 0;
+                }
+                writer->write(data.data(), chunk_size);
+                pos += chunk_size;
+            }
+        },
+        "Write a 512 MiB file 1 MiB at a time through a write-behind "
+        "writer with 8 MiB chunks."
+    };
+    for (auto* b: {&buffered, &behind}) {
+        b->set_bytes_per_op(chunk_size);
+    }
+
+    stfu::test_group group{"advice benchmarks",
+        "Write-behind against buffered streaming writes."};
+    group.add_test(buffered)
+         .add_test(behind)
+         .set_jobs(1);
+
+    stfu::test_result_summary summary = group();
+
+    unlink(path);
+
+    return summary.failed + summary.crashed + summary.timed_out +
+        summary.regressed;
+}
+#endif // ADVICE_BENCH
@@ -210,6 +210,73 @@ unit_tests()
              .add_after_all(test_teardown);
 
     stfu::test_result_summary summary = group();
-    return summary.failed + summary.crashed;
+    return summary.failed + summary.crashed + summary.timed_out +
+        summary.regressed;
 }
 #endif // AUTO_FD_TEST
+
+#ifdef AUTO_FD_BENCH
+#include <fcntl.h>
+#include "stfu/stfu.hh"
+
+//
+// Keeps the compiler from optimizing away the operations under measurement.
+//
+static volatile int sink;
+
+extern "C" std::size_t
+unit_tests()
+{
+    stfu::benchmark construct{"construct", [](std::size_t n) {
+            for (std::size_t i = 0; i < n; ++i) {
+                posixcc::auto_fd fd{static_cast<int>(i)};
+                sink = fd.release();
+            }
+        },
+        "Construct an auto_fd from an integer, and release it."
+    };
+    stfu::benchmark move{"move", [](std::size_t n) {
+            posixcc::auto_fd fd{99};
+            for (std::size_t i = 0; i < n; ++i) {
+                posixcc::auto_fd moved{std::move(fd)};
+                fd = std::move(moved);
+            }
+            sink = fd.release();
+        },
+        "Move-construct, then move-assign an auto_fd back."
+    };
+    stfu::benchmark copy{"copy (dup)", [](std::size_t n) {
+            posixcc::auto_fd fd{open("/dev/null", O_RDONLY)};
+            for (std::size_t i = 0; i < n; ++i) {
+                posixcc::auto_fd copied{fd};
+                sink = copied.get();
+            }
+        },
+        "Copy-construct an auto_fd, which duplicates the descriptor, and "
+        "close it again on destruction."
+    };
+    stfu::benchmark raw{"raw dup/close", [](std::size_t n) {
+            const int fd = open("/dev/null", O_RDONLY);
+            for (std::size_t i = 0; i < n; ++i) {
+                const int copied = dup(fd);
+                sink = copied;
+                ::close(copied);
+            }
+            ::close(fd);
+        },
+        "Reference for the above: dup() and close() a plain descriptor."
+    };
+
+    stfu::test_group group{"auto_fd benchmarks",
+        "Cost of auto_fd operations."};
+    group.add_test(construct)
+         .add_test(move)
+         .add_test(copy)
+         .add_test(raw)
+         .set_jobs(1);
+
+    stfu::test_result_summary summary = group();
+    return summary.failed + summary.crashed + summary.timed_out +
+        summary.regressed;
+}
+#endif // AUTO_FD_BENCH
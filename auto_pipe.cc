@@ -141,6 +141,50 @@ unit_tests()
         "Tests of the auto_pipe class and operations."});
 
     stfu::test_result_summary summary = group();
-    return summary.failed + summary.crashed;
+    return summary.failed + summary.crashed + summary.timed_out +
+        summary.regressed;
 }
 #endif // AUTO_PIPE_TEST
+
+#ifdef AUTO_PIPE_BENCH
+#include <vector>
+#include "stfu/stfu.hh"
+
+extern "C" std::size_t
+unit_tests()
+{
+    static const std::size_t chunk = 16384;
+
+    stfu::benchmark create{"create", [](std::size_t n) {
+            for (std::size_t i = 0; i < n; ++i) {
+                posixcc::auto_pipe p;
+            }
+        },
+        "Create an auto_pipe, and close both ends on destruction."
+    };
+    stfu::benchmark throughput{"throughput", [](std::size_t n) {
+            posixcc::auto_pipe p;
+            std::vector<char> buffer(chunk, 'x');
+
+            for (std::size_t i = 0; i < n; ++i) {
+                STFU_ASSERT(static_cast<ssize_t>(chunk) ==
+                    write(p.get_wfd(), buffer.data(), chunk));
+                STFU_ASSERT(static_cast<ssize_t>(chunk) ==
+                    read(p.get_rfd(), buffer.data(), chunk));
+            }
+        },
+        "Write a 16 KiB chunk into an auto_pipe, and read it back out."
+    };
+    throughput.set_bytes_per_op(chunk);
+
+    stfu::test_group group{"auto_pipe benchmarks",
+        "Cost of auto_pipe operations."};
+    group.add_test(create)
+         .add_test(throughput)
+         .set_jobs(1);
+
+    stfu::test_result_summary summary = group();
+    return summary.failed + summary.crashed + summary.timed_out +
+        summary.regressed;
+}
+#endif // AUTO_PIPE_BENCH
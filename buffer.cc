@@ -0,0 +1,494 @@
+//
+// Copyright (c) 2025 Bryan Phillippe
+//
+// This software is free to use for any purpose, provided this copyright
+// notice is preserved.
+//
+
+#include <algorithm>
+#include <cerrno>
+
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include <libposix.hh>
+
+constexpr std::size_t posixcc::buffer_pool::huge_page_size;
+
+//
+// Rounds "n" up to a multiple of "unit", a power of two.
+//
+static std::size_t
+round_up(std::size_t n, std::size_t unit)
+{
+    return (n + unit - 1) & ~(unit - 1);
+}
+
+//
+// Maps an anonymous region of "size" bytes, aligned to a huge page if
+// "huge". Reserved huge pages are tried first; failing that, a larger
+// region is trimmed to alignment and left to transparent huge pages.
+//
+static char*
+map_region(std::size_t size, bool huge)
+{
+    static const int prot = PROT_READ | PROT_WRITE;
+    static const int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+    const std::size_t unit = posixcc::buffer_pool::huge_page_size;
+
+    if (!huge) {
+        void* p = mmap(nullptr, size, prot, flags, -1, 0);
+        if (MAP_FAILED == p) {
+            throw std::runtime_error{errno_to_string(errno)};
+        }
+        return static_cast<char*>(p);
+    }
+
+    void* p = mmap(nullptr, size, prot, flags | MAP_HUGETLB, -1, 0);
+    if (MAP_FAILED != p) {
+        return static_cast<char*>(p);
+    }
+
+    p = mmap(nullptr, size + unit, prot, flags, -1, 0);
+    if (MAP_FAILED == p) {
+        throw std::runtime_error{errno_to_string(errno)};
+    }
+
+    char* const start = static_cast<char*>(p);
+    char* const aligned = reinterpret_cast<char*>(
+        round_up(reinterpret_cast<std::uintptr_t>(start), unit));
+
+    if (aligned > start) {
+        munmap(start, aligned - start);
+    }
+    if (start + unit > aligned) {
+        munmap(aligned + size, start + unit - aligned);
+    }
+    madvise(aligned, size, MADV_HUGEPAGE);
+
+    return aligned;
+}
+
+posixcc::io_buffer::io_buffer(buffer_pool* p, char* b,
+                              std::size_t l) noexcept:
+pool{p},
+base{b},
+length{l}
+{
+}
+
+posixcc::io_buffer::io_buffer(io_buffer&& b) noexcept:
+pool{b.pool},
+base{b.base},
+length{b.length}
+{
+    b.pool = nullptr;
+    b.base = nullptr;
+    b.length = 0;
+}
+
+posixcc::io_buffer::~io_buffer()
+{
+    release();
+}
+
+posixcc::io_buffer&
+posixcc::io_buffer::operator=(io_buffer&& b) noexcept
+{
+    if (this != &b) {
+        release();
+        std::swap(pool, b.pool);
+        std::swap(base, b.base);
+        std::swap(length, b.length);
+    }
+    return *this;
+}
+
+posixcc::io_buffer::operator bool() const noexcept
+{
+    return (nullptr != base);
+}
+
+char*
+posixcc::io_buffer::data() const noexcept
+{
+    return base;
+}
+
+std::size_t
+posixcc::io_buffer::size() const noexcept
+{
+    return length;
+}
+
+void
+posixcc::io_buffer::release() noexcept
+{
+    if (pool) {
+        pool->put(base);
+    }
+
+    pool = nullptr;
+    base = nullptr;
+    length = 0;
+}
+
+posixcc::buffer_pool::buffer_pool(std::size_t size, bool h,
+                                  std::size_t m):
+buffer_size{round_up(std::max<std::size_t>(size, 1),
+                     h ? huge_page_size :
+                     static_cast<std::size_t>(sysconf(_SC_PAGESIZE)))},
+huge{h},
+max_free{m}
+{
+}
+
+posixcc::buffer_pool::~buffer_pool()
+{
+    trim();
+}
+
+void
+posixcc::buffer_pool::put(char* base) noexcept
+{
+    {
+        std::lock_guard<std::mutex> guard{lock};
+
+        --outstanding;
+        if (free_list.size() < max_free) {
+            free_list.push_back(base);
+            return;
+        }
+    }
+
+    munmap(base, buffer_size);
+}
+
+posixcc::io_buffer
+posixcc::buffer_pool::get()
+{
+    char* base = nullptr;
+
+    {
+        std::lock_guard<std::mutex> guard{lock};
+
+        if (!free_list.empty()) {
+            base = free_list.back();
+            free_list.pop_back();
+        }
+        ++outstanding;
+    }
+
+    if (!base) {
+        try {
+            base = map_region(buffer_size, huge);
+        } catch (...) {
+            std::lock_guard<std::mutex> guard{lock};
+            --outstanding;
+            throw;
+        }
+    }
+
+    return io_buffer{this, base, buffer_size};
+}
+
+std::size_t
+posixcc::buffer_pool::get_buffer_size() const noexcept
+{
+    return buffer_size;
+}
+
+bool
+posixcc::buffer_pool::is_huge() const noexcept
+{
+    return huge;
+}
+
+std::size_t
+posixcc::buffer_pool::get_free() const noexcept
+{
+    std::lock_guard<std::mutex> guard{lock};
+    return free_list.size();
+}
+
+std::size_t
+posixcc::buffer_pool::get_outstanding() const noexcept
+{
+    std::lock_guard<std::mutex> guard{lock};
+    return outstanding;
+}
+
+void
+posixcc::buffer_pool::trim() noexcept
+{
+    std::vector<char*> unmapped;
+
+    {
+        std::lock_guard<std::mutex> guard{lock};
+        unmapped.swap(free_list);
+    }
+
+    for (char* base: unmapped) {
+        munmap(base, buffer_size);
+    }
+}
+
+#ifdef BUFFER_TEST
+#include <thread>
+#include "stfu/stfu.hh"
+
+static void
+pool_tests()
+{
+    const std::size_t page = sysconf(_SC_PAGESIZE);
+    posixcc::buffer_pool pool{1000, false, 2};
+
+    STFU_ASSERT(page == pool.get_buffer_size());
+    STFU_ASSERT(!pool.is_huge());
+
+    posixcc::io_buffer empty;
+    STFU_ASSERT(!empty && nullptr == empty.data() && 0 == empty.size());
+
+    // Buffers are page-aligned, writable and returned for reuse.
+    char* first;
+    {
+        posixcc::io_buffer a = pool.get();
+        STFU_ASSERT(a && page == a.size());
+        STFU_ASSERT(0 == reinterpret_cast<std::uintptr_t>(a.data()) % page);
+        memset(a.data(), 'x', a.size());
+        first = a.data();
+        STFU_ASSERT(1 == pool.get_outstanding() && 0 == pool.get_free());
+    }
+    STFU_ASSERT(0 == pool.get_outstanding() && 1 == pool.get_free());
+
+    posixcc::io_buffer b = pool.get();
+    STFU_ASSERT(first == b.data() && 'x' == b.data()[page - 1]);
+
+    // Moving hands the buffer over; releasing returns it early.
+    posixcc::io_buffer c{std::move(b)};
+    STFU_ASSERT(!b && c && first == c.data());
+    c.release();
+    STFU_ASSERT(!c && 1 == pool.get_free());
+
+    // The free list is bounded.
+    {
+        posixcc::io_buffer d[4] = {pool.get(), pool.get(), pool.get(),
+                                   pool.get()};
+        STFU_ASSERT(4 == pool.get_outstanding());
+    }
+    STFU_ASSERT(2 == pool.get_free());
+
+    pool.trim();
+    STFU_PASS_IFF(0 == pool.get_free());
+}
+
+static void
+huge_tests()
+{
+    const std::size_t huge = posixcc::buffer_pool::huge_page_size;
+    posixcc::buffer_pool pool{huge + 1, true};
+
+    STFU_ASSERT(2 * huge == pool.get_buffer_size() && pool.is_huge());
+
+    posixcc::io_buffer a = pool.get(), b = pool.get();
+    for (const auto* x: {&a, &b}) {
+        STFU_ASSERT(0 == reinterpret_cast<std::uintptr_t>(x->data()) % huge);
+    }
+    memset(a.data(), 'y', a.size());
+    memset(b.data(), 'z', b.size());
+
+    // Usable with the descriptor I/O helpers.
+    posixcc::auto_pipe p;
+    std::thread t{[&] {
+        posixcc::write_all(p.get_wfd(), a.data(), a.size(),
+                           std::chrono::seconds(10));
+    }};
+    const auto r = posixcc::read_exact(p.get_rfd(), b.data(), b.size(),
+                                       std::chrono::seconds(10));
+    t.join();
+    STFU_PASS_IFF(b.size() == r.bytes && 0 == memcmp(a.data(), b.data(),
+                                                     a.size()));
+}
+
+static void
+thread_tests()
+{
+    posixcc::buffer_pool pool{1 << 16, false, 4};
+    std::vector<std::thread> threads;
+
+    for (int i = 0; i < 4; ++i) {
+        threads.emplace_back([&pool] {
+            for (int j = 0; j < 1000; ++j) {
+                posixcc::io_buffer b = pool.get();
+                b.data()[0] = 1;
+            }
+        });
+    }
+    for (auto& t: threads) {
+        t.join();
+    }
+
+    STFU_PASS_IFF(0 == pool.get_outstanding() && 4 >= pool.get_free());
+}
+
+extern "C" std::size_t
+unit_tests()
+{
+    stfu::test_group group{"buffer tests",
+        "Tests of the I/O buffer pool."};
+    group.add_test(stfu::test{"pool",
+            pool_tests,
+            "Verify that buffers are aligned, and reused from a bounded free "
+            "list."})
+         .add_test(stfu::test{"huge",
+            huge_tests,
+            "Verify huge page aligned buffers, used for I/O."})
+         .add_test(stfu::test{"threads",
+            thread_tests,
+            "Verify that a pool can be shared among threads."});
+
+    stfu::test_result_summary summary = group();
+    return summary.failed + summary.crashed + summary.timed_out +
+        summary.regressed;
+}
+#endif // BUFFER_TEST
+
+#ifdef BUFFER_BENCH
+#include <cstdlib>
+#include <memory>
+#include <fcntl.h>
+#include "stfu/stfu.hh"
+
+//
+// Size of the buffers walked by the TLB benchmarks.
+//
+static const std::size_t region = 1 << 29;
+
+//
+// Keeps the reads of walk() from being optimized away.
+//
+volatile char walk_sink;
+
+//
+// Reads one byte in each of "n" pages chosen pseudo-randomly from "data",
+// so that nearly every access needs a fresh TLB entry. Reading avoids the
+// copy-on-write faults writing would take in the forked benchmark process.
+//
+static void
+walk(const char* data, std::size_t n)
+{
+    static const std::size_t pages = region >> 12;
+    static std::uint64_t x = 88172645463325252ULL;
+    char sum = 0;
+
+    for (std::size_t i = 0; i < n; ++i) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        sum += data[(x % pages) << 12];
+    }
+
+    walk_sink = sum;
+}
+
+//
+// Copies "data" in 1 MiB chunks "n" times over through a pipe, with
+// vmsplice() on the way in, as in a multi-GB sequential transfer.
+//
+static void
+transfer(char* data, std::size_t n)
+{
+    static const std::size_t chunk = 1 << 20;
+    posixcc::auto_pipe p;
+    std::size_t offset = 0;
+
+    fcntl(p.get_wfd(), F_SETPIPE_SZ, chunk);
+    for (std::size_t i = 0; i < n; ++i) {
+        struct iovec v{data + offset, chunk};
+        while (v.iov_len) {
+            const ssize_t l = vmsplice(p.get_wfd(), &v, 1, 0);
+            STFU_ASSERT(0 < l);
+            v.iov_base = static_cast<char*>(v.iov_base) + l;
+            v.iov_len -= l;
+            posixcc::read_exact(p.get_rfd(), data + offset, l,
+                                std::chrono::seconds(1));
+        }
+        offset = (offset + chunk) % region;
+    }
+}
+
+extern "C" std::size_t
+unit_tests()
+{
+    // Mapped up front and faulted in once, as a pool would keep them.
+    posixcc::buffer_pool small{region}, huge{region, true};
+    posixcc::io_buffer pages = small.get(), huge_pages = huge.get();
+    std::unique_ptr<char, void (*)(void*)> heap{
+        static_cast<char*>(malloc(region)), free};
+
+    memset(heap.get(), 1, region);
+    memset(pages.data(), 1, region);
+    memset(huge_pages.data(), 1, region);
+
+    stfu::benchmark map{"map", [](std::size_t n) {
+            posixcc::buffer_pool pool{1 << 20, false, 0};
+            for (std::size_t i = 0; i < n; ++i) {
+                posixcc::io_buffer b = pool.get();
+                b.data()[0] = 1;
+            }
+        },
+        "Get a 1 MiB buffer, mapped afresh each time, and touch it."
+    };
+    stfu::benchmark pooled{"pooled", [](std::size_t n) {
+            posixcc::buffer_pool pool{1 << 20};
+            for (std::size_t i = 0; i < n; ++i) {
+                posixcc::io_buffer b = pool.get();
+                b.data()[0] = 1;
+            }
+        },
+        "Get a 1 MiB buffer from the free list, and touch it."
+    };
+    stfu::benchmark walk_heap{"walk malloc", [&](std::size_t n) {
+            walk(heap.get(), n);
+        },
+        "Touch random pages of a 512 MiB buffer from malloc()."
+    };
+    stfu::benchmark walk_pages{"walk pages", [&](std::size_t n) {
+            walk(pages.data(), n);
+        },
+        "Touch random pages of a 512 MiB page-aligned buffer."
+    };
+    stfu::benchmark walk_huge{"walk huge", [&](std::size_t n) {
+            walk(huge_pages.data(), n);
+        },
+        "Touch random pages of a 512 MiB huge page buffer."
+    };
+    stfu::benchmark copy_pages{"transfer pages", [&](std::size_t n) {
+            transfer(pages.data(), n);
+        },
+        "Pass a 512 MiB page-aligned buffer through a pipe in 1 MiB chunks."
+    };
+    stfu::benchmark copy_huge{"transfer huge", [&](std::size_t n) {
+            transfer(huge_pages.data(), n);
+        },
+        "Pass a 512 MiB huge page buffer through a pipe in 1 MiB chunks."
+    };
+    copy_pages.set_bytes_per_op(1 << 20);
+    copy_huge.set_bytes_per_op(1 << 20);
+
+    stfu::test_group group{"buffer benchmarks",
+        "Cost of buffer allocation, and of TLB misses."};
+    group.add_test(map)
+         .add_test(pooled)
+         .add_test(walk_heap)
+         .add_test(walk_pages)
+         .add_test(walk_huge)
+         .add_test(copy_pages)
+         .add_test(copy_huge)
+         .set_jobs(1);
+
+    stfu::test_result_summary summary = group();
+    return summary.failed + summary.crashed + summary.timed_out +
+        summary.regressed;
+}
+#endif // BUFFER_BENCH
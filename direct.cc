@@ -0,0 +1,741 @@
+//
+// Copyright (c) 2025 Bryan Phillippe
+//
+// This software is free to use for any purpose, provided this copyright
+// notice is preserved.
+//
+
+#include <algorithm>
+#include <cerrno>
+#include <limits>
+#include <vector>
+
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/aio_abi.h>
+
+#include <libposix.hh>
+
+//
+// Alignment assumed when statx() can not tell; enough for any common
+// device.
+//
+static const std::size_t fallback_align = 4096;
+
+//
+// Marks an AIO request which has not completed yet.
+//
+static const std::int64_t pending = std::numeric_limits<std::int64_t>::min();
+
+static std::uint64_t
+round_down(std::uint64_t n, std::size_t unit)
+{
+    return n - n % unit;
+}
+
+static std::uint64_t
+round_up(std::uint64_t n, std::size_t unit)
+{
+    return round_down(n + unit - 1, unit);
+}
+
+static bool
+is_aligned(const void* p, std::size_t unit)
+{
+    return 0 == reinterpret_cast<std::uintptr_t>(p) % unit;
+}
+
+//
+// Reads or writes up to "length" bytes at "offset" with a single transfer,
+// resumed if interrupted; returns the number of bytes transferred, short
+// only at the end of the file.
+//
+static std::size_t
+transfer(int fd, char* data, std::size_t length, off_t offset, bool writing)
+{
+    ssize_t l;
+
+    do {
+        l = writing ? pwrite(fd, data, length, offset) :
+                      pread(fd, data, length, offset);
+    } while (-1 == l && EINTR == errno);
+
+    if (-1 == l) {
+        throw std::runtime_error{errno_to_string(errno)};
+    }
+
+    return l;
+}
+
+posixcc::direct_file::direct_file(const std::string& path, int flags,
+                                  mode_t mode, std::size_t chunk_size,
+                                  std::size_t d):
+fd{open(path.c_str(),
+        // Unaligned writes read the blocks around them.
+        ((O_WRONLY == (flags & O_ACCMODE)) ? (flags & ~O_ACCMODE) | O_RDWR :
+         flags) | O_DIRECT | O_CLOEXEC,
+        mode)},
+chunk{chunk_size},
+depth{std::max<std::size_t>(d, 1)},
+pool{chunk_size, false, depth + 1}
+{
+    if (!fd) {
+        throw std::runtime_error{errno_to_string(errno)};
+    }
+
+#ifdef STATX_DIOALIGN
+    struct statx s;
+
+    if (0 == statx(fd, "", AT_EMPTY_PATH, STATX_DIOALIGN, &s) &&
+        (s.stx_mask & STATX_DIOALIGN)) {
+        // No alignment means no direct I/O for this file.
+        if (!s.stx_dio_mem_align || !s.stx_dio_offset_align) {
+            throw std::runtime_error{errno_to_string(EINVAL)};
+        }
+        memory_align = s.stx_dio_mem_align;
+        offset_align = s.stx_dio_offset_align;
+    }
+#endif
+
+    if (!memory_align) {
+        memory_align = offset_align = fallback_align;
+    }
+
+    // Pool buffers are page-aligned and sized, which satisfies any device
+    // with blocks no larger than a page.
+    chunk = pool.get_buffer_size();
+    if (chunk % offset_align || memory_align > chunk ||
+        chunk % memory_align) {
+        throw std::runtime_error{errno_to_string(EINVAL)};
+    }
+    bounce = pool.get();
+
+    // Scans fall back to synchronous reads without AIO.
+    aio_context_t context = 0;
+    if (0 == syscall(SYS_io_setup, depth, &context)) {
+        aio = context;
+    }
+}
+
+posixcc::direct_file::~direct_file()
+{
+    if (aio) {
+        syscall(SYS_io_destroy, static_cast<aio_context_t>(aio));
+    }
+}
+
+int
+posixcc::direct_file::get() const noexcept
+{
+    return fd.get();
+}
+
+std::size_t
+posixcc::direct_file::get_memory_alignment() const noexcept
+{
+    return memory_align;
+}
+
+std::size_t
+posixcc::direct_file::get_offset_alignment() const noexcept
+{
+    return offset_align;
+}
+
+std::size_t
+posixcc::direct_file::get_size() const
+{
+    struct stat s;
+
+    if (-1 == fstat(fd, &s)) {
+        throw std::runtime_error{errno_to_string(errno)};
+    }
+
+    return s.st_size;
+}
+
+std::size_t
+posixcc::direct_file::read(void* data, std::size_t length, off_t offset)
+{
+    char* const p = static_cast<char*>(data);
+    std::size_t done = 0;
+
+    while (done < length) {
+        const off_t pos = offset + done;
+        const std::size_t left = length - done;
+
+        // Aligned whole blocks go straight to the caller's memory.
+        if (0 == pos % offset_align && is_aligned(p + done, memory_align) &&
+            left >= offset_align) {
+            const std::size_t n = round_down(std::min(left, chunk * depth),
+                                             offset_align);
+            const std::size_t l = transfer(fd, p + done, n, pos, false);
+
+            done += l;
+            if (l < n) {
+                break;
+            }
+            continue;
+        }
+
+        // Otherwise bounce the block at "pos", if the caller's memory lines
+        // up after it, or else as much as fits.
+        const off_t start = round_down(pos, offset_align);
+        const std::size_t head = pos - start;
+        const std::size_t rest = offset_align - head;
+        const std::size_t span = (left > rest &&
+                                  is_aligned(p + done + rest, memory_align)) ?
+            offset_align :
+            std::min<std::size_t>(chunk, round_up(head + left, offset_align));
+
+        const std::size_t l = transfer(fd, bounce.data(), span, start, false);
+        if (l <= head) {
+            break;
+        }
+
+        const std::size_t n = std::min(l - head, left);
+        memcpy(p + done, bounce.data() + head, n);
+        done += n;
+        if (l < span) {
+            break;
+        }
+    }
+
+    return done;
+}
+
+std::size_t
+posixcc::direct_file::write(const void* data, std::size_t length,
+                            off_t offset)
+{
+    const char* const p = static_cast<const char*>(data);
+    const std::size_t size = get_size();
+    std::size_t done = 0;
+
+    while (done < length) {
+        const off_t pos = offset + done;
+        const std::size_t left = length - done;
+
+        if (0 == pos % offset_align && is_aligned(p + done, memory_align) &&
+            left >= offset_align) {
+            const std::size_t n = round_down(std::min(left, chunk * depth),
+                                             offset_align);
+            const std::size_t l = transfer(fd, const_cast<char*>(p + done),
+                                           n, pos, true);
+
+            done += l;
+            if (l < n) {
+                break;
+            }
+            continue;
+        }
+
+        const off_t start = round_down(pos, offset_align);
+        const std::size_t head = pos - start;
+        const std::size_t rest = offset_align - head;
+        const std::size_t span = (left > rest &&
+                                  is_aligned(p + done + rest, memory_align)) ?
+            offset_align :
+            std::min<std::size_t>(chunk, round_up(head + left, offset_align));
+        const std::size_t n = std::min(span - head, left);
+        char* const b = bounce.data();
+
+        // Blocks only partly written are read first, and zero past the end
+        // of the file.
+        if (head) {
+            const std::size_t l = transfer(fd, b, offset_align, start, false);
+            memset(b + l, 0, offset_align - l);
+        }
+        const std::size_t last = round_down(head + n, offset_align);
+        if ((head + n) % offset_align && (last || !head)) {
+            const std::size_t l = transfer(fd, b + last, offset_align,
+                                           start + last, false);
+            memset(b + last + l, 0, offset_align - l);
+        }
+
+        memcpy(b + head, p + done, n);
+        if (span != transfer(fd, b, span, start, true)) {
+            throw std::runtime_error{errno_to_string(EIO)};
+        }
+        done += n;
+    }
+
+    // Whole blocks written past the end of the data are cut back to it.
+    const std::size_t end = std::max<std::size_t>(size, offset + done);
+    if (get_size() > end && -1 == ftruncate(fd, end)) {
+        throw std::runtime_error{errno_to_string(errno)};
+    }
+
+    return done;
+}
+
+std::size_t
+posixcc::direct_file::scan(off_t offset, std::size_t length,
+                           const consumer& f)
+{
+    const std::uint64_t stop =
+        (length > std::numeric_limits<std::uint64_t>::max() - offset) ?
+        std::numeric_limits<std::uint64_t>::max() : offset + length;
+    std::uint64_t next = round_down(offset, offset_align);
+    std::size_t skip = offset - next;
+    std::size_t total = 0;
+
+    if (!aio) {
+        while (next < stop) {
+            const std::size_t l = transfer(fd, bounce.data(), chunk, next,
+                                           false);
+            if (l <= skip) {
+                break;
+            }
+
+            const std::size_t n = std::min<std::uint64_t>(
+                l - skip, stop - next - skip);
+            f(bounce.data() + skip, n);
+            total += n;
+            next += chunk;
+            skip = 0;
+            if (l < chunk) {
+                break;
+            }
+        }
+        return total;
+    }
+
+    // Requests complete in any order, into a ring of "depth" buffers, and
+    // are passed on in order.
+    std::vector<io_buffer> buffers;
+    std::vector<struct iocb> blocks(depth);
+    std::vector<struct iocb*> batch;
+    std::vector<struct io_event> events(depth);
+    std::vector<std::int64_t> results(depth, pending);
+    std::uint64_t issued = 0, completed = 0, delivered = 0;
+    bool end = false;
+
+    for (std::size_t i = 0; i < depth; ++i) {
+        buffers.push_back(pool.get());
+    }
+
+    const auto reap = [&] {
+        long n;
+
+        do {
+            n = syscall(SYS_io_getevents, static_cast<aio_context_t>(aio),
+                        1L, static_cast<long>(depth), events.data(),
+                        nullptr);
+        } while (-1 == n && EINTR == errno);
+
+        if (-1 == n) {
+            throw std::runtime_error{errno_to_string(errno)};
+        }
+
+        for (long i = 0; i < n; ++i) {
+            results[events[i].data % depth] = events[i].res;
+        }
+        completed += n;
+    };
+
+    try {
+        while (!end) {
+            // Keep the pipeline full.
+            batch.clear();
+            while (issued - delivered < depth && next < stop) {
+                struct iocb& b = blocks[issued % depth];
+
+                b = {};
+                b.aio_data = issued;
+                b.aio_lio_opcode = IOCB_CMD_PREAD;
+                b.aio_fildes = fd.get();
+                b.aio_buf = reinterpret_cast<std::uintptr_t>(
+                    buffers[issued % depth].data());
+                b.aio_nbytes = chunk;
+                b.aio_offset = next;
+                results[issued % depth] = pending;
+                batch.push_back(&b);
+
+                next += chunk;
+                ++issued;
+            }
+
+            for (std::size_t submitted = 0; submitted < batch.size();) {
+                const long r = syscall(SYS_io_submit,
+                                       static_cast<aio_context_t>(aio),
+                                       static_cast<long>(batch.size() -
+                                                         submitted),
+                                       batch.data() + submitted);
+                if (-1 == r) {
+                    if (EINTR == errno) {
+                        continue;
+                    }
+                    issued -= batch.size() - submitted;
+                    throw std::runtime_error{errno_to_string(errno)};
+                }
+                submitted += r;
+            }
+
+            if (issued == delivered) {
+                break;
+            }
+
+            const std::size_t slot = delivered % depth;
+            while (pending == results[slot]) {
+                reap();
+            }
+            if (0 > results[slot]) {
+                throw std::runtime_error{errno_to_string(-results[slot])};
+            }
+
+            const std::size_t l = results[slot];
+            if (l > skip) {
+                const std::size_t n = std::min<std::uint64_t>(
+                    l - skip,
+                    stop - static_cast<std::uint64_t>(
+                        blocks[slot].aio_offset) - skip);
+                f(buffers[slot].data() + skip, n);
+                total += n;
+            }
+
+            ++delivered;
+            skip = 0;
+            end = (l < chunk);
+        }
+    } catch (...) {
+        // The buffers may not be released while still being read into.
+        // Failing that, destroying the context waits for them, and later
+        // scans do without AIO.
+        try {
+            while (completed < issued) {
+                reap();
+            }
+        } catch (...) {
+            syscall(SYS_io_destroy, static_cast<aio_context_t>(aio));
+            aio = 0;
+        }
+        throw;
+    }
+
+    // Read ahead past the end of the file.
+    while (completed < issued) {
+        reap();
+    }
+
+    return total;
+}
+
+#ifdef DIRECT_TEST
+#include <sys/mman.h>
+#include "stfu/stfu.hh"
+
+//
+// Creates an empty file to test with, returning its path.
+//
+static std::string
+temp_file()
+{
+    char path[] = "/var/tmp/posixcc-direct-XXXXXX";
+    const int fd = mkstemp(path);
+
+    STFU_ASSERT(-1 != fd);
+    ::close(fd);
+    return path;
+}
+
+//
+// Returns "length" bytes of a pattern which differs at every offset.
+//
+static std::vector<char>
+pattern(std::size_t length, std::size_t seed)
+{
+    std::vector<char> data(length);
+
+    for (std::size_t i = 0; i < length; ++i) {
+        data[i] = static_cast<char>((i * 7 + seed) % 253);
+    }
+
+    return data;
+}
+
+static void
+read_write_tests()
+{
+    const std::string path = temp_file();
+    posixcc::direct_file file{path, O_RDWR};
+
+    const std::size_t align = file.get_offset_alignment();
+    STFU_ASSERT(file.get() != -1 && 0 < align && 0 == (align & (align - 1)));
+    STFU_ASSERT(0 < file.get_memory_alignment());
+
+    // An unaligned write into an empty file, from unaligned memory.
+    std::vector<char> expected(3 << 20, '\0');
+    const auto a = pattern((3 << 20) - 1000, 1);
+    STFU_ASSERT(a.size() == file.write(a.data(), a.size(), 777));
+    std::copy(a.begin(), a.end(), expected.begin() + 777);
+    STFU_ASSERT(777 + a.size() == file.get_size());
+
+    // Small writes within a block, and across block boundaries.
+    const auto b = pattern(10, 2), c = pattern(2 * align, 3);
+    file.write(b.data(), b.size(), 5);
+    file.write(c.data(), c.size(), align - 3);
+    std::copy(b.begin(), b.end(), expected.begin() + 5);
+    std::copy(c.begin(), c.end(), expected.begin() + align - 3);
+
+    // An aligned write from aligned memory extends the file.
+    posixcc::buffer_pool pool{1 << 20};
+    posixcc::io_buffer d = pool.get();
+    const auto e = pattern(d.size(), 4);
+    std::copy(e.begin(), e.end(), d.data());
+    file.write(d.data(), d.size(), 3 << 20);
+    expected.insert(expected.end(), e.begin(), e.end());
+    STFU_ASSERT(expected.size() == file.get_size());
+
+    // Reads at every alignment agree, including one past the end.
+    std::vector<char> got(expected.size() + 1);
+    STFU_ASSERT(expected.size() == file.read(got.data(), got.size(), 0));
+    STFU_ASSERT(std::equal(expected.begin(), expected.end(), got.begin()));
+    STFU_ASSERT(1000 == file.read(got.data() + 1, 1000, align + 1));
+    STFU_ASSERT(std::equal(got.begin() + 1, got.begin() + 1001,
+                           expected.begin() + align + 1));
+    STFU_ASSERT(d.size() == file.read(d.data(), d.size(), 3 << 20));
+    STFU_ASSERT(std::equal(e.begin(), e.end(), d.data()));
+    STFU_ASSERT(0 == file.read(got.data(), 10, expected.size()));
+
+    unlink(path.c_str());
+    STFU_PASS();
+}
+
+static void
+scan_tests()
+{
+    const std::string path = temp_file();
+    const auto data = pattern((5 << 20) + 123, 5);
+    {
+        posixcc::direct_file file{path, O_WRONLY};
+        STFU_ASSERT(data.size() == file.write(data.data(), data.size(), 0));
+    }
+
+    // A small chunk size, so that many reads are in flight.
+    posixcc::direct_file file{path, O_RDONLY, 0, 1 << 16, 8};
+    std::vector<char> got;
+    const auto collect = [&](const char* d, std::size_t l) {
+        got.insert(got.end(), d, d + l);
+    };
+
+    // Up to the end of the file, from an unaligned offset.
+    STFU_ASSERT(data.size() - 777 ==
+                file.scan(777, std::numeric_limits<std::size_t>::max(),
+                          collect));
+    STFU_ASSERT(std::equal(got.begin(), got.end(), data.begin() + 777));
+
+    // A range within the file.
+    got.clear();
+    STFU_ASSERT(300000 == file.scan(100000, 300000, collect));
+    STFU_ASSERT(std::equal(got.begin(), got.end(), data.begin() + 100000));
+
+    // Errors thrown by the consumer pass through.
+    bool thrown = false;
+    try {
+        file.scan(0, data.size(), [](const char*, std::size_t) {
+            throw std::runtime_error{"stop"};
+        });
+    } catch (const std::runtime_error&) {
+        thrown = true;
+    }
+    STFU_ASSERT(thrown);
+
+    // Direct reads leave nothing in the page cache.
+    posix_fadvise(file.get(), 0, 0, POSIX_FADV_DONTNEED);
+    file.scan(0, data.size(), [](const char*, std::size_t) {});
+
+    const std::size_t page = sysconf(_SC_PAGESIZE);
+    const std::size_t pages = (data.size() + page - 1) / page;
+    std::vector<unsigned char> resident(pages);
+    posixcc::auto_fd plain{open(path.c_str(), O_RDONLY)};
+    void* m = mmap(nullptr, data.size(), PROT_READ, MAP_SHARED, plain, 0);
+    STFU_ASSERT(MAP_FAILED != m);
+    mincore(m, data.size(), resident.data());
+    munmap(m, data.size());
+
+    unlink(path.c_str());
+    STFU_PASS_IFF(0 == std::count_if(resident.begin(), resident.end(),
+                                     [](unsigned char r) { return r & 1; }));
+}
+
+extern "C" std::size_t
+unit_tests()
+{
+    stfu::test_group group{"direct tests",
+        "Tests of direct file I/O."};
+    group.add_test(stfu::test{"read and write",
+            read_write_tests,
+            "Verify direct reads and writes at any alignment."})
+         .add_test(stfu::test{"scan",
+            scan_tests,
+            "Verify pipelined scans, and that they bypass the page cache."})
+         .set_timeout(std::chrono::seconds(30));
+
+    stfu::test_result_summary summary = group();
+    return summary.failed + summary.crashed + summary.timed_out +
+        summary.regressed;
+}
+#endif // DIRECT_TEST
+
+#ifdef DIRECT_BENCH
+#include <memory>
+#include "stfu/stfu.hh"
+
+static const std::size_t chunk_size = 1 << 20;
+static const std::size_t data_size = 256 << 20;
+static const std::size_t hot_size = 32 << 20;
+
+//
+// Creates a file of "size" bytes, flushed to disk and dropped from the page
+// cache, returning its path.
+//
+static std::string
+create(std::size_t size)
+{
+    char path[] = "/var/tmp/posixcc-direct-XXXXXX";
+    posixcc::auto_fd fd{mkstemp(path)};
+    const std::vector<char> data(chunk_size, 'x');
+
+    for (std::size_t i = 0; i < size; i += chunk_size) {
+        STFU_ASSERT(static_cast<ssize_t>(chunk_size) ==
+                    ::write(fd, data.data(), chunk_size));
+    }
+    fsync(fd);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+
+    return path;
+}
+
+//
+// Reads "n" chunks of the file at "fd" through the page cache, from "pos"
+// on, wrapping around at its end; with "drop", each pass is dropped from
+// the cache, so that every pass reads from the device.
+//
+static void
+buffered_scan(int fd, std::size_t& pos, std::size_t n, bool drop)
+{
+    static std::vector<char> buffer(chunk_size);
+
+    for (std::size_t i = 0; i < n; ++i) {
+        if (data_size == pos) {
+            if (drop) {
+                posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+            }
+            pos = 0;
+        }
+        pos += pread(fd, buffer.data(), chunk_size, pos);
+    }
+}
+
+//
+// Scans "n" chunks of "file" directly, from "pos" on, wrapping around.
+//
+static void
+direct_scan(posixcc::direct_file& file, std::size_t& pos, std::size_t n)
+{
+    while (n) {
+        const std::size_t l = std::min(n * chunk_size, data_size - pos);
+
+        file.scan(pos, l, [](const char*, std::size_t) {});
+        pos = (pos + l) % data_size;
+        n -= l / chunk_size;
+    }
+}
+
+//
+// Returns a direct_file for "path", opened on first use in the benchmark
+// process, as AIO contexts are neither inherited across fork() nor cheap
+// to destroy.
+//
+static posixcc::direct_file&
+direct_file(const std::string& path)
+{
+    static std::unique_ptr<posixcc::direct_file> file;
+
+    if (!file) {
+        file.reset(new posixcc::direct_file{path});
+    }
+
+    return *file;
+}
+
+//
+// Reads 16 random pages of the file at "fd", as a workload whose data is
+// meant to stay cached.
+//
+static void
+hot_reads(int fd)
+{
+    static std::uint64_t x = 88172645463325252ULL;
+    char page[4096];
+
+    for (int i = 0; i < 16; ++i) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        pread(fd, page, sizeof(page), (x % (hot_size / 4096)) * 4096);
+    }
+}
+
+extern "C" std::size_t
+unit_tests()
+{
+    const std::string data_path = create(data_size);
+    const std::string hot_path = create(hot_size);
+    const posixcc::auto_fd data{open(data_path.c_str(), O_RDONLY)};
+    const posixcc::auto_fd hot{open(hot_path.c_str(), O_RDONLY)};
+    std::size_t pos = 0;
+
+    stfu::benchmark buffered{"buffered scan", [&](std::size_t n) {
+            buffered_scan(data, pos, n, true);
+        },
+        "Read a 256 MiB file 1 MiB at a time through the page cache, "
+        "dropping it after each pass."
+    };
+    stfu::benchmark direct{"direct scan", [&](std::size_t n) {
+            direct_scan(direct_file(data_path), pos, n);
+        },
+        "Scan a 256 MiB file with direct I/O, 1 MiB at a time with 4 "
+        "reads in flight."
+    };
+    stfu::benchmark hot_buffered{"hot, buffered scan", [&](std::size_t n) {
+            for (std::size_t i = 0; i < n; ++i) {
+                buffered_scan(data, pos, 1, false);
+                hot_reads(hot);
+            }
+        },
+        "Read 16 random pages of a 32 MiB hot file, alongside each 1 MiB "
+        "of a buffered scan filling the page cache."
+    };
+    stfu::benchmark hot_direct{"hot, direct scan", [&](std::size_t n) {
+            for (std::size_t i = 0; i < n; ++i) {
+                direct_scan(direct_file(data_path), pos, 1);
+                hot_reads(hot);
+            }
+        },
+        "Read 16 random pages of a 32 MiB hot file, alongside each 1 MiB "
+        "of a direct scan."
+    };
+    for (auto* b: {&buffered, &direct, &hot_buffered, &hot_direct}) {
+        b->set_bytes_per_op(chunk_size);
+    }
+
+    stfu::test_group group{"direct benchmarks",
+        "Direct against buffered streaming."};
+    group.add_test(buffered)
+         .add_test(direct)
+         .add_test(hot_buffered)
+         .add_test(hot_direct)
+         .set_jobs(1);
+
+    stfu::test_result_summary summary = group();
+
+    unlink(data_path.c_str());
+    unlink(hot_path.c_str());
+
+    return summary.failed + summary.crashed + summary.timed_out +
+        summary.regressed;
+}
+#endif // DIRECT_BENCH
@@ -0,0 +1,515 @@
+//
+// Copyright (c) 2025 Bryan Phillippe
+//
+// This software is free to use for any purpose, provided this copyright
+// notice is preserved.
+//
+
+#include <cerrno>
+
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+
+#include <libposix.hh>
+
+//
+// Converts a duration to a timespec.
+//
+static struct timespec
+to_timespec(std::chrono::nanoseconds d)
+{
+    struct timespec t;
+
+    t.tv_sec = std::chrono::duration_cast<std::chrono::seconds>(d).count();
+    t.tv_nsec = (d - std::chrono::seconds(t.tv_sec)).count();
+
+    return t;
+}
+
+posixcc::event_fd::event_fd(unsigned int initial, bool semaphore):
+fd{eventfd(initial,
+           EFD_CLOEXEC | EFD_NONBLOCK | (semaphore ? EFD_SEMAPHORE : 0))}
+{
+    if (!fd) {
+        throw std::runtime_error{errno_to_string(errno)};
+    }
+}
+
+int
+posixcc::event_fd::get() const noexcept
+{
+    return fd.get();
+}
+
+posixcc::event_fd::operator bool() const noexcept
+{
+    return static_cast<bool>(fd);
+}
+
+bool
+posixcc::event_fd::notify(std::uint64_t n) const
+{
+    ssize_t r;
+
+    do {
+        r = write(fd, &n, sizeof(n));
+    } while (-1 == r && EINTR == errno);
+
+    if (-1 == r) {
+        if (EAGAIN == errno) {
+            return false;
+        }
+        throw std::runtime_error{errno_to_string(errno)};
+    }
+
+    return true;
+}
+
+std::uint64_t
+posixcc::event_fd::consume() const
+{
+    std::uint64_t n;
+    ssize_t r;
+
+    do {
+        r = read(fd, &n, sizeof(n));
+    } while (-1 == r && EINTR == errno);
+
+    if (-1 == r) {
+        if (EAGAIN == errno) {
+            return 0;
+        }
+        throw std::runtime_error{errno_to_string(errno)};
+    }
+
+    return n;
+}
+
+posixcc::signal_fd::signal_fd(std::initializer_list<int> signals)
+{
+    sigemptyset(&mask);
+    sigemptyset(&blocked);
+
+    for (const int signo: signals) {
+        if (-1 == sigaddset(&mask, signo)) {
+            throw std::runtime_error{errno_to_string(errno)};
+        }
+    }
+
+    update();
+}
+
+posixcc::signal_fd::~signal_fd()
+{
+    // Discard whatever is still pending, rather than have it delivered,
+    // likely with a fatal default action, as soon as it is unblocked.
+    const struct timespec none{0, 0};
+    while (0 < sigtimedwait(&blocked, nullptr, &none)) {
+    }
+
+    pthread_sigmask(SIG_UNBLOCK, &blocked, nullptr);
+}
+
+void
+posixcc::signal_fd::update()
+{
+    sigset_t current;
+    int r;
+
+    // Block the signals not already blocked, remembering which those were.
+    if (0 != (r = pthread_sigmask(SIG_BLOCK, nullptr, &current))) {
+        throw std::runtime_error{errno_to_string(r)};
+    }
+    for (int signo = 1; signo < NSIG; ++signo) {
+        if (1 == sigismember(&mask, signo) &&
+            0 == sigismember(&current, signo)) {
+            sigaddset(&blocked, signo);
+        }
+    }
+    if (0 != (r = pthread_sigmask(SIG_BLOCK, &mask, nullptr))) {
+        throw std::runtime_error{errno_to_string(r)};
+    }
+
+    const int s = signalfd(fd ? fd.get() : -1, &mask,
+                           SFD_CLOEXEC | SFD_NONBLOCK);
+    if (-1 == s) {
+        throw std::runtime_error{errno_to_string(errno)};
+    }
+    if (!fd) {
+        fd = s;
+    }
+}
+
+int
+posixcc::signal_fd::get() const noexcept
+{
+    return fd.get();
+}
+
+posixcc::signal_fd::operator bool() const noexcept
+{
+    return static_cast<bool>(fd);
+}
+
+posixcc::signal_fd&
+posixcc::signal_fd::add(int signo)
+{
+    if (-1 == sigaddset(&mask, signo)) {
+        throw std::runtime_error{errno_to_string(errno)};
+    }
+
+    update();
+    return *this;
+}
+
+posixcc::signal_fd&
+posixcc::signal_fd::remove(int signo)
+{
+    if (-1 == sigdelset(&mask, signo)) {
+        throw std::runtime_error{errno_to_string(errno)};
+    }
+
+    // Only a signal this object blocked is unblocked again.
+    update();
+    if (1 == sigismember(&blocked, signo)) {
+        sigset_t one;
+        sigemptyset(&one);
+        sigaddset(&one, signo);
+
+        const struct timespec none{0, 0};
+        while (0 < sigtimedwait(&one, nullptr, &none)) {
+        }
+
+        pthread_sigmask(SIG_UNBLOCK, &one, nullptr);
+        sigdelset(&blocked, signo);
+    }
+
+    return *this;
+}
+
+bool
+posixcc::signal_fd::read(struct signalfd_siginfo& info) const
+{
+    ssize_t r;
+
+    do {
+        r = ::read(fd, &info, sizeof(info));
+    } while (-1 == r && EINTR == errno);
+
+    if (-1 == r) {
+        if (EAGAIN == errno) {
+            return false;
+        }
+        throw std::runtime_error{errno_to_string(errno)};
+    }
+
+    return sizeof(info) == r;
+}
+
+posixcc::timer_fd::timer_fd(clockid_t clock):
+fd{timerfd_create(clock, TFD_CLOEXEC | TFD_NONBLOCK)}
+{
+    if (!fd) {
+        throw std::runtime_error{errno_to_string(errno)};
+    }
+}
+
+int
+posixcc::timer_fd::get() const noexcept
+{
+    return fd.get();
+}
+
+posixcc::timer_fd::operator bool() const noexcept
+{
+    return static_cast<bool>(fd);
+}
+
+posixcc::timer_fd&
+posixcc::timer_fd::set(std::chrono::nanoseconds after,
+                       std::chrono::nanoseconds interval)
+{
+    struct itimerspec spec{to_timespec(interval), to_timespec(after)};
+
+    // A zero value would disarm the timer instead.
+    if (0 == spec.it_value.tv_sec && 0 == spec.it_value.tv_nsec) {
+        spec.it_value.tv_nsec = 1;
+    }
+
+    if (-1 == timerfd_settime(fd, 0, &spec, nullptr)) {
+        throw std::runtime_error{errno_to_string(errno)};
+    }
+
+    cancelled = false;
+    return *this;
+}
+
+posixcc::timer_fd&
+posixcc::timer_fd::set_at(std::chrono::nanoseconds when,
+                          std::chrono::nanoseconds interval,
+                          bool cancel_on_set)
+{
+    struct itimerspec spec{to_timespec(interval), to_timespec(when)};
+    const int flags = TFD_TIMER_ABSTIME |
+        (cancel_on_set ? TFD_TIMER_CANCEL_ON_SET : 0);
+
+    if (0 == spec.it_value.tv_sec && 0 == spec.it_value.tv_nsec) {
+        spec.it_value.tv_nsec = 1;
+    }
+
+    if (-1 == timerfd_settime(fd, flags, &spec, nullptr)) {
+        throw std::runtime_error{errno_to_string(errno)};
+    }
+
+    cancelled = false;
+    return *this;
+}
+
+posixcc::timer_fd&
+posixcc::timer_fd::disarm()
+{
+    const struct itimerspec spec{};
+
+    if (-1 == timerfd_settime(fd, 0, &spec, nullptr)) {
+        throw std::runtime_error{errno_to_string(errno)};
+    }
+
+    return *this;
+}
+
+std::chrono::nanoseconds
+posixcc::timer_fd::get_remaining() const
+{
+    struct itimerspec spec;
+
+    if (-1 == timerfd_gettime(fd, &spec)) {
+        throw std::runtime_error{errno_to_string(errno)};
+    }
+
+    return std::chrono::seconds(spec.it_value.tv_sec) +
+        std::chrono::nanoseconds(spec.it_value.tv_nsec);
+}
+
+std::uint64_t
+posixcc::timer_fd::expirations() const
+{
+    std::uint64_t n;
+    ssize_t r;
+
+    do {
+        r = read(fd, &n, sizeof(n));
+    } while (-1 == r && EINTR == errno);
+
+    if (-1 == r) {
+        if (EAGAIN == errno) {
+            return 0;
+        }
+        if (ECANCELED == errno) {
+            cancelled = true;
+            return 0;
+        }
+        throw std::runtime_error{errno_to_string(errno)};
+    }
+
+    return n;
+}
+
+bool
+posixcc::timer_fd::is_cancelled() const noexcept
+{
+    return cancelled;
+}
+
+#ifdef EVENTS_TEST
+#include <poll.h>
+#include <thread>
+#include <sys/epoll.h>
+#include "stfu/stfu.hh"
+
+//
+// Returns true if a descriptor is readable within "ms".
+//
+static bool
+readable(int fd, int ms = 0)
+{
+    struct pollfd p{fd, POLLIN, 0};
+    return 1 == poll(&p, 1, ms);
+}
+
+static void
+event_fd_tests()
+{
+    posixcc::event_fd counter;
+    posixcc::event_fd semaphore{2, true};
+
+    STFU_ASSERT(counter && -1 != counter.get());
+    STFU_ASSERT(!readable(counter.get()));
+    STFU_ASSERT(0 == counter.consume());
+
+    // A counter hands out the whole count at once.
+    STFU_ASSERT(counter.notify() && counter.notify(4));
+    STFU_ASSERT(readable(counter.get()));
+    STFU_ASSERT(5 == counter.consume());
+    STFU_ASSERT(0 == counter.consume());
+
+    // The counter saturates just below the maximum.
+    STFU_ASSERT(counter.notify(UINT64_MAX - 1));
+    STFU_ASSERT(!counter.notify());
+    STFU_ASSERT(UINT64_MAX - 1 == counter.consume());
+
+    // A semaphore hands out one at a time.
+    STFU_ASSERT(1 == semaphore.consume());
+    STFU_ASSERT(1 == semaphore.consume());
+    STFU_ASSERT(0 == semaphore.consume());
+
+    // A wakeup from another thread.
+    std::thread t{[&counter] { counter.notify(); }};
+    STFU_ASSERT(readable(counter.get(), 1000));
+    t.join();
+    STFU_PASS_IFF(1 == counter.consume());
+}
+
+static void
+signal_fd_tests()
+{
+    sigset_t before, after;
+    pthread_sigmask(SIG_BLOCK, nullptr, &before);
+    STFU_ASSERT(!sigismember(&before, SIGUSR1));
+
+    {
+        posixcc::signal_fd signals{SIGUSR1};
+        struct signalfd_siginfo info;
+
+        pthread_sigmask(SIG_BLOCK, nullptr, &after);
+        STFU_ASSERT(sigismember(&after, SIGUSR1));
+        STFU_ASSERT(!signals.read(info));
+
+        // A signal is read from the descriptor instead of delivered.
+        kill(getpid(), SIGUSR1);
+        STFU_ASSERT(readable(signals.get(), 1000));
+        STFU_ASSERT(signals.read(info));
+        STFU_ASSERT(SIGUSR1 == info.ssi_signo);
+        STFU_ASSERT(getpid() == static_cast<pid_t>(info.ssi_pid));
+
+        // Signals sent to the process from another thread, which blocks
+        // them too having inherited the mask.
+        signals.add(SIGUSR2);
+        std::thread t{[] { kill(getpid(), SIGUSR2); }};
+        t.join();
+        STFU_ASSERT(readable(signals.get(), 1000));
+        STFU_ASSERT(signals.read(info));
+        STFU_ASSERT(SIGUSR2 == info.ssi_signo);
+
+        signals.remove(SIGUSR2);
+        pthread_sigmask(SIG_BLOCK, nullptr, &after);
+        STFU_ASSERT(!sigismember(&after, SIGUSR2));
+
+        // Still pending when destroyed, so discarded rather than fatal.
+        kill(getpid(), SIGUSR1);
+    }
+
+    pthread_sigmask(SIG_BLOCK, nullptr, &after);
+    STFU_PASS_IFF(!sigismember(&after, SIGUSR1));
+}
+
+static void
+timer_fd_tests()
+{
+    using namespace std::chrono;
+
+    posixcc::timer_fd timer;
+
+    STFU_ASSERT(timer && 0 == timer.expirations());
+    STFU_ASSERT(nanoseconds::zero() == timer.get_remaining());
+
+    // Relative, once.
+    timer.set(milliseconds(10));
+    STFU_ASSERT(timer.get_remaining() > nanoseconds::zero());
+    STFU_ASSERT(readable(timer.get(), 1000));
+    STFU_ASSERT(1 == timer.expirations());
+    STFU_ASSERT(!readable(timer.get(), 20));
+
+    // Periodic expirations accumulate until read.
+    timer.set(milliseconds(1), milliseconds(1));
+    usleep(20000);
+    STFU_ASSERT(2 <= timer.expirations());
+    timer.disarm();
+    STFU_ASSERT(nanoseconds::zero() == timer.get_remaining());
+
+    // Absolute, on the realtime clock; a time in the past expires at once.
+    posixcc::timer_fd wall{CLOCK_REALTIME};
+    const auto now = duration_cast<nanoseconds>(
+        system_clock::now().time_since_epoch());
+    wall.set_at(now + milliseconds(10), nanoseconds::zero(), true);
+    STFU_ASSERT(readable(wall.get(), 1000));
+    STFU_ASSERT(1 == wall.expirations());
+    STFU_ASSERT(!wall.is_cancelled());
+    wall.set_at(now - seconds(1));
+    STFU_PASS_IFF(readable(wall.get(), 1000) && 1 == wall.expirations());
+}
+
+static void
+reactor_tests()
+{
+    posixcc::signal_fd signals{SIGUSR1};
+    posixcc::event_fd wakeup;
+    posixcc::timer_fd timer;
+    posixcc::reactor r;
+    std::string order;
+
+    // Wakeups, signals and timers, all in a single wait.
+    r.add(wakeup.get(), EPOLLIN, [&](std::uint32_t) {
+        wakeup.consume();
+        order += "w";
+        kill(getpid(), SIGUSR1);
+    });
+    r.add(signals.get(), EPOLLIN, [&](std::uint32_t) {
+        struct signalfd_siginfo info;
+        while (signals.read(info)) {
+            order += "s";
+        }
+        timer.set(std::chrono::milliseconds(1));
+    });
+    r.add(timer.get(), EPOLLIN, [&](std::uint32_t) {
+        timer.expirations();
+        order += "t";
+        r.remove(wakeup.get())
+         .remove(signals.get())
+         .remove(timer.get());
+    });
+
+    std::thread t{[&wakeup] { wakeup.notify(); }};
+    for (int i = 0; i < 10 && r.size(); ++i) {
+        r.run_once(std::chrono::milliseconds(1000));
+    }
+    t.join();
+
+    STFU_PASS_IFF("wst" == order);
+}
+
+extern "C" std::size_t
+unit_tests()
+{
+    stfu::test_group group{"events tests",
+        "Tests of the eventfd, signalfd and timerfd wrappers."};
+    group.add_test(stfu::test{"event_fd",
+            event_fd_tests,
+            "Verify the counter and semaphore modes of an eventfd."})
+         .add_test(stfu::test{"signal_fd",
+            signal_fd_tests,
+            "Verify that signals are received through a signalfd, and the "
+            "signal mask is restored."})
+         .add_test(stfu::test{"timer_fd",
+            timer_fd_tests,
+            "Verify relative, periodic and absolute timerfd expiry."})
+         .add_test(stfu::test{"reactor",
+            reactor_tests,
+            "Verify that all three are dispatched by a reactor."});
+
+    stfu::test_result_summary summary = group();
+    return summary.failed + summary.crashed + summary.timed_out +
+        summary.regressed;
+}
+#endif // EVENTS_TEST
@@ -0,0 +1,405 @@
+//
+// Copyright (c) 2025 Bryan Phillippe
+//
+// This software is free to use for any purpose, provided this copyright
+// notice is preserved.
+//
+
+#include <algorithm>
+#include <cerrno>
+#include <vector>
+
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include <libposix.hh>
+
+//
+// Most handoffs passed in a single sendmmsg/recvmmsg call.
+//
+static const std::size_t batch_limit = 64;
+
+//
+// Each message starts with a marker byte, so that a handoff without data
+// is never mistaken for the end of the channel.
+//
+static const char marker = 'H';
+
+//
+// Control message buffer for a single descriptor, suitably aligned.
+//
+union control {
+    struct cmsghdr header;
+    char buffer[CMSG_SPACE(sizeof(int))];
+};
+
+posixcc::handoff_channel::handoff_channel(std::size_t max_data):
+sender{auto_fd{}},
+receiver{auto_fd{}},
+limit{max_data}
+{
+    int fds[2];
+
+    // Sequenced packets keep handoffs apart, without the small queue limit
+    // of UNIX datagram sockets.
+    if (-1 == socketpair(AF_UNIX,
+                         SOCK_SEQPACKET | SOCK_CLOEXEC | SOCK_NONBLOCK,
+                         0, fds)) {
+        throw std::runtime_error{errno_to_string(errno)};
+    }
+
+    sender = socket{auto_fd{fds[0]}};
+    receiver = socket{auto_fd{fds[1]}};
+}
+
+int
+posixcc::handoff_channel::get_sender() const noexcept
+{
+    return sender.get();
+}
+
+int
+posixcc::handoff_channel::get_receiver() const noexcept
+{
+    return receiver.get();
+}
+
+std::size_t
+posixcc::handoff_channel::send(handoff* handoffs, std::size_t count)
+{
+    struct mmsghdr headers[batch_limit];
+    struct iovec vectors[batch_limit][2];
+    union control controls[batch_limit];
+    std::size_t done = 0;
+
+    for (std::size_t i = 0; i < count; ++i) {
+        if (handoffs[i].data.length() > limit) {
+            throw std::runtime_error{"handoff data exceeds limit"};
+        }
+    }
+
+    while (done < count) {
+        const std::size_t n = std::min(count - done, batch_limit);
+
+        for (std::size_t i = 0; i < n; ++i) {
+            handoff& h = handoffs[done + i];
+
+            vectors[i][0] = {const_cast<char*>(&marker), 1};
+            vectors[i][1] = {const_cast<char*>(h.data.data()),
+                             h.data.length()};
+
+            headers[i] = {};
+            headers[i].msg_hdr.msg_iov = vectors[i];
+            headers[i].msg_hdr.msg_iovlen = 2;
+            headers[i].msg_hdr.msg_control = controls[i].buffer;
+            headers[i].msg_hdr.msg_controllen = sizeof(controls[i].buffer);
+
+            struct cmsghdr* c = CMSG_FIRSTHDR(&headers[i].msg_hdr);
+            c->cmsg_level = SOL_SOCKET;
+            c->cmsg_type = SCM_RIGHTS;
+            c->cmsg_len = CMSG_LEN(sizeof(int));
+            const int fd = h.connection.get();
+            memcpy(CMSG_DATA(c), &fd, sizeof(fd));
+        }
+
+        int r;
+        do {
+            r = sendmmsg(sender.get(), headers, n, MSG_NOSIGNAL);
+        } while (-1 == r && EINTR == errno);
+
+        if (-1 == r) {
+            if (EAGAIN == errno || EWOULDBLOCK == errno) {
+                break;
+            }
+            throw std::runtime_error{errno_to_string(errno)};
+        }
+
+        // The receiver now holds its own reference to each connection.
+        for (int i = 0; i < r; ++i) {
+            handoffs[done + i].connection.close();
+        }
+
+        done += r;
+        if (static_cast<std::size_t>(r) < n) {
+            break;
+        }
+    }
+
+    return done;
+}
+
+std::size_t
+posixcc::handoff_channel::receive(handoff* handoffs, std::size_t count)
+{
+    struct mmsghdr headers[batch_limit];
+    struct iovec vectors[batch_limit];
+    union control controls[batch_limit];
+    std::vector<char> buffer;
+    std::size_t done = 0;
+
+    while (done < count) {
+        const std::size_t n = std::min(count - done, batch_limit);
+        const std::size_t size = limit + 2;
+
+        buffer.resize(size * n);
+        for (std::size_t i = 0; i < n; ++i) {
+            vectors[i] = {&buffer[i * size], size};
+
+            headers[i] = {};
+            headers[i].msg_hdr.msg_iov = &vectors[i];
+            headers[i].msg_hdr.msg_iovlen = 1;
+            headers[i].msg_hdr.msg_control = controls[i].buffer;
+            headers[i].msg_hdr.msg_controllen = sizeof(controls[i].buffer);
+        }
+
+        int r;
+        do {
+            r = recvmmsg(receiver.get(), headers, n,
+                         MSG_DONTWAIT | MSG_CMSG_CLOEXEC, nullptr);
+        } while (-1 == r && EINTR == errno);
+
+        if (-1 == r) {
+            if (EAGAIN == errno || EWOULDBLOCK == errno) {
+                break;
+            }
+            throw std::runtime_error{errno_to_string(errno)};
+        }
+
+        int received = 0;
+        bool end = false;
+        for (int i = 0; i < r; ++i) {
+            const struct msghdr& m = headers[i].msg_hdr;
+            const struct cmsghdr* c = CMSG_FIRSTHDR(&m);
+            const char* data = &buffer[i * size];
+            int fd = -1;
+
+            if (c && SOL_SOCKET == c->cmsg_level &&
+                SCM_RIGHTS == c->cmsg_type) {
+                memcpy(&fd, CMSG_DATA(c), sizeof(fd));
+            }
+
+            // A zero-length message is the end of the channel, and so is
+            // every one after it.
+            if (0 == headers[i].msg_len) {
+                if (-1 != fd) {
+                    ::close(fd);
+                }
+                end = true;
+                break;
+            }
+
+            if (marker != data[0] || -1 == fd) {
+                if (-1 != fd) {
+                    ::close(fd);
+                }
+                continue;
+            }
+
+            handoff& h = handoffs[done + received++];
+            h.connection = fd;
+            h.data.assign(data + 1, std::min<std::size_t>(
+                headers[i].msg_len - 1, limit));
+        }
+
+        done += received;
+        if (end || static_cast<std::size_t>(r) < n || 0 == r) {
+            break;
+        }
+    }
+
+    return done;
+}
+
+posixcc::handoff_channel&
+posixcc::handoff_channel::close_sender() noexcept
+{
+    sender.close();
+    return *this;
+}
+
+posixcc::handoff_channel&
+posixcc::handoff_channel::close_receiver() noexcept
+{
+    receiver.close();
+    return *this;
+}
+
+#ifdef HANDOFF_TEST
+#include <fcntl.h>
+#include <poll.h>
+#include "stfu/stfu.hh"
+
+//
+// Waits for a descriptor to become ready.
+//
+static bool
+wait_for(int fd, short events)
+{
+    struct pollfd p{fd, events, 0};
+    return 1 == poll(&p, 1, 1000);
+}
+
+//
+// Opens a connection to "listener", returning the client end, and the
+// accepted end in "server".
+//
+static posixcc::tcp_socket
+connection(const posixcc::tcp_socket& listener, posixcc::stream_socket& server)
+{
+    posixcc::tcp_socket client;
+
+    client.set_blocking(true);
+    client.connect(listener.get_local_address());
+    STFU_ASSERT(wait_for(listener.get(), POLLIN));
+    server = listener.accept();
+    STFU_ASSERT(server);
+
+    return client;
+}
+
+static void
+single_tests()
+{
+    auto listener = posixcc::tcp_socket::listen_on(
+        posixcc::socket_address::inet("127.0.0.1", 0));
+    posixcc::handoff_channel channel;
+    posixcc::stream_socket server{posixcc::auto_fd{}};
+    auto client = connection(listener, server);
+
+    // The acceptor consumes the first bytes to route the connection.
+    char buffer[16];
+    STFU_ASSERT(4 == client.send("GET ", 4));
+    STFU_ASSERT(wait_for(server.get(), POLLIN));
+    STFU_ASSERT(4 == server.recv(buffer, sizeof(buffer)));
+
+    posixcc::handoff out{server.release(), std::string{buffer, 4}};
+    const int original = out.connection.get();
+    STFU_ASSERT(1 == channel.send(&out, 1));
+    STFU_ASSERT(!out.connection);
+    STFU_ASSERT(-1 == fcntl(original, F_GETFD));
+
+    posixcc::handoff in;
+    STFU_ASSERT(1 == channel.receive(&in, 1));
+    STFU_ASSERT("GET " == in.data);
+    STFU_ASSERT(FD_CLOEXEC & fcntl(in.connection, F_GETFD));
+    STFU_ASSERT(0 == channel.receive(&in, 1));
+
+    // The received descriptor is the same connection.
+    STFU_ASSERT(2 == write(in.connection, "OK", 2));
+    STFU_ASSERT(2 == client.recv(buffer, sizeof(buffer)));
+
+    // Handoffs without data, and with too much.
+    posixcc::handoff empty{posixcc::auto_fd{dup(0)}, ""};
+    STFU_ASSERT(1 == channel.send(&empty, 1));
+    STFU_ASSERT(1 == channel.receive(&in, 1));
+    STFU_ASSERT(in.connection && in.data.empty());
+
+    bool thrown = false;
+    posixcc::handoff large{posixcc::auto_fd{dup(0)}, std::string(5000, 'x')};
+    try {
+        channel.send(&large, 1);
+    } catch (const std::runtime_error&) {
+        thrown = true;
+    }
+    STFU_PASS_IFF(thrown && large.connection);
+}
+
+static void
+worker_tests()
+{
+    static const std::size_t count = 10;
+
+    auto listener = posixcc::tcp_socket::listen_on(
+        posixcc::socket_address::inet("127.0.0.1", 0));
+    posixcc::handoff_channel channel;
+    posixcc::worker_process worker;
+
+    // The worker answers each connection with the bytes handed off with it.
+    worker.start([&channel] {
+        channel.close_sender();
+
+        std::size_t served = 0;
+        posixcc::handoff in[count];
+        while (served < count && wait_for(channel.get_receiver(), POLLIN)) {
+            const std::size_t n = channel.receive(in, count);
+            for (std::size_t i = 0; i < n; ++i) {
+                write(in[i].connection, in[i].data.data(),
+                      in[i].data.length());
+                in[i].connection.close();
+            }
+            served += n;
+        }
+    });
+    channel.close_receiver();
+
+    // All connections are handed off in one batch.
+    std::vector<posixcc::tcp_socket> clients;
+    std::vector<posixcc::handoff> out(count);
+    for (std::size_t i = 0; i < count; ++i) {
+        posixcc::stream_socket server{posixcc::auto_fd{}};
+        clients.push_back(connection(listener, server));
+        out[i].connection = server.release();
+        out[i].data = std::to_string(i);
+    }
+    STFU_ASSERT(count == channel.send(out.data(), count));
+
+    for (std::size_t i = 0; i < count; ++i) {
+        char buffer[16] = {'\0'};
+        STFU_ASSERT(0 < clients[i].recv(buffer, sizeof(buffer) - 1));
+        STFU_ASSERT(std::to_string(i) == buffer);
+    }
+
+    worker.join();
+    STFU_PASS();
+}
+
+static void
+close_tests()
+{
+    posixcc::handoff_channel channel;
+    posixcc::handoff in[8];
+
+    // Handoffs queued before the close are still received, and then the
+    // end of the channel.
+    posixcc::handoff out[3];
+    for (auto& h: out) {
+        h.connection = dup(0);
+        h.data = "queued";
+    }
+    STFU_ASSERT(3 == channel.send(out, 3));
+    channel.close_sender();
+    STFU_ASSERT(3 == channel.receive(in, 8));
+    for (std::size_t i = 0; i < 3; ++i) {
+        STFU_ASSERT(in[i].connection && "queued" == in[i].data);
+    }
+    STFU_ASSERT(0 == channel.receive(in, 8));
+
+    // Without anything queued, the end of the channel comes right away.
+    posixcc::handoff_channel closed;
+    closed.close_sender();
+    STFU_PASS_IFF(0 == closed.receive(in, 8) && 0 == closed.receive(in, 1));
+}
+
+extern "C" std::size_t
+unit_tests()
+{
+    stfu::test_group group{"handoff tests",
+        "Tests of connection handoff."};
+    group.add_test(stfu::test{"handoff",
+            single_tests,
+            "Verify that a connection and its data are handed off intact."})
+         .add_test(stfu::test{"worker handoff",
+            worker_tests,
+            "Verify that a batch of connections is handed off to a worker "
+            "process."})
+         .add_test(stfu::test{"close",
+            close_tests,
+            "Verify that receiving ends once the sending end is closed, "
+            "after any handoffs still queued."})
+         .set_timeout(std::chrono::seconds(30));
+
+    stfu::test_result_summary summary = group();
+    return summary.failed + summary.crashed + summary.timed_out +
+        summary.regressed;
+}
+#endif // HANDOFF_TEST
@@ -9,8 +9,24 @@
 
 #include <string>
 #include <cstring>
+#include <cstdint>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <stdexcept>
 #include <functional>
+#include <initializer_list>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
 
 namespace posixcc {
 
@@ -122,97 +138,1605 @@ namespace posixcc {
     };
 
     //
-    // Implementation of a worker using a UNIX process.
+    // Reads and writes bounded in time, on any descriptor, e.g. that of an
+    // auto_fd or either end of an auto_pipe. A blocking descriptor is made
+    // non-blocking for the duration of the call; note that this applies to
+    // all descriptors sharing its open file description. Interruptions by
+    // signals are resumed, and a timeout is not an error: each returns the
+    // number of bytes transferred and why it stopped. An expired deadline
+    // still transfers what can be without waiting.
     //
-    class worker_process {
+    using io_clock = std::chrono::steady_clock;
+
+    enum class io_status {
+        ok,         // Transferred what was asked for
+        timed_out,  // The deadline passed first
+        eof,        // The end of the input was reached first
+        error       // Failed with "error"
+    };
+
+    struct io_result {
+        std::size_t bytes;
+        io_status status;
+        int error;
+    };
+
+    //
+    // Transfers whatever is possible, up to "length" bytes, as soon as the
+    // descriptor is ready, waiting for it no longer than the timeout or
+    // until the deadline.
+    //
+    io_result read_for(int fd, void* data, std::size_t length,
+                       io_clock::duration timeout);
+    io_result read_until(int fd, void* data, std::size_t length,
+                         io_clock::time_point deadline);
+    io_result write_for(int fd, const void* data, std::size_t length,
+                        io_clock::duration timeout);
+    io_result write_until(int fd, const void* data, std::size_t length,
+                          io_clock::time_point deadline);
+
+    //
+    // Transfers all "length" bytes, across as many partial transfers as it
+    // takes, unless the deadline passes, the input ends or an error occurs
+    // first.
+    //
+    io_result read_exact(int fd, void* data, std::size_t length,
+                         io_clock::time_point deadline);
+    io_result read_exact(int fd, void* data, std::size_t length,
+                         io_clock::duration timeout);
+    io_result write_all(int fd, const void* data, std::size_t length,
+                        io_clock::time_point deadline);
+    io_result write_all(int fd, const void* data, std::size_t length,
+                        io_clock::duration timeout);
+
+    class buffer_pool;
+
+    //
+    // A page-aligned I/O buffer handed out by a buffer_pool, suitable for
+    // O_DIRECT and vmsplice(). It is returned to its pool on destruction,
+    // and must not outlive it.
+    //
+    class io_buffer {
         protected:
 
-        mutable pid_t child_pid{-1};
-        void release() const noexcept;
+        buffer_pool* pool{nullptr};
+        char* base{nullptr};
+        std::size_t length{0};
+
+        friend class buffer_pool;
+        io_buffer(buffer_pool* p, char* b, std::size_t l) noexcept;
 
         public:
 
         //
-        // Enables or disables zombie process accumulation.
+        // Construction
         //
-        static void enable_zombies(bool);
+        io_buffer() = default;
+        io_buffer(const io_buffer&) = delete;
+        io_buffer(io_buffer&& b) noexcept;
+        virtual ~io_buffer();
 
         //
-        // Blocks until all zombie processes have been reaped.
+        // Assignment
         //
-        static void reap_all() noexcept;
+        io_buffer& operator=(const io_buffer&) = delete;
+        io_buffer& operator=(io_buffer&& b) noexcept;
 
         //
-        // Construction
+        // Context-sensitive usage
         //
-        worker_process() = default;
-        worker_process(const worker_process&) = delete;
-        worker_process(worker_process&& p) noexcept;
-        virtual ~worker_process();
+        explicit operator bool() const noexcept;
+
+        //
+        // Getters
+        //
+        char* data() const noexcept;
+        std::size_t size() const noexcept;
+
+        //
+        // Returns the buffer to its pool early.
+        //
+        void release() noexcept;
+    };
+
+    //
+    // A pool of equally sized, page-aligned buffers. Buffers returned to it
+    // are kept on a free list, up to a limit, and handed out again instead
+    // of being mapped afresh. Huge buffers are 2 MiB aligned and sized, and
+    // backed by huge pages where possible: from the reserved pool if there
+    // are any, or else transparent huge pages. The pool may be used from
+    // many threads.
+    //
+    class buffer_pool {
+        public:
+
+        static constexpr std::size_t huge_page_size = 2 << 20;
+
+        protected:
+
+        std::size_t buffer_size;
+        bool huge;
+        std::size_t max_free;
+        std::vector<char*> free_list{};
+        std::size_t outstanding{0};
+        mutable std::mutex lock{};
+
+        friend class io_buffer;
+        void put(char* base) noexcept;
+
+        public:
+
+        //
+        // Construction; "size" is rounded up to whole pages, or huge pages.
+        //
+        explicit buffer_pool(std::size_t size, bool huge = false,
+                             std::size_t max_free = 16);
+        buffer_pool(const buffer_pool&) = delete;
+        virtual ~buffer_pool();
 
         //
         // Assignment
         //
-        worker_process& operator=(const worker_process&) = delete;
-        worker_process& operator=(worker_process&& p) noexcept;
+        buffer_pool& operator=(const buffer_pool&) = delete;
 
         //
-        // Returns true if the worker is currently executing, false otherwise.
+        // Returns a buffer, from the free list if possible. Throws a
+        // std::runtime_error if memory can not be mapped.
         //
-        bool is_running() const;
+        io_buffer get();
 
         //
-        // Starts the worker, implicitly cancelling any currently executing
-        // worker, if one exists.
+        // Getters
         //
-        virtual void start(const std::function<void()> &) const;
+        std::size_t get_buffer_size() const noexcept;
+        bool is_huge() const noexcept;
+        std::size_t get_free() const noexcept;
+        std::size_t get_outstanding() const noexcept;
 
         //
-        // Returns a unique value representing the ID of the worker.
-        // Its value is undefined if the worker is not running.
+        // Unmaps the buffers on the free list.
         //
-        // Note that this value is implementation-defined and is only
-        // guaranteed to be unique within the instance of the application.
+        void trim() noexcept;
+    };
+
+    //
+    // A file opened for direct I/O (O_DIRECT), bypassing the page cache, so
+    // that streaming large files does not evict what others need cached.
+    // The alignment direct I/O requires of memory, offsets and lengths is
+    // taken from statx(); reads and writes of any alignment are accepted,
+    // with the unaligned parts passed through bounce buffers internally.
+    // Scans keep several aligned reads in flight at once, with Linux AIO,
+    // whose context is not inherited by child processes: open the file in
+    // the process using it. Not safe for concurrent use by several threads.
+    //
+    class direct_file {
+        public:
+
+        using consumer = std::function<void(const char* data,
+                                            std::size_t length)>;
+
+        protected:
+
+        auto_fd fd{};
+        std::size_t memory_align{0};
+        std::size_t offset_align{0};
+        std::size_t chunk;
+        std::size_t depth;
+        buffer_pool pool;
+        io_buffer bounce{};
+        unsigned long aio{0};
+
+        public:
+
         //
-        std::size_t get_id() const;
+        // Construction; opens "path" with "flags" and O_DIRECT, and for
+        // reading as well if only for writing, as unaligned writes read the
+        // blocks around them first. Transfers are made "chunk_size" bytes at
+        // a time, with up to "depth" in flight during scans. Throws a
+        // std::runtime_error if the file can not be opened, or its file
+        // system does not support direct I/O.
+        //
+        explicit direct_file(const std::string& path, int flags = O_RDONLY,
+                             mode_t mode = 0644,
+                             std::size_t chunk_size = 1 << 20,
+                             std::size_t depth = 4);
+        direct_file(const direct_file&) = delete;
+        virtual ~direct_file();
 
         //
-        // Suspends execution of the caller until the worker has finished
-        // running.
+        // Assignment
         //
-        void join() const;
+        direct_file& operator=(const direct_file&) = delete;
 
         //
-        // Forcibly stops the worker if it's actively running. Does not block.
+        // Getters
         //
-        void stop() const;
+        int get() const noexcept;
+        std::size_t get_memory_alignment() const noexcept;
+        std::size_t get_offset_alignment() const noexcept;
+        std::size_t get_size() const;
+
+        //
+        // Reads or writes "length" bytes at "offset"; returns the number of
+        // bytes transferred, short only at the end of the file. Throws a
+        // std::runtime_error on any error.
+        //
+        std::size_t read(void* data, std::size_t length, off_t offset);
+        std::size_t write(const void* data, std::size_t length,
+                          off_t offset);
+
+        //
+        // Reads "length" bytes from "offset", or up to the end of the file,
+        // passing them in order to "f" as each chunk arrives; returns the
+        // number of bytes passed.
+        //
+        std::size_t scan(off_t offset, std::size_t length, const consumer& f);
     };
 
     //
-    // Implementation of a daemon using a UNIX process.
+    // A sequential writer of a file which keeps writeback steady: extents
+    // are preallocated ahead of the data, and each completed chunk is handed
+    // to writeback right away with sync_file_range(), so that dirty pages
+    // never build up into a stall. Once the device has written a chunk, it
+    // is dropped from the cache, as the one before it is being written.
+    // Dirty memory is thus bounded to about two chunks. Nothing is made
+    // durable; that still takes an fdatasync() after finish().
     //
-    class worker_daemon: public worker_process {
+    class file_writer {
+        protected:
+
+        int fd;
+        off_t position;
+        off_t submitted;
+        off_t dropped;
+        off_t allocated;
+        std::size_t chunk{8 << 20};
+        std::size_t extent{64 << 20};
+
+        void write_behind();
+
+        public:
+
+        //
+        // Construction; writing starts at "offset". The descriptor is not
+        // taken over.
+        //
+        explicit file_writer(int fd, off_t offset = 0) noexcept;
+
+        //
+        // Sets the size of the chunks handed to writeback, and of the
+        // extents preallocated; both are rounded up to whole pages, and an
+        // extent size of 0 turns preallocation off.
+        //
+        file_writer& set_chunk_size(std::size_t) noexcept;
+        file_writer& set_extent_size(std::size_t) noexcept;
+
+        //
+        // Writes "length" bytes at the current position. Throws a
+        // std::runtime_error on any error.
+        //
+        void write(const void* data, std::size_t length);
+
+        //
+        // Waits for the rest of the data to be written back and drops it,
+        // and releases what was preallocated past the end of the file. The
+        // writer may be written to again afterwards. Throws a
+        // std::runtime_error on any error.
+        //
+        void finish();
+
+        //
+        // Getters
+        //
+        off_t get_position() const noexcept;
+    };
+
+    //
+    // Access patterns to advise the kernel of for a range of a file, which
+    // size its readahead accordingly: the default, a larger window for
+    // sequential access, none for random access, and data used only once.
+    //
+    enum class access_pattern {
+        normal,
+        sequential,
+        random,
+        no_reuse
+    };
+
+    //
+    // Advises the kernel how the range of the file at "fd" from "offset" of
+    // "length" bytes will be accessed; a length of 0 extends to the end of
+    // the file. Throws a std::runtime_error on any error.
+    //
+    void set_access_pattern(int fd, access_pattern p, off_t offset = 0,
+                            off_t length = 0);
+
+    //
+    // Starts reading a range of a file into the page cache in the
+    // background, or drops it from the cache (unless dirty). Throws a
+    // std::runtime_error on any error.
+    //
+    void will_need(int fd, off_t offset, off_t length);
+    void dont_need(int fd, off_t offset, off_t length);
+
+    //
+    // Reads a range of a file into the page cache, with readahead(). Throws
+    // a std::runtime_error on any error.
+    //
+    void read_ahead(int fd, off_t offset, std::size_t length);
+
+    //
+    // A sequential scan of a file through the page cache, which neither
+    // starves nor floods it: data is read ahead of the cursor a window at a
+    // time, so that reads seldom wait for the device, and dropped from the
+    // cache once consumed, so that a large scan does not evict what others
+    // need. The access pattern advised for the descriptor is left as it
+    // is. Data passed to the consumer is only valid during the call.
+    //
+    class file_scanner {
+        public:
+
+        using consumer = std::function<void(const char* data,
+                                            std::size_t length)>;
+
+        protected:
+
+        int fd;
+        std::size_t chunk{1 << 20};
+        std::size_t window{8 << 20};
+        bool drop_behind{true};
+
+        public:
+
+        //
+        // Construction; the descriptor is not taken over.
+        //
+        explicit file_scanner(int fd) noexcept;
+
+        //
+        // Sets the size of each read, and of the readahead window. Both are
+        // rounded up to whole pages.
+        //
+        file_scanner& set_chunk_size(std::size_t) noexcept;
+        file_scanner& set_window(std::size_t) noexcept;
+
+        //
+        // Sets whether consumed data is dropped from the cache; on by
+        // default.
+        //
+        file_scanner& set_drop_behind(bool) noexcept;
+
+        //
+        // Reads "length" bytes from "offset", or up to the end of the file,
+        // passing them to "f" a chunk at a time; returns the number of bytes
+        // passed. Throws a std::runtime_error on any error.
+        //
+        std::size_t scan(off_t offset, std::size_t length, const consumer& f);
+    };
+
+    //
+    // An append-only journal of records, such as a write-ahead log, in a
+    // directory of zero-filled segment files. Records may be appended from
+    // many threads; those arriving while one group is being committed form
+    // the next, which is written with a single writev() and made durable
+    // with a single fdatasync(). Each record carries its sequence number and
+    // a CRC-32C checksum, so that a torn write at the end of the journal is
+    // recognized, and the journal resumes after the last intact record when
+    // reopened. After a failure to write or sync, nothing more is accepted,
+    // as what reached the disk is no longer known.
+    //
+    class journal {
+        public:
+
+        using sequence = std::uint64_t;
+        using record_handler = std::function<void(sequence, const char* data,
+                                                  std::size_t length)>;
+
+        protected:
+
+        struct record {
+            sequence number;
+            const char* data;
+            std::size_t length;
+        };
+
+        std::string directory;
+        std::size_t segment_size;
+        std::chrono::microseconds window{0};
+        auto_fd directory_fd{};
+        auto_fd segment{};
+        std::uint64_t segment_index{0};
+        std::uint64_t tail{0};
+        std::mutex lock{};
+        std::condition_variable committed{};
+        std::vector<record> pending{};
+        sequence last{0};
+        sequence durable{0};
+        bool committing{false};
+        std::string failure{};
+
+        void open_segment(std::uint64_t index);
+        void commit(std::unique_lock<std::mutex>&);
+        void write_group(const std::vector<record>&);
+
+        public:
+
+        //
+        // Construction; opens the journal in "directory", creating it if
+        // need be, and writes out segments of "segment_size" bytes ahead.
+        // Appending starts in a new segment. Throws a std::runtime_error on
+        // any error.
+        //
+        explicit journal(const std::string& directory,
+                         std::size_t segment_size = 64 << 20);
+        journal(const journal&) = delete;
+        virtual ~journal() = default;
+
+        //
+        // Assignment
+        //
+        journal& operator=(const journal&) = delete;
+
+        //
+        // Sets how long a commit waits for more records to join its group;
+        // zero by default, as records arriving during a commit already wait
+        // for the next.
+        //
+        journal& set_commit_window(std::chrono::microseconds) noexcept;
+
+        //
+        // Appends a record, returning its sequence number once it is
+        // durable. Throws a std::runtime_error if it could not be made
+        // durable, or if it would not fit in a segment.
+        //
+        sequence append(const void* data, std::size_t length);
+
+        //
+        // Getters
+        //
+        sequence get_last_sequence();
+        std::uint64_t get_segment_index();
+
+        //
+        // Passes every intact record in the journal in "directory" to "h",
+        // in order, returning the number of records passed.
+        //
+        static std::size_t replay(const std::string& directory,
+                                  const record_handler& h);
+    };
+
+    //
+    // How a batch of replaced files is made durable: with one syncfs() of
+    // the whole file system, or an fdatasync() of each file, for when the
+    // file system holds much unrelated dirty data.
+    //
+    enum class batch_durability {
+        file_system,
+        each_file
+    };
+
+    //
+    // A batch of files in one directory to be replaced atomically, as for
+    // configuration or state snapshots: after a crash, each file has either
+    // its old or its new contents, never a mix. New contents are written to
+    // unnamed files (O_TMPFILE, or hidden temporary files where that is not
+    // supported), whose data is made durable together before any is linked
+    // in over its old name; the renames are made durable with one fsync()
+    // of the directory. Files not yet committed are discarded along with
+    // the batch. Each holds a descriptor until then.
+    //
+    class file_replacer {
+        protected:
+
+        struct file {
+            std::string name;
+            auto_fd fd;
+            std::string temp_name;
+        };
+
+        auto_fd directory_fd{};
+        batch_durability durability{batch_durability::file_system};
+        std::vector<file> files{};
+
+        void discard() noexcept;
+
+        public:
+
+        //
+        // Construction; throws a std::runtime_error if "directory" can not
+        // be opened.
+        //
+        explicit file_replacer(const std::string& directory);
+        file_replacer(const file_replacer&) = delete;
+        virtual ~file_replacer();
+
+        //
+        // Assignment
+        //
+        file_replacer& operator=(const file_replacer&) = delete;
+
+        //
+        // Sets how the batch is made durable; by syncfs() by default.
+        //
+        file_replacer& set_durability(batch_durability) noexcept;
+
+        //
+        // Adds the new contents of the file "name" in the directory to the
+        // batch. Throws a std::runtime_error on any error, or if "name" is
+        // not in the directory itself.
+        //
+        file_replacer& add(const std::string& name, const void* data,
+                           std::size_t length, mode_t mode = 0644);
+
+        //
+        // Replaces every file in the batch, and empties it. Throws a
+        // std::runtime_error on any error, after which any file may have
+        // been replaced or not, but none partly.
+        //
+        void commit();
+
+        //
+        // Getters
+        //
+        std::size_t size() const noexcept;
+    };
+
+    //
+    // A wrapper class for an eventfd: a counter which can be waited on like
+    // any other descriptor, e.g. to wake up an event loop from another
+    // thread. In semaphore mode each consume() takes one off the counter;
+    // otherwise it takes the whole count. The descriptor is close-on-exec
+    // and non-blocking.
+    //
+    class event_fd {
+        protected:
+
+        auto_fd fd{};
+
         public:
 
         //
         // Construction
         //
-        worker_daemon() = default;
-        worker_daemon(const worker_daemon&) = delete;
-        worker_daemon(worker_daemon&& p) noexcept;
-        ~worker_daemon() override;
+        explicit event_fd(unsigned int initial = 0, bool semaphore = false);
+        event_fd(const event_fd& e) noexcept = default;
+        event_fd(event_fd&& e) noexcept = default;
+        virtual ~event_fd() = default;
 
         //
         // Assignment
         //
-        worker_daemon& operator=(const worker_daemon&) = delete;
-        worker_daemon& operator=(worker_daemon&& p) noexcept;
+        event_fd& operator=(const event_fd& e) noexcept = default;
+        event_fd& operator=(event_fd&& e) noexcept = default;
 
         //
-        // Starts the worker, implicitly cancelling any currently executing
-        // worker, if one exists.
+        // Getters
         //
-        void start(const std::function<void()> &) const override;
+        int get() const noexcept;
+        explicit operator bool() const noexcept;
+
+        //
+        // Adds "n" to the counter, making the descriptor readable. Returns
+        // false if the counter would overflow.
+        //
+        bool notify(std::uint64_t n = 1) const;
+
+        //
+        // Takes from the counter as described above, returning the amount
+        // taken; 0 if the counter is zero.
+        //
+        std::uint64_t consume() const;
+    };
+
+    //
+    // A wrapper class for a signalfd, receiving the given signals through a
+    // descriptor instead of a handler. The signals are blocked in the
+    // constructing thread, and so in threads and processes it creates
+    // afterwards; create it before starting other threads, or block the
+    // signals in those too, or the signals may instead be delivered to a
+    // thread which does not block them. On destruction, the signals it
+    // blocked are unblocked again, discarding any still pending. The
+    // descriptor is close-on-exec and non-blocking.
+    //
+    class signal_fd {
+        protected:
+
+        auto_fd fd{};
+        sigset_t mask{};
+        sigset_t blocked{};
+
+        void update();
+
+        public:
+
+        //
+        // Construction
+        //
+        explicit signal_fd(std::initializer_list<int> signals);
+        signal_fd(const signal_fd&) = delete;
+        virtual ~signal_fd();
+
+        //
+        // Assignment
+        //
+        signal_fd& operator=(const signal_fd&) = delete;
+
+        //
+        // Getters
+        //
+        int get() const noexcept;
+        explicit operator bool() const noexcept;
+
+        //
+        // Adds or removes a signal from those received.
+        //
+        signal_fd& add(int signo);
+        signal_fd& remove(int signo);
+
+        //
+        // Reads the next pending signal into "info"; returns false if none
+        // are pending.
+        //
+        bool read(struct signalfd_siginfo& info) const;
+    };
+
+    //
+    // A wrapper class for a timerfd, expiring once or periodically on the
+    // given clock. The descriptor is close-on-exec and non-blocking.
+    //
+    class timer_fd {
+        protected:
+
+        auto_fd fd{};
+        mutable bool cancelled{false};
+
+        public:
+
+        //
+        // Construction
+        //
+        explicit timer_fd(clockid_t clock = CLOCK_MONOTONIC);
+        timer_fd(const timer_fd& t) noexcept = default;
+        timer_fd(timer_fd&& t) noexcept = default;
+        virtual ~timer_fd() = default;
+
+        //
+        // Assignment
+        //
+        timer_fd& operator=(const timer_fd& t) noexcept = default;
+        timer_fd& operator=(timer_fd&& t) noexcept = default;
+
+        //
+        // Getters
+        //
+        int get() const noexcept;
+        explicit operator bool() const noexcept;
+
+        //
+        // Arms the timer to expire "after" from now, or at "when" since the
+        // epoch of its clock, and then every "interval" unless that is zero.
+        // With "cancel_on_set", an absolute CLOCK_REALTIME timer is cancelled
+        // when the clock is set discontinuously.
+        //
+        timer_fd& set(std::chrono::nanoseconds after,
+                      std::chrono::nanoseconds interval =
+                      std::chrono::nanoseconds::zero());
+        timer_fd& set_at(std::chrono::nanoseconds when,
+                         std::chrono::nanoseconds interval =
+                         std::chrono::nanoseconds::zero(),
+                         bool cancel_on_set = false);
+
+        //
+        // Disarms the timer.
+        //
+        timer_fd& disarm();
+
+        //
+        // Returns the time until the next expiry; zero if disarmed.
+        //
+        std::chrono::nanoseconds get_remaining() const;
+
+        //
+        // Returns the number of expirations since the last call; 0 if none.
+        //
+        std::uint64_t expirations() const;
+
+        //
+        // Returns true once a cancel_on_set timer has been cancelled by a
+        // change of the clock, until it is armed again.
+        //
+        bool is_cancelled() const noexcept;
+    };
+
+    //
+    // A socket address of any family, such as an IPv4 or IPv6 address and
+    // port, or a UNIX socket path.
+    //
+    class socket_address final {
+        struct sockaddr_storage storage{};
+        socklen_t length{0};
+
+        public:
+
+        //
+        // Construction
+        //
+        socket_address() = default;
+        socket_address(const struct sockaddr* a, socklen_t l) noexcept;
+
+        //
+        // Create an address from a numerical IPv4 or IPv6 host and a port.
+        // Throws a std::runtime_error if the host is not a valid address.
+        //
+        static socket_address inet(const std::string& host,
+                                   unsigned short port);
+
+        //
+        // Create a UNIX socket address from a path; a path starting with a
+        // NUL character denotes an abstract socket. Throws a
+        // std::runtime_error if the path is too long.
+        //
+        static socket_address local(const std::string& path);
+
+        //
+        // Getters and setters
+        //
+        int get_family() const noexcept;
+        unsigned short get_port() const noexcept;
+        const struct sockaddr* get() const noexcept;
+        struct sockaddr* get() noexcept;
+        socklen_t get_length() const noexcept;
+        socklen_t get_capacity() const noexcept;
+        void set_length(socklen_t l) noexcept;
+    };
+
+    //
+    // A datagram for batched sending and receiving. When receiving, "size" is
+    // the capacity of "data", and "length" and "address" are set to those of
+    // the datagram received; when sending, "size" bytes of "data" are sent
+    // to "address" (or the connected peer, if the address is empty), and
+    // "length" is set to the number of bytes sent.
+    //
+    struct datagram {
+        void* data{nullptr};
+        std::size_t size{0};
+        std::size_t length{0};
+        socket_address address{};
+        bool truncated{false};
+    };
+
+    //
+    // A wrapper class for sockets built on an auto_fd. Sockets are created
+    // close-on-exec and non-blocking: operations which would block return
+    // without transferring anything rather than waiting, unless the socket
+    // is explicitly set to blocking. All other errors throw a
+    // std::runtime_error.
+    //
+    class socket {
+        protected:
+
+        auto_fd fd{};
+
+        public:
+
+        //
+        // Construction
+        //
+        socket(int domain, int type, int protocol = 0);
+        explicit socket(auto_fd&& f) noexcept;
+        socket(const socket& s) noexcept = default;
+        socket(socket&& s) noexcept = default;
+        virtual ~socket() = default;
+
+        //
+        // Assignment
+        //
+        socket& operator=(const socket& s) noexcept = default;
+        socket& operator=(socket&& s) noexcept = default;
+
+        //
+        // Context-sensitive usage
+        //
+        explicit operator bool() const noexcept;
+
+        //
+        // Socket comparison never makes sense
+        //
+        bool operator==(const socket&) = delete;
+
+        //
+        // Getters and setters
+        //
+        int get() const noexcept;
+        socket_address get_local_address() const;
+        socket_address get_peer_address() const;
+        socket& set_blocking(bool);
+        socket& set_option(int level, int name, int value);
+        int get_option(int level, int name) const;
+
+        //
+        // Binds the socket to a local address.
+        //
+        socket& bind(const socket_address&);
+
+        //
+        // Initiates a connection to a peer. Returns true if connected, or
+        // false if a non-blocking connection is still in progress; it has
+        // completed once the socket becomes writable, and get_error() then
+        // reports its outcome.
+        //
+        bool connect(const socket_address&);
+
+        //
+        // Returns, and clears, the pending error of the socket.
+        //
+        int get_error() const;
+
+        //
+        // Cleanup
+        //
+        auto_fd release() noexcept;
+        void close() noexcept;
+    };
+
+    //
+    // A connection-oriented socket, either listening or connected.
+    //
+    class stream_socket: public socket {
+        public:
+
+        using socket::socket;
+
+        //
+        // Starts listening for connections.
+        //
+        stream_socket& listen(int backlog = SOMAXCONN);
+
+        //
+        // Accepts a pending connection, created close-on-exec and
+        // non-blocking. Returns an empty socket if no connection is pending.
+        //
+        stream_socket accept(socket_address* peer = nullptr) const;
+
+        //
+        // Sends or receives up to "length" bytes, returning the number of
+        // bytes transferred, or -1 if the operation would block. Receiving
+        // returns 0 once the peer has shut down its side.
+        //
+        ssize_t send(const void* data, std::size_t length,
+                     int flags = 0) const;
+        ssize_t recv(void* data, std::size_t length, int flags = 0) const;
+
+        //
+        // Shuts down either or both directions (SHUT_RD, SHUT_WR, SHUT_RDWR).
+        //
+        stream_socket& shutdown(int how);
+    };
+
+    //
+    // A connectionless socket, sending and receiving whole datagrams.
+    //
+    class datagram_socket: public socket {
+        public:
+
+        using socket::socket;
+
+        //
+        // Sends or receives a single datagram, returning the number of bytes
+        // transferred, or -1 if the operation would block.
+        //
+        ssize_t send_to(const void* data, std::size_t length,
+                        const socket_address& to, int flags = 0) const;
+        ssize_t recv_from(void* data, std::size_t length,
+                          socket_address* from = nullptr,
+                          int flags = 0) const;
+
+        //
+        // Sends or receives up to "count" datagrams with as few system calls
+        // as possible (sendmmsg/recvmmsg), returning the number transferred;
+        // 0 if the operation would block. An error after some datagrams were
+        // transferred ends the batch there, and is left to the next call.
+        //
+        std::size_t send_batch(datagram* messages, std::size_t count,
+                               int flags = 0) const;
+        std::size_t recv_batch(datagram* messages, std::size_t count,
+                               int flags = 0) const;
+    };
+
+    //
+    // TCP and UDP sockets of the IPv4 (AF_INET) or IPv6 (AF_INET6) family.
+    //
+    class tcp_socket: public stream_socket {
+        public:
+
+        explicit tcp_socket(int family = AF_INET);
+
+        //
+        // Creates a socket listening on the given address, reusing the
+        // address of an earlier listener in TIME_WAIT.
+        //
+        static tcp_socket listen_on(const socket_address&,
+                                    int backlog = SOMAXCONN);
+
+        //
+        // Disables or enables Nagle's algorithm.
+        //
+        tcp_socket& set_nodelay(bool);
+    };
+
+    class udp_socket: public datagram_socket {
+        public:
+
+        explicit udp_socket(int family = AF_INET);
+    };
+
+    //
+    // UNIX domain sockets, either unnamed pairs of connected sockets, or
+    // bound to a path.
+    //
+    class unix_stream_socket: public stream_socket {
+        public:
+
+        unix_stream_socket();
+        explicit unix_stream_socket(auto_fd&& f) noexcept;
+
+        static std::pair<unix_stream_socket, unix_stream_socket> pair();
+    };
+
+    class unix_datagram_socket: public datagram_socket {
+        public:
+
+        unix_datagram_socket();
+        explicit unix_datagram_socket(auto_fd&& f) noexcept;
+
+        static std::pair<unix_datagram_socket, unix_datagram_socket> pair();
+    };
+
+    //
+    // A hierarchical timing wheel driving a single timerfd, for large numbers
+    // of pending timeouts: timers are added and cancelled in constant time,
+    // and expire in ticks of the wheel's resolution, which coalesces timers
+    // due within the same tick. The timerfd becomes readable when timers may
+    // be due; register it with any event loop, and call expire() then.
+    //
+    class timer_wheel {
+        public:
+
+        using clock = std::chrono::steady_clock;
+        using timer_id = std::uint64_t;
+
+        protected:
+
+        static constexpr std::size_t levels = 4;
+        static constexpr std::size_t slot_bits = 8;
+        static constexpr std::size_t slots = 1 << slot_bits;
+
+        struct node {
+            std::uint64_t expires;
+            std::uint32_t generation;
+            std::uint32_t slot;
+            std::uint32_t prev;
+            std::uint32_t next;
+            std::function<void()> callback;
+        };
+
+        auto_fd timer_fd{};
+        std::chrono::nanoseconds resolution;
+        clock::time_point start;
+        std::uint64_t current{0};
+        std::uint64_t armed{0};
+        std::size_t pending{0};
+        std::vector<node> nodes{};
+        std::uint32_t free_list;
+        std::uint32_t heads[levels * slots];
+        std::uint64_t occupied[levels][slots / 64]{};
+
+        std::uint64_t tick_of(clock::time_point) const noexcept;
+        void link(std::uint32_t) noexcept;
+        void unlink(std::uint32_t) noexcept;
+        void release(std::uint32_t) noexcept;
+        void cascade(std::size_t level) noexcept;
+        void rearm();
+
+        public:
+
+        //
+        // Construction; timers expire in multiples of "resolution" after the
+        // wheel was created.
+        //
+        explicit timer_wheel(std::chrono::nanoseconds resolution =
+                             std::chrono::milliseconds(1));
+        timer_wheel(const timer_wheel&) = delete;
+        virtual ~timer_wheel() = default;
+
+        //
+        // Assignment
+        //
+        timer_wheel& operator=(const timer_wheel&) = delete;
+
+        //
+        // Returns the timerfd, which becomes readable when timers may be due.
+        //
+        const auto_fd& get_fd() const noexcept;
+
+        //
+        // Calls "callback" once from expire(), no earlier than "after" from
+        // now; returns an ID by which the timer can be cancelled until then.
+        // IDs are never 0.
+        //
+        timer_id add(clock::duration after,
+                     const std::function<void()>& callback);
+
+        //
+        // Cancels a pending timer; returns false if it already expired or
+        // was cancelled.
+        //
+        bool cancel(timer_id) noexcept;
+
+        //
+        // The number of pending timers.
+        //
+        std::size_t size() const noexcept;
+
+        //
+        // Calls the callbacks of all timers due, returning their number.
+        // Callbacks may add and cancel timers; those they add are not called
+        // before the next tick.
+        //
+        std::size_t expire();
+    };
+
+    //
+    // An event loop dispatching readiness of many descriptors, via epoll, and
+    // expiry of timers to callbacks, all on the thread calling run().
+    // Callbacks may add and remove descriptors and timers, including their
+    // own.
+    //
+    class reactor {
+        public:
+
+        using clock = timer_wheel::clock;
+        using handler = std::function<void(std::uint32_t events)>;
+        using timer_id = timer_wheel::timer_id;
+
+        protected:
+
+        auto_fd epoll_fd{};
+        std::uint64_t next_id{1};
+        std::map<int, std::uint64_t> registered{};
+        std::map<std::uint64_t, std::shared_ptr<handler>> handlers{};
+        timer_wheel wheel{};
+
+        public:
+
+        //
+        // Construction
+        //
+        reactor();
+        reactor(const reactor&) = delete;
+        virtual ~reactor() = default;
+
+        //
+        // Assignment
+        //
+        reactor& operator=(const reactor&) = delete;
+
+        //
+        // Returns the epoll descriptor, which becomes readable when events
+        // are pending, e.g. to nest this reactor in another event loop.
+        //
+        int get() const noexcept;
+
+        //
+        // Registers a descriptor for the given epoll events (EPOLLIN,
+        // EPOLLOUT, EPOLLET, ...), changes them, or removes it. Throws a
+        // std::runtime_error on any error.
+        //
+        reactor& add(int fd, std::uint32_t events, const handler&);
+        reactor& modify(int fd, std::uint32_t events);
+        reactor& remove(int fd);
+
+        //
+        // Calls "callback" once, no earlier than "after" from now; returns an
+        // ID by which the timer can be cancelled until it has fired. Timers
+        // run on a timer_wheel of millisecond resolution.
+        //
+        timer_id add_timer(clock::duration after,
+                           const std::function<void()>& callback);
+        void cancel_timer(timer_id) noexcept;
+
+        //
+        // The number of registered descriptors and pending timers.
+        //
+        std::size_t size() const noexcept;
+
+        //
+        // Waits up to "timeout" (forever if negative) for events and timers,
+        // and dispatches them; returns the number of callbacks made.
+        //
+        std::size_t run_once(std::chrono::milliseconds timeout =
+                             std::chrono::milliseconds(-1));
+
+        //
+        // Dispatches events and timers until none are registered.
+        //
+        void run();
+    };
+
+    //
+    // A bidirectional relay between two descriptors, such as a client and a
+    // backend socket, driven by a reactor. Data moves through a pair of
+    // internal pipes with splice(), never being copied to user space; each
+    // direction is read only as fast as its destination accepts it. When
+    // either side shuts down its writing end, the shutdown is passed on
+    // once the data before it has been delivered, and the relay closes once
+    // both directions are done, on an error, or after being idle for too
+    // long. A peer which resets or goes away ends the directions to and from
+    // it, without raising SIGPIPE.
+    //
+    class relay {
+        protected:
+
+        reactor& loop;
+        auto_fd ends[2];
+        auto_pipe buffers[2];
+        std::uint64_t counts[2]{0, 0};
+        std::size_t buffered[2]{0, 0};
+        bool eof[2]{false, false};
+        bool open{true};
+        reactor::clock::duration idle{reactor::clock::duration::zero()};
+        reactor::clock::time_point active{};
+        reactor::timer_id timer{0};
+        std::function<void(relay&)> on_close{};
+
+        bool pump(int from);
+        void check_idle();
+
+        public:
+
+        //
+        // Construction; both descriptors are made non-blocking, and the relay
+        // takes them over.
+        //
+        relay(reactor& r, auto_fd&& a, auto_fd&& b);
+        relay(const relay&) = delete;
+        virtual ~relay();
+
+        //
+        // Assignment
+        //
+        relay& operator=(const relay&) = delete;
+
+        //
+        // Closes the relay after "timeout" without any data moving in either
+        // direction; zero disables the timeout.
+        //
+        relay& set_idle_timeout(reactor::clock::duration timeout);
+
+        //
+        // Sets a callback invoked once the relay has closed.
+        //
+        relay& set_on_close(const std::function<void(relay&)>&);
+
+        //
+        // Byte counters: from the first descriptor to the second (forward),
+        // and back.
+        //
+        std::uint64_t get_forward_bytes() const noexcept;
+        std::uint64_t get_backward_bytes() const noexcept;
+
+        //
+        // Returns true until the relay has closed.
+        //
+        bool is_open() const noexcept;
+
+        //
+        // Closes both descriptors and unregisters them from the reactor.
+        //
+        void close() noexcept;
+    };
+
+    //
+    // A non-blocking writer to a pipe, or any other stream descriptor, driven
+    // by a reactor, for feeding a consumer without ever waiting on it. What
+    // the descriptor does not take at once is queued in a chain of buffers,
+    // up to a limit, and written out as it becomes writable. Callbacks
+    // report the queue reaching a high watermark, and later draining to a
+    // low one, so that producers can throttle. SIGPIPE must be ignored or
+    // blocked; a consumer closing its end is reported as an error.
+    //
+    class pipe_writer {
+        protected:
+
+        reactor& loop;
+        auto_fd fd{};
+        std::deque<std::vector<char>> chain{};
+        std::size_t offset{0};
+        std::size_t queued{0};
+        std::size_t limit;
+        std::size_t high;
+        std::size_t low;
+        bool throttled{false};
+        bool finishing{false};
+        std::function<void(pipe_writer&)> on_high{};
+        std::function<void(pipe_writer&)> on_low{};
+        std::function<void(pipe_writer&, int)> on_error{};
+
+        void drain();
+        void enqueue(const char* data, std::size_t length);
+        void fail(int error);
+
+        public:
+
+        //
+        // Construction; the descriptor is made non-blocking, and the writer
+        // takes it over. At most "max_queued" bytes are queued; the
+        // watermarks default to a half and an eighth of that.
+        //
+        pipe_writer(reactor& r, auto_fd&& wfd,
+                    std::size_t max_queued = 1 << 20);
+        pipe_writer(const pipe_writer&) = delete;
+        virtual ~pipe_writer();
+
+        //
+        // Assignment
+        //
+        pipe_writer& operator=(const pipe_writer&) = delete;
+
+        //
+        // Sets the watermarks; "low" must not exceed "high", nor "high" the
+        // limit.
+        //
+        pipe_writer& set_watermarks(std::size_t high, std::size_t low);
+
+        //
+        // Sets callbacks for the queue reaching the high watermark, draining
+        // to the low watermark after that, and for an error, after which the
+        // writer has closed. The error callback is made last, and may
+        // destroy the writer.
+        //
+        pipe_writer& set_on_high(const std::function<void(pipe_writer&)>&);
+        pipe_writer& set_on_low(const std::function<void(pipe_writer&)>&);
+        pipe_writer& set_on_error(
+            const std::function<void(pipe_writer&, int error)>&);
+
+        //
+        // Writes what the descriptor takes now, and queues as much of the
+        // rest as fits; returns the number of bytes accepted, which is short
+        // only when the queue is full, or 0 once the writer has closed.
+        //
+        std::size_t write(const void* data, std::size_t length);
+
+        //
+        // Getters
+        //
+        std::size_t get_queued() const noexcept;
+        bool is_throttled() const noexcept;
+        bool is_open() const noexcept;
+
+        //
+        // Closes the descriptor once the queue has drained, so that the
+        // consumer sees the end of the data; nothing more is accepted.
+        //
+        void finish();
+
+        //
+        // Discards the queue, closes the descriptor and unregisters it from
+        // the reactor.
+        //
+        void close() noexcept;
+    };
+
+    //
+    // Collects delimited records, such as lines, from the read ends of many
+    // pipes, e.g. the output of worker processes, driven by a reactor. Each
+    // pipe is read into a buffer of its own, and every complete record is
+    // passed to a single handler, tagged with its source, in place in that
+    // buffer. A pipe reaching EOF means its writer has finished: any
+    // unterminated record left is passed on, and the completion handler is
+    // called for the source, which is then removed.
+    //
+    class pipe_aggregator {
+        public:
+
+        using source = std::uint64_t;
+        using record_handler = std::function<void(source, const char* data,
+                                                  std::size_t length)>;
+        using completion_handler = std::function<void(source)>;
+
+        protected:
+
+        struct stream {
+            auto_fd fd;
+            std::vector<char> buffer;
+            std::size_t start;
+            std::size_t scanned;
+            std::size_t end;
+        };
+
+        reactor& loop;
+        record_handler on_record;
+        completion_handler on_complete{};
+        char delimiter;
+        std::size_t buffer_size;
+        source next_source{1};
+        std::uint64_t removals{0};
+        std::map<source, stream> streams{};
+
+        void fill(source);
+        void complete(source);
+
+        public:
+
+        //
+        // Construction; records end with "delimiter", which is not passed to
+        // the handler. Each pipe gets a buffer of "buffer_size" bytes, grown
+        // as needed for records which do not fit.
+        //
+        pipe_aggregator(reactor& r, const record_handler& h,
+                        char delimiter = '\n',
+                        std::size_t buffer_size = 1 << 16);
+        pipe_aggregator(const pipe_aggregator&) = delete;
+        virtual ~pipe_aggregator();
+
+        //
+        // Assignment
+        //
+        pipe_aggregator& operator=(const pipe_aggregator&) = delete;
+
+        //
+        // Sets a callback invoked when a source reaches EOF.
+        //
+        pipe_aggregator& set_on_complete(const completion_handler&);
+
+        //
+        // Takes over a read end, made non-blocking, returning the tag of its
+        // records.
+        //
+        source add(auto_fd&& rfd);
+
+        //
+        // Stops reading from a source, discarding any partial record, and
+        // closes it.
+        //
+        void remove(source);
+
+        //
+        // The number of sources not yet complete.
+        //
+        std::size_t size() const noexcept;
+    };
+
+    //
+    // Implementation of a worker using a UNIX process.
+    //
+    class worker_process {
+        protected:
+
+        mutable pid_t child_pid{-1};
+        void release() const noexcept;
+
+        public:
+
+        //
+        // Enables or disables zombie process accumulation.
+        //
+        static void enable_zombies(bool);
+
+        //
+        // Blocks until all zombie processes have been reaped.
+        //
+        static void reap_all() noexcept;
+
+        //
+        // Construction
+        //
+        worker_process() = default;
+        worker_process(const worker_process&) = delete;
+        worker_process(worker_process&& p) noexcept;
+        virtual ~worker_process();
+
+        //
+        // Assignment
+        //
+        worker_process& operator=(const worker_process&) = delete;
+        worker_process& operator=(worker_process&& p) noexcept;
+
+        //
+        // Returns true if the worker is currently executing, false otherwise.
+        //
+        bool is_running() const;
+
+        //
+        // Starts the worker, implicitly cancelling any currently executing
+        // worker, if one exists.
+        //
+        virtual void start(const std::function<void()> &) const;
+
+        //
+        // Returns a unique value representing the ID of the worker.
+        // Its value is undefined if the worker is not running.
+        //
+        // Note that this value is implementation-defined and is only
+        // guaranteed to be unique within the instance of the application.
+        //
+        std::size_t get_id() const;
+
+        //
+        // Suspends execution of the caller until the worker has finished
+        // running.
+        //
+        void join() const;
+
+        //
+        // Forcibly stops the worker if it's actively running. Does not block.
+        //
+        void stop() const;
+    };
+
+    //
+    // Implementation of a daemon using a UNIX process.
+    //
+    class worker_daemon: public worker_process {
+        public:
+
+        //
+        // Construction
+        //
+        worker_daemon() = default;
+        worker_daemon(const worker_daemon&) = delete;
+        worker_daemon(worker_daemon&& p) noexcept;
+        ~worker_daemon() override;
+
+        //
+        // Assignment
+        //
+        worker_daemon& operator=(const worker_daemon&) = delete;
+        worker_daemon& operator=(worker_daemon&& p) noexcept;
+
+        //
+        // Starts the worker, implicitly cancelling any currently executing
+        // worker, if one exists.
+        //
+        void start(const std::function<void()> &) const override;
+    };
+
+    //
+    // A connection handed off between processes: its descriptor, along with
+    // any bytes the sender already read from it.
+    //
+    struct handoff {
+        auto_fd connection;
+        std::string data;
+    };
+
+    //
+    // A channel for handing off connections, such as from an acceptor which
+    // inspects their first bytes to the worker process serving them. The
+    // descriptors are passed as SCM_RIGHTS over a pair of UNIX sockets, so
+    // that no bytes need to be relayed. Create the channel before starting
+    // the worker, then close the end each process does not use, as with an
+    // auto_pipe. Both ends are non-blocking.
+    //
+    class handoff_channel {
+        protected:
+
+        socket sender;
+        socket receiver;
+        std::size_t limit;
+
+        public:
+
+        //
+        // Construction; "max_data" bounds the bytes sent along with each
+        // connection.
+        //
+        explicit handoff_channel(std::size_t max_data = 4096);
+        handoff_channel(const handoff_channel&) noexcept = default;
+        handoff_channel(handoff_channel&&) noexcept = default;
+        virtual ~handoff_channel() = default;
+
+        //
+        // Assignment
+        //
+        handoff_channel& operator=(const handoff_channel&) noexcept = default;
+        handoff_channel& operator=(handoff_channel&&) noexcept = default;
+
+        //
+        // Getters, e.g. for polling
+        //
+        int get_sender() const noexcept;
+        int get_receiver() const noexcept;
+
+        //
+        // Sends up to "count" handoffs, as many per system call as possible,
+        // returning the number sent; 0 if the channel is full. The
+        // connections sent are closed in the sending process. Throws a
+        // std::runtime_error if the data of a handoff exceeds "max_data".
+        //
+        std::size_t send(handoff* handoffs, std::size_t count);
+
+        //
+        // Receives up to "count" handoffs, returning the number received; 0
+        // if none are pending, or if the sending end was closed (which poll()
+        // reports as POLLHUP on the receiving descriptor).
+        //
+        std::size_t receive(handoff* handoffs, std::size_t count);
+
+        //
+        // Cleanup
+        //
+        handoff_channel& close_sender() noexcept;
+        handoff_channel& close_receiver() noexcept;
+    };
+
+    //
+    // A prefork server: a pool of worker processes accepting connections on
+    // a TCP address, and handing each to a handler in the worker. By default
+    // every worker listens on a socket of its own, bound with SO_REUSEPORT,
+    // so that the kernel balances connections among the workers instead of
+    // waking all of them for each one.
+    //
+    class prefork_server {
+        protected:
+
+        socket_address address;
+        std::size_t count;
+        bool reuseport{true};
+        bool steering{false};
+        std::vector<worker_process> workers{};
+
+        public:
+
+        //
+        // Construction; a worker count of 0 selects the number of online
+        // processors.
+        //
+        explicit prefork_server(const socket_address& a,
+                                std::size_t workers = 0);
+        prefork_server(const prefork_server&) = delete;
+        virtual ~prefork_server();
+
+        //
+        // Assignment
+        //
+        prefork_server& operator=(const prefork_server&) = delete;
+
+        //
+        // Disabling SO_REUSEPORT falls back to all workers accepting on one
+        // shared listening socket.
+        //
+        prefork_server& set_reuseport(bool) noexcept;
+
+        //
+        // Steers each connection to the worker pinned to the processor
+        // which received it, with a classic BPF program attached to the
+        // SO_REUSEPORT group; this works best with one worker per processor.
+        //
+        prefork_server& set_cpu_steering(bool) noexcept;
+
+        //
+        // Binds the listening sockets and starts the workers, each calling
+        // "handler" for every connection it accepts; the connection is
+        // closed once the handler returns, or throws. Workers out of
+        // descriptors or buffers back off and retry accepting. Throws a
+        // std::runtime_error if the address can not be bound. Implicitly
+        // stops any workers already running.
+        //
+        void start(const std::function<void(stream_socket&)>& handler);
+
+        //
+        // Getters; the address is the one bound, i.e. with the port chosen
+        // by the system if it was given as 0.
+        //
+        const socket_address& get_address() const noexcept;
+        const std::vector<worker_process>& get_workers() const noexcept;
+
+        //
+        // Stops all workers, without blocking; or waits for them to finish.
+        //
+        void stop() const;
+        void join() const;
     };
 
     //
@@ -0,0 +1,319 @@
+//
+// Copyright (c) 2025 Bryan Phillippe
+//
+// This software is free to use for any purpose, provided this copyright
+// notice is preserved.
+//
+
+#include <cerrno>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include <libposix.hh>
+
+//
+// Makes a descriptor non-blocking for the lifetime of the object, if it is
+// not already.
+//
+class nonblocking_scope {
+    const int fd;
+    int flags;
+    int failure{0};
+
+    public:
+
+    explicit nonblocking_scope(int f):
+    fd{f},
+    flags{fcntl(f, F_GETFL)}
+    {
+        if (-1 == flags ||
+            (!(flags & O_NONBLOCK) &&
+             -1 == fcntl(fd, F_SETFL, flags | O_NONBLOCK))) {
+            failure = errno;
+            flags = -1;
+        }
+    }
+
+    ~nonblocking_scope()
+    {
+        if (-1 != flags && !(flags & O_NONBLOCK)) {
+            fcntl(fd, F_SETFL, flags);
+        }
+    }
+
+    int error() const noexcept
+    {
+        return failure;
+    }
+};
+
+//
+// Reads or writes at "fd" until "length" bytes are transferred, or once any
+// are, unless "exact", waiting for readiness until "deadline".
+//
+static posixcc::io_result
+transfer(int fd, char* data, std::size_t length,
+         posixcc::io_clock::time_point deadline, bool writing, bool exact)
+{
+    posixcc::io_result r{0, posixcc::io_status::ok, 0};
+    const nonblocking_scope scope{fd};
+
+    if (scope.error()) {
+        return {0, posixcc::io_status::error, scope.error()};
+    }
+
+    while (r.bytes < length) {
+        // Try first, so that a ready descriptor costs no poll.
+        const ssize_t l = writing ?
+            write(fd, data + r.bytes, length - r.bytes) :
+            read(fd, data + r.bytes, length - r.bytes);
+
+        if (0 < l) {
+            r.bytes += l;
+            if (!exact) {
+                break;
+            }
+            continue;
+        }
+        if (0 == l && !writing) {
+            r.status = posixcc::io_status::eof;
+            break;
+        }
+        if (-1 == l && EINTR == errno) {
+            continue;
+        }
+        if (-1 == l && EAGAIN != errno && EWOULDBLOCK != errno) {
+            r.status = posixcc::io_status::error;
+            r.error = errno;
+            break;
+        }
+
+        const auto now = posixcc::io_clock::now();
+        if (now >= deadline) {
+            r.status = posixcc::io_status::timed_out;
+            break;
+        }
+
+        const auto left = std::chrono::duration_cast<
+            std::chrono::nanoseconds>(deadline - now);
+        const auto seconds = std::chrono::duration_cast<
+            std::chrono::seconds>(left);
+        const struct timespec t{static_cast<time_t>(seconds.count()),
+                                static_cast<long>((left - seconds).count())};
+        struct pollfd p{fd, static_cast<short>(writing ? POLLOUT : POLLIN),
+                        0};
+
+        // Hangups and errors are left to the next transfer to report.
+        if (-1 == ppoll(&p, 1, &t, nullptr) && EINTR != errno) {
+            r.status = posixcc::io_status::error;
+            r.error = errno;
+            break;
+        }
+    }
+
+    return r;
+}
+
+posixcc::io_result
+posixcc::read_for(int fd, void* data, std::size_t length,
+                  io_clock::duration timeout)
+{
+    return transfer(fd, static_cast<char*>(data), length,
+                    io_clock::now() + timeout, false, false);
+}
+
+posixcc::io_result
+posixcc::read_until(int fd, void* data, std::size_t length,
+                    io_clock::time_point deadline)
+{
+    return transfer(fd, static_cast<char*>(data), length, deadline,
+                    false, false);
+}
+
+posixcc::io_result
+posixcc::write_for(int fd, const void* data, std::size_t length,
+                   io_clock::duration timeout)
+{
+    return transfer(fd, static_cast<char*>(const_cast<void*>(data)), length,
+                    io_clock::now() + timeout, true, false);
+}
+
+posixcc::io_result
+posixcc::write_until(int fd, const void* data, std::size_t length,
+                     io_clock::time_point deadline)
+{
+    return transfer(fd, static_cast<char*>(const_cast<void*>(data)), length,
+                    deadline, true, false);
+}
+
+posixcc::io_result
+posixcc::read_exact(int fd, void* data, std::size_t length,
+                    io_clock::time_point deadline)
+{
+    return transfer(fd, static_cast<char*>(data), length, deadline,
+                    false, true);
+}
+
+posixcc::io_result
+posixcc::read_exact(int fd, void* data, std::size_t length,
+                    io_clock::duration timeout)
+{
+    return read_exact(fd, data, length, io_clock::now() + timeout);
+}
+
+posixcc::io_result
+posixcc::write_all(int fd, const void* data, std::size_t length,
+                   io_clock::time_point deadline)
+{
+    return transfer(fd, static_cast<char*>(const_cast<void*>(data)), length,
+                    deadline, true, true);
+}
+
+posixcc::io_result
+posixcc::write_all(int fd, const void* data, std::size_t length,
+                   io_clock::duration timeout)
+{
+    return write_all(fd, data, length, io_clock::now() + timeout);
+}
+
+#ifdef IO_TEST
+#include <csignal>
+#include <thread>
+#include <vector>
+#include <sys/time.h>
+#include "stfu/stfu.hh"
+
+static void
+read_tests()
+{
+    using namespace std::chrono;
+
+    posixcc::auto_pipe p;
+    char buffer[16];
+
+    // Nothing to read: times out, without throwing, after the timeout.
+    auto start = posixcc::io_clock::now();
+    auto r = posixcc::read_for(p.get_rfd(), buffer, sizeof(buffer),
+                               milliseconds(20));
+    STFU_ASSERT(posixcc::io_status::timed_out == r.status && 0 == r.bytes);
+    STFU_ASSERT(posixcc::io_clock::now() - start >= milliseconds(20));
+
+    // The descriptor is left blocking, as it was.
+    STFU_ASSERT(!(O_NONBLOCK & fcntl(p.get_rfd(), F_GETFL)));
+
+    // A single read takes whatever is there.
+    write(p.get_wfd(), "abc", 3);
+    r = posixcc::read_until(p.get_rfd(), buffer, sizeof(buffer),
+                            posixcc::io_clock::now() + seconds(1));
+    STFU_ASSERT(posixcc::io_status::ok == r.status && 3 == r.bytes);
+
+    // An exact read gathers partial writes, then times out short of the
+    // rest, reporting what it got.
+    std::thread t{[&p] {
+        for (int i = 0; i < 4; ++i) {
+            usleep(5000);
+            write(p.get_wfd(), "1234", 4);
+        }
+    }};
+    r = posixcc::read_exact(p.get_rfd(), buffer, 16, seconds(5));
+    t.join();
+    STFU_ASSERT(posixcc::io_status::ok == r.status && 16 == r.bytes);
+
+    write(p.get_wfd(), "xy", 2);
+    r = posixcc::read_exact(p.get_rfd(), buffer, 4, milliseconds(10));
+    STFU_ASSERT(posixcc::io_status::timed_out == r.status && 2 == r.bytes);
+
+    // The end of the input.
+    write(p.get_wfd(), "z", 1);
+    p.close_wfd();
+    r = posixcc::read_exact(p.get_rfd(), buffer, 4, seconds(1));
+    STFU_ASSERT(posixcc::io_status::eof == r.status && 1 == r.bytes);
+
+    // An invalid descriptor is an error.
+    r = posixcc::read_for(-1, buffer, 1, milliseconds(0));
+    STFU_PASS_IFF(posixcc::io_status::error == r.status && EBADF == r.error);
+}
+
+static void
+write_tests()
+{
+    using namespace std::chrono;
+
+    posixcc::auto_pipe p;
+    std::vector<char> data(1 << 20, 'x');
+
+    // A full pipe takes part, then times out.
+    auto r = posixcc::write_for(p.get_wfd(), data.data(), data.size(),
+                                milliseconds(10));
+    STFU_ASSERT(posixcc::io_status::ok == r.status);
+    STFU_ASSERT(0 < r.bytes && r.bytes < data.size());
+    r = posixcc::write_for(p.get_wfd(), data.data(), data.size(),
+                           milliseconds(10));
+    STFU_ASSERT(posixcc::io_status::timed_out == r.status && 0 == r.bytes);
+
+    // All of it is written as a reader drains the pipe.
+    std::size_t drained = 0;
+    std::thread t{[&] {
+        char buffer[1 << 16];
+        ssize_t l;
+        while (0 < (l = read(p.get_rfd(), buffer, sizeof(buffer)))) {
+            drained += l;
+        }
+    }};
+    r = posixcc::write_all(p.get_wfd(), data.data(), data.size(), seconds(5));
+    p.close_wfd();
+    t.join();
+    STFU_ASSERT(posixcc::io_status::ok == r.status && data.size() == r.bytes);
+    STFU_PASS_IFF(2 * data.size() > drained && data.size() < drained);
+}
+
+static void
+interrupt_tests()
+{
+    using namespace std::chrono;
+
+    posixcc::auto_pipe p;
+    char buffer[4];
+
+    // Signals interrupting the wait, without SA_RESTART, are not errors.
+    struct sigaction sa{};
+    sa.sa_handler = [](int) {};
+    sigaction(SIGALRM, &sa, nullptr);
+    struct itimerval it{{0, 5000}, {0, 5000}};
+    setitimer(ITIMER_REAL, &it, nullptr);
+
+    const auto start = posixcc::io_clock::now();
+    const auto r = posixcc::read_exact(p.get_rfd(), buffer, sizeof(buffer),
+                                       milliseconds(50));
+    const auto elapsed = posixcc::io_clock::now() - start;
+
+    it = {};
+    setitimer(ITIMER_REAL, &it, nullptr);
+
+    STFU_ASSERT(elapsed >= milliseconds(50));
+    STFU_PASS_IFF(posixcc::io_status::timed_out == r.status);
+}
+
+extern "C" std::size_t
+unit_tests()
+{
+    stfu::test_group group{"io tests",
+        "Tests of reads and writes with deadlines."};
+    group.add_test(stfu::test{"read",
+            read_tests,
+            "Verify reads with timeouts, deadlines, partial input and EOF."})
+         .add_test(stfu::test{"write",
+            write_tests,
+            "Verify writes with timeouts to a full pipe, and complete "
+            "writes."})
+         .add_test(stfu::test{"interrupts",
+            interrupt_tests,
+            "Verify that signals do not cut a wait short."});
+
+    stfu::test_result_summary summary = group();
+    return summary.failed + summary.crashed + summary.timed_out +
+        summary.regressed;
+}
+#endif // IO_TEST
@@ -0,0 +1,789 @@
+//
+// Copyright (c) 2025 Bryan Phillippe
+//
+// This software is free to use for any purpose, provided this copyright
+// notice is preserved.
+//
+
+#include <algorithm>
+#include <cerrno>
+#include <cinttypes>
+#include <cstddef>
+#include <cstdlib>
+#include <limits>
+#include <thread>
+
+#include <dirent.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#include <libposix.hh>
+
+//
+// Each record is a header followed by its data, in host byte order. The
+// checksum covers the rest of the header and the data, so that neither a
+// torn record nor the zeroes past the last one pass for a record.
+//
+struct record_header {
+    std::uint64_t number;
+    std::uint32_t length;
+    std::uint32_t checksum;
+};
+
+static const std::size_t header_size = sizeof(record_header);
+static const char segment_suffix[] = ".journal";
+
+//
+// Replays read segments in chunks of this size; a larger record is read
+// whole.
+//
+static const std::size_t replay_chunk = 1 << 20;
+
+//
+// New segments are written with zeroes in chunks of this size.
+//
+static const std::size_t zero_chunk = 1 << 20;
+
+static std::uint32_t
+crc32c(std::uint32_t crc, const void* data, std::size_t length)
+{
+    static const struct table {
+        std::uint32_t entries[256];
+
+        table()
+        {
+            for (std::uint32_t i = 0; i < 256; ++i) {
+                std::uint32_t c = i;
+                for (int k = 0; k < 8; ++k) {
+                    c = (c >> 1) ^ ((c & 1) ? 0x82f63b78 : 0);
+                }
+                entries[i] = c;
+            }
+        }
+    } t;
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+
+    crc = ~crc;
+    while (length--) {
+        crc = t.entries[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+    }
+
+    return ~crc;
+}
+
+static std::uint32_t
+checksum(const record_header& h, const void* data)
+{
+    return crc32c(crc32c(0, &h, offsetof(record_header, checksum)), data,
+                  h.length);
+}
+
+static std::string
+segment_path(const std::string& directory, std::uint64_t index)
+{
+    char name[32];
+
+    snprintf(name, sizeof(name), "%016" PRIx64 "%s", index, segment_suffix);
+    return directory + "/" + name;
+}
+
+//
+// Returns the indices of the segments in "directory", in order.
+//
+static std::vector<std::uint64_t>
+list_segments(const std::string& directory)
+{
+    std::unique_ptr<DIR, int (*)(DIR*)> d{opendir(directory.c_str()),
+                                          closedir};
+    std::vector<std::uint64_t> indices;
+
+    if (!d) {
+        throw std::runtime_error{errno_to_string(errno)};
+    }
+
+    while (const struct dirent* e = readdir(d.get())) {
+        char* end;
+        const std::uint64_t index = strtoull(e->d_name, &end, 16);
+
+        if (16 == end - e->d_name && 0 == strcmp(end, segment_suffix)) {
+            indices.push_back(index);
+        }
+    }
+    std::sort(indices.begin(), indices.end());
+
+    return indices;
+}
+
+static std::size_t
+read_at(int fd, char* data, std::size_t length, off_t offset)
+{
+    std::size_t done = 0;
+
+    while (done < length) {
+        const ssize_t l = pread(fd, data + done, length - done,
+                                offset + done);
+
+        if (-1 == l) {
+            if (EINTR == errno) {
+                continue;
+            }
+            throw std::runtime_error{errno_to_string(errno)};
+        }
+        if (0 == l) {
+            break;
+        }
+        done += l;
+    }
+
+    return done;
+}
+
+//
+// Passes the intact records of the journal in "directory" to "h", if any,
+// leaving the last sequence number and highest segment index in "last" and
+// "highest". Records are numbered on from 1. A segment ends at its first
+// record which is not intact or not next in sequence, and the journal
+// continues with the segment which starts with the next one, if any.
+//
+static std::size_t
+scan_journal(const std::string& directory,
+             const posixcc::journal::record_handler& h,
+             posixcc::journal::sequence& last, std::uint64_t& highest,
+             bool& found)
+{
+    std::vector<char> buffer(replay_chunk);
+    std::size_t count = 0;
+
+    found = false;
+    last = 0;
+    highest = 0;
+
+    for (const std::uint64_t index: list_segments(directory)) {
+        const posixcc::auto_fd fd{open(segment_path(directory, index).c_str(),
+                                       O_RDONLY | O_CLOEXEC)};
+        struct stat s;
+
+        if (!fd || -1 == fstat(fd, &s)) {
+            throw std::runtime_error{errno_to_string(errno)};
+        }
+
+        found = true;
+        highest = index;
+
+        // The buffer holds the segment from "offset" to "offset" + "end";
+        // the next record starts at "start".
+        off_t offset = 0;
+        std::size_t start = 0, end = 0;
+
+        // Makes sure the buffer holds "length" bytes from "start".
+        const auto fill = [&](std::size_t length) {
+            if (end - start >= length) {
+                return true;
+            }
+            end -= start;
+            memmove(buffer.data(), buffer.data() + start, end);
+            offset += start;
+            start = 0;
+            if (buffer.size() < length) {
+                buffer.resize(length);
+            }
+            end += read_at(fd, buffer.data() + end, buffer.size() - end,
+                           offset + end);
+            return end >= length;
+        };
+
+        while (fill(header_size)) {
+            record_header r;
+            memcpy(&r, buffer.data() + start, header_size);
+
+            // Nothing but a record may claim more than is left, and only
+            // then is its data worth reading.
+            const std::size_t size = header_size + r.length;
+            if (r.number != last + 1 ||
+                static_cast<std::uint64_t>(offset + start + size) >
+                static_cast<std::uint64_t>(s.st_size) ||
+                !fill(size)) {
+                break;
+            }
+
+            const char* data = buffer.data() + start + header_size;
+            if (r.checksum != checksum(r, data)) {
+                break;
+            }
+
+            if (h) {
+                h(r.number, data, r.length);
+            }
+            last = r.number;
+            ++count;
+            start += size;
+        }
+    }
+
+    return count;
+}
+
+posixcc::journal::journal(const std::string& d, std::size_t size):
+directory{d},
+segment_size{size}
+{
+    if (-1 == mkdir(directory.c_str(), 0755) && EEXIST != errno) {
+        throw std::runtime_error{errno_to_string(errno)};
+    }
+
+    directory_fd = open(directory.c_str(),
+                        O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (!directory_fd) {
+        throw std::runtime_error{errno_to_string(errno)};
+    }
+
+    // Whatever follows the last intact record was never acknowledged, and
+    // is left behind rather than overwritten: appending starts in a fresh
+    // segment, so that no stale record can ever line up after a new one.
+    bool found;
+    scan_journal(directory, nullptr, last, segment_index, found);
+    durable = last;
+    open_segment(found ? segment_index + 1 : 0);
+}
+
+void
+posixcc::journal::open_segment(std::uint64_t index)
+{
+    auto_fd fd{open(segment_path(directory, index).c_str(),
+                    O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644)};
+
+    if (!fd) {
+        throw std::runtime_error{errno_to_string(errno)};
+    }
+
+    // Preallocation alone leaves unwritten extents, whose conversion on
+    // first write costs each group's fdatasync() a metadata commit too. The
+    // segment is written with zeroes once instead, so that later syncs have
+    // only data to flush; fallocate() merely reserves its blocks up front,
+    // where supported.
+    if (-1 == fallocate(fd, 0, 0, segment_size) && EOPNOTSUPP != errno) {
+        throw std::runtime_error{errno_to_string(errno)};
+    }
+
+    const std::vector<char> zeroes(std::min(segment_size, zero_chunk));
+    std::size_t done = 0;
+
+    while (done < segment_size) {
+        const ssize_t l = pwrite(fd, zeroes.data(),
+                                 std::min(zeroes.size(), segment_size - done),
+                                 done);
+        if (-1 == l) {
+            if (EINTR == errno) {
+                continue;
+            }
+            throw std::runtime_error{errno_to_string(errno)};
+        }
+        done += l;
+    }
+
+    if (-1 == fdatasync(fd) || -1 == fsync(directory_fd)) {
+        throw std::runtime_error{errno_to_string(errno)};
+    }
+
+    segment = std::move(fd);
+    segment_index = index;
+    tail = 0;
+}
+
+posixcc::journal&
+posixcc::journal::set_commit_window(std::chrono::microseconds w) noexcept
+{
+    std::lock_guard<std::mutex> guard{lock};
+    window = w;
+    return *this;
+}
+
+posixcc::journal::sequence
+posixcc::journal::append(const void* data, std::size_t length)
+{
+    if (length > segment_size - std::min(segment_size, header_size) ||
+        length > std::numeric_limits<std::uint32_t>::max()) {
+        throw std::runtime_error{errno_to_string(EMSGSIZE)};
+    }
+
+    std::unique_lock<std::mutex> guard{lock};
+
+    if (!failure.empty()) {
+        throw std::runtime_error{failure};
+    }
+
+    // The record is only referenced, as its caller waits for it.
+    const sequence number = ++last;
+    pending.push_back(record{number, static_cast<const char*>(data),
+                             length});
+
+    // Whoever finds no commit in progress commits everything pending, on
+    // behalf of the others.
+    while (durable < number) {
+        if (!failure.empty()) {
+            throw std::runtime_error{failure};
+        }
+        if (committing) {
+            committed.wait(guard);
+        } else {
+            commit(guard);
+        }
+    }
+
+    return number;
+}
+
+void
+posixcc::journal::commit(std::unique_lock<std::mutex>& guard)
+{
+    std::vector<record> group;
+
+    committing = true;
+    if (window.count()) {
+        guard.unlock();
+        std::this_thread::sleep_for(window);
+        guard.lock();
+    }
+    group.swap(pending);
+    guard.unlock();
+
+    std::string error;
+    try {
+        write_group(group);
+    } catch (const std::exception& e) {
+        error = e.what();
+    }
+
+    guard.lock();
+    committing = false;
+    if (error.empty()) {
+        durable = group.back().number;
+    } else {
+        failure = error;
+    }
+    committed.notify_all();
+}
+
+void
+posixcc::journal::write_group(const std::vector<record>& group)
+{
+    static const std::size_t iov_max = IOV_MAX;
+    std::vector<record_header> headers(group.size());
+    std::vector<struct iovec> iov;
+
+    iov.reserve(2 * group.size());
+
+    // Writes out "iov", and leaves it empty.
+    const auto flush = [&] {
+        std::size_t i = 0;
+
+        while (i < iov.size()) {
+            const int n = std::min(iov.size() - i, iov_max);
+            const ssize_t l = pwritev(segment, iov.data() + i, n, tail);
+
+            if (-1 == l) {
+                if (EINTR == errno) {
+                    continue;
+                }
+                throw std::runtime_error{errno_to_string(errno)};
+            }
+            tail += l;
+
+            // Resume a short write where it stopped.
+            std::size_t left = l;
+            while (i < iov.size() && left >= iov[i].iov_len) {
+                left -= iov[i++].iov_len;
+            }
+            if (left) {
+                iov[i].iov_base = static_cast<char*>(iov[i].iov_base) + left;
+                iov[i].iov_len -= left;
+            }
+        }
+        iov.clear();
+    };
+
+    for (std::size_t i = 0; i < group.size(); ++i) {
+        const record& r = group[i];
+        record_header& h = headers[i];
+        const std::size_t size = header_size + r.length;
+
+        // Records do not span segments. The full one is made durable before
+        // moving on, so that the journal never continues past a gap.
+        if (tail + size > segment_size) {
+            flush();
+            if (-1 == fdatasync(segment)) {
+                throw std::runtime_error{errno_to_string(errno)};
+            }
+            open_segment(segment_index + 1);
+        }
+
+        h.number = r.number;
+        h.length = r.length;
+        h.checksum = checksum(h, r.data);
+
+        iov.push_back({&h, header_size});
+        if (r.length) {
+            iov.push_back({const_cast<char*>(r.data), r.length});
+        }
+    }
+
+    flush();
+    if (-1 == fdatasync(segment)) {
+        throw std::runtime_error{errno_to_string(errno)};
+    }
+}
+
+posixcc::journal::sequence
+posixcc::journal::get_last_sequence()
+{
+    std::lock_guard<std::mutex> guard{lock};
+    return last;
+}
+
+std::uint64_t
+posixcc::journal::get_segment_index()
+{
+    std::lock_guard<std::mutex> guard{lock};
+    return segment_index;
+}
+
+std::size_t
+posixcc::journal::replay(const std::string& directory,
+                         const record_handler& h)
+{
+    sequence last;
+    std::uint64_t highest;
+    bool found;
+
+    return scan_journal(directory, h, last, highest, found);
+}
+
+#ifdef JOURNAL_TEST
+#include <atomic>
+#include "stfu/stfu.hh"
+
+//
+// Creates an empty directory to hold a journal, returning its path.
+//
+static std::string
+temp_directory()
+{
+    char path[] = "/var/tmp/posixcc-journal-XXXXXX";
+
+    STFU_ASSERT(nullptr != mkdtemp(path));
+    return path;
+}
+
+static void
+remove_directory(const std::string& directory)
+{
+    for (const std::uint64_t index: list_segments(directory)) {
+        unlink(segment_path(directory, index).c_str());
+    }
+    rmdir(directory.c_str());
+}
+
+//
+// Returns the "n"th record of the tests, of a length varying with "n".
+//
+static std::string
+record_data(std::size_t n)
+{
+    return std::string(n % 300, static_cast<char>('a' + n % 26)) +
+        std::to_string(n);
+}
+
+static void
+append_replay_tests()
+{
+    const std::string directory = temp_directory();
+    std::size_t count = 0;
+    bool ordered = true;
+    const auto check = [&](posixcc::journal::sequence n, const char* d,
+                           std::size_t l) {
+        ordered = ordered && n == count + 1 &&
+            std::string(d, l) == record_data(count + 1);
+        ++count;
+    };
+
+    // Small segments, so that many are filled.
+    {
+        posixcc::journal j{directory, 4096};
+
+        for (std::size_t i = 1; i <= 200; ++i) {
+            const std::string r = record_data(i);
+            STFU_ASSERT(i == j.append(r.data(), r.size()));
+        }
+        STFU_ASSERT(200 == j.get_last_sequence());
+        STFU_ASSERT(4 < j.get_segment_index());
+
+        // Records larger than a segment are refused.
+        bool thrown = false;
+        try {
+            const std::string big(4096, 'x');
+            j.append(big.data(), big.size());
+        } catch (const std::runtime_error&) {
+            thrown = true;
+        }
+        STFU_ASSERT(thrown && 200 == j.get_last_sequence());
+    }
+    STFU_ASSERT(200 == posixcc::journal::replay(directory, check));
+    STFU_ASSERT(ordered);
+
+    // Reopened, the journal carries on in a new segment.
+    {
+        posixcc::journal j{directory, 4096};
+        const std::uint64_t index = j.get_segment_index();
+
+        STFU_ASSERT(200 == j.get_last_sequence());
+        const std::string r = record_data(201);
+        STFU_ASSERT(201 == j.append(r.data(), r.size()));
+        STFU_ASSERT(index == j.get_segment_index());
+    }
+    count = 0;
+    STFU_ASSERT(201 == posixcc::journal::replay(directory, check));
+
+    remove_directory(directory);
+    STFU_PASS_IFF(ordered);
+}
+
+static void
+torn_write_tests()
+{
+    const std::string directory = temp_directory();
+    std::uint64_t index;
+    {
+        posixcc::journal j{directory};
+
+        for (std::size_t i = 1; i <= 10; ++i) {
+            const std::string r = record_data(i);
+            j.append(r.data(), r.size());
+        }
+        index = j.get_segment_index();
+    }
+
+    // Tear the last record, as a crash during its write might.
+    std::size_t size = 0;
+    for (std::size_t i = 1; i <= 10; ++i) {
+        size += header_size + record_data(i).size();
+    }
+    {
+        const posixcc::auto_fd fd{open(segment_path(directory, index).c_str(),
+                                       O_WRONLY)};
+        STFU_ASSERT(1 == pwrite(fd, "!", 1, size - 1));
+    }
+    STFU_ASSERT(9 == posixcc::journal::replay(directory, nullptr));
+
+    // The journal resumes after the last intact record, and replays past
+    // the torn one.
+    std::vector<posixcc::journal::sequence> numbers;
+    {
+        posixcc::journal j{directory};
+
+        STFU_ASSERT(9 == j.get_last_sequence());
+        const std::string r = record_data(10);
+        STFU_ASSERT(10 == j.append(r.data(), r.size()));
+    }
+    STFU_ASSERT(10 == posixcc::journal::replay(directory,
+        [&](posixcc::journal::sequence n, const char*, std::size_t) {
+            numbers.push_back(n);
+        }));
+
+    // A journal whose first segment is torn throughout is empty.
+    {
+        const posixcc::auto_fd fd{open(segment_path(directory, 0).c_str(),
+                                       O_WRONLY)};
+        STFU_ASSERT(1 == pwrite(fd, "!", 1, 0));
+    }
+    const std::size_t left = posixcc::journal::replay(directory, nullptr);
+
+    remove_directory(directory);
+    STFU_PASS_IFF(10 == numbers.size() && 10 == numbers.back() && 0 == left);
+}
+
+static void
+concurrent_tests()
+{
+    const std::string directory = temp_directory();
+    const std::size_t threads = 8, per_thread = 250;
+    std::vector<std::vector<posixcc::journal::sequence>> numbers(threads);
+    {
+        posixcc::journal j{directory, 64 << 10};
+        std::vector<std::thread> appenders;
+
+        for (std::size_t t = 0; t < threads; ++t) {
+            appenders.emplace_back([&, t] {
+                for (std::size_t i = 0; i < per_thread; ++i) {
+                    const std::string r = record_data(t * per_thread + i);
+                    numbers[t].push_back(j.append(r.data(), r.size()));
+                }
+            });
+        }
+        for (auto& a: appenders) {
+            a.join();
+        }
+    }
+
+    // Every record got its own number, and every one replays.
+    std::vector<posixcc::journal::sequence> all;
+    for (const auto& n: numbers) {
+        STFU_ASSERT(std::is_sorted(n.begin(), n.end()));
+        all.insert(all.end(), n.begin(), n.end());
+    }
+    std::sort(all.begin(), all.end());
+
+    posixcc::journal::sequence expected = 1;
+    const std::size_t count = posixcc::journal::replay(directory,
+        [&](posixcc::journal::sequence n, const char*, std::size_t) {
+            STFU_ASSERT(expected++ == n);
+        });
+
+    remove_directory(directory);
+    STFU_PASS_IFF(threads * per_thread == count &&
+                  all.end() == std::adjacent_find(all.begin(), all.end()) &&
+                  1 == all.front() && threads * per_thread == all.back());
+}
+
+extern "C" std::size_t
+unit_tests()
+{
+    stfu::test_group group{"journal tests",
+        "Tests of the append-only journal."};
+    group.add_test(stfu::test{"append and replay",
+            append_replay_tests,
+            "Verify that appended records replay in order, across "
+            "segments and reopening."})
+         .add_test(stfu::test{"torn write",
+            torn_write_tests,
+            "Verify that a torn record ends the journal, and that it "
+            "resumes before it."})
+         .add_test(stfu::test{"concurrent",
+            concurrent_tests,
+            "Verify group commits of records appended from many threads."})
+         .set_timeout(std::chrono::seconds(60));
+
+    stfu::test_result_summary summary = group();
+    return summary.failed + summary.crashed + summary.timed_out +
+        summary.regressed;
+}
+#endif // JOURNAL_TEST
+
+#ifdef JOURNAL_BENCH
+#include <atomic>
+#include "stfu/stfu.hh"
+
+static const std::size_t record_size = 128;
+static const std::size_t appenders = 32;
+
+//
+// Runs "n" appends through "f" on each of "appenders" threads; an operation
+// is one append by every thread, as starting the threads would otherwise
+// dominate.
+//
+static void
+spread(std::size_t n, const std::function<void()>& f)
+{
+    std::vector<std::thread> threads;
+
+    for (std::size_t t = 0; t < appenders; ++t) {
+        threads.emplace_back([&f, n] {
+            for (std::size_t i = 0; i < n; ++i) {
+                f();
+            }
+        });
+    }
+    for (auto& t: threads) {
+        t.join();
+    }
+}
+
+extern "C" std::size_t
+unit_tests()
+{
+    // Outside of any test, a failure can only be counted.
+    char path[] = "/var/tmp/posixcc-journal-XXXXXX";
+    if (nullptr == mkdtemp(path)) {
+        return 1;
+    }
+    const std::string directory = path;
+    const std::string data(record_size, 'x');
+
+    // A log syncing every record by itself, as the baseline.
+    std::mutex log_lock;
+    posixcc::auto_fd log{open((directory + "/log").c_str(),
+                              O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC,
+                              0644)};
+    if (!log) {
+        rmdir(path);
+        return 1;
+    }
+
+    // The journal is created by the benchmark process, which runs the
+    // threads.
+    std::unique_ptr<posixcc::journal> journal;
+    const auto get_journal = [&]() -> posixcc::journal& {
+        if (!journal) {
+            journal.reset(new posixcc::journal{directory + "/journal"});
+        }
+        return *journal;
+    };
+
+    // A failed assertion may not leave the threads, so failures are
+    // counted there and asserted on once they are done.
+    std::atomic<std::size_t> failures{0};
+
+    stfu::benchmark per_record{"sync per record", [&](std::size_t n) {
+            spread(n, [&] {
+                std::lock_guard<std::mutex> guard{log_lock};
+                if (static_cast<ssize_t>(data.size()) !=
+                        write(log, data.data(), data.size()) ||
+                    -1 == fdatasync(log)) {
+                    ++failures;
+                }
+            });
+            STFU_ASSERT(0 == failures);
+        },
+        "Append 128-byte records from 32 threads, each written and synced "
+        "on its own."
+    };
+    stfu::benchmark group_commit{"group commit", [&](std::size_t n) {
+            posixcc::journal& j = get_journal();
+            spread(n, [&] {
+                try {
+                    j.append(data.data(), data.size());
+                } catch (const std::runtime_error&) {
+                    ++failures;
+                }
+            });
+            STFU_ASSERT(0 == failures);
+        },
+        "Append 128-byte records from 32 threads to a journal, committed "
+        "in groups."
+    };
+    for (auto* b: {&per_record, &group_commit}) {
+        b->set_bytes_per_op(record_size * appenders)
+          .set_time_budget(std::chrono::seconds(2));
+    }
+
+    stfu::test_group group{"journal benchmarks",
+        "Group commit against a sync per record."};
+    group.add_test(per_record)
+         .add_test(group_commit)
+         .set_jobs(1);
+
+    stfu::test_result_summary summary = group();
+
+    unlink((directory + "/log").c_str());
+    for (const std::uint64_t index:
+             list_segments(directory + "/journal")) {
+        unlink(segment_path(directory + "/journal", index).c_str());
+    }
+    rmdir((directory + "/journal").c_str());
+    rmdir(directory.c_str());
+
+    return summary.failed + summary.crashed + summary.timed_out +
+        summary.regressed;
+}
+#endif // JOURNAL_BENCH
@@ -65,3 +65,31 @@ posixcc::load_modsymbol(const char *sym, const char *from)
 
     return modsymbol{h, p};
 }
+
+#ifdef MODULE_BENCH
+#include "stfu/stfu.hh"
+
+extern "C" std::size_t
+unit_tests()
+{
+    stfu::benchmark load{"load_modsymbol", [](std::size_t n) {
+            for (std::size_t i = 0; i < n; ++i) {
+                const auto &ms = posixcc::load_modsymbol("getpid",
+                                                         "libc.so.6");
+                STFU_ASSERT(posixcc::get_symbol<pid_t (*)()>(ms));
+            }
+        },
+        "Find a symbol in a library which is already loaded, and release "
+        "it again."
+    };
+
+    stfu::test_group group{"module benchmarks",
+        "Cost of module operations."};
+    group.add_test(load)
+         .set_jobs(1);
+
+    stfu::test_result_summary summary = group();
+    return summary.failed + summary.crashed + summary.timed_out +
+        summary.regressed;
+}
+#endif // MODULE_BENCH
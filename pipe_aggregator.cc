@@ -0,0 +1,308 @@
+//
+// Copyright (c) 2025 Bryan Phillippe
+//
+// This software is free to use for any purpose, provided this copyright
+// notice is preserved.
+//
+
+#include <algorithm>
+#include <cerrno>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+
+#include <libposix.hh>
+
+posixcc::pipe_aggregator::pipe_aggregator(reactor& r,
+                                          const record_handler& h,
+                                          char d, std::size_t size):
+loop{r},
+on_record{h},
+delimiter{d},
+buffer_size{std::max<std::size_t>(size, 1)}
+{
+}
+
+posixcc::pipe_aggregator::~pipe_aggregator()
+{
+    for (auto& s: streams) {
+        try {
+            loop.remove(s.second.fd);
+        } catch (const std::runtime_error&) {
+        }
+    }
+}
+
+void
+posixcc::pipe_aggregator::fill(source tag)
+{
+    const auto s = streams.find(tag);
+    if (streams.end() == s) {
+        return;
+    }
+    stream& st = s->second;
+
+    // Make room: move a partial record to the front, or grow the buffer if
+    // it fills the buffer entirely.
+    if (st.end == st.buffer.size()) {
+        if (st.start) {
+            memmove(st.buffer.data(), &st.buffer[st.start],
+                    st.end - st.start);
+            st.scanned -= st.start;
+            st.end -= st.start;
+            st.start = 0;
+        } else {
+            st.buffer.resize(st.buffer.size() * 2);
+        }
+    }
+
+    // A single read per event keeps one busy pipe from starving the rest;
+    // being level-triggered, the reactor comes back for whatever is left.
+    const ssize_t l = read(st.fd, &st.buffer[st.end],
+                           st.buffer.size() - st.end);
+    if (-1 == l && (EINTR == errno || EAGAIN == errno)) {
+        return;
+    }
+    if (0 >= l) {
+        complete(tag);
+        return;
+    }
+    st.end += l;
+
+    // Records are passed in place; the handler may remove any source,
+    // including this one.
+    std::uint64_t seen = removals;
+    while (const char* d = static_cast<const char*>(
+               memchr(&st.buffer[st.scanned], delimiter,
+                      st.end - st.scanned))) {
+        const std::size_t from = st.start;
+        const std::size_t to = d - st.buffer.data();
+
+        st.start = st.scanned = to + 1;
+        on_record(tag, &st.buffer[from], to - from);
+
+        if (seen != removals) {
+            if (!streams.count(tag)) {
+                return;
+            }
+            seen = removals;
+        }
+    }
+
+    st.scanned = st.end;
+    if (st.start == st.end) {
+        st.start = st.scanned = st.end = 0;
+    }
+}
+
+void
+posixcc::pipe_aggregator::complete(source tag)
+{
+    const auto s = streams.find(tag);
+    const stream& st = s->second;
+
+    if (st.start < st.end) {
+        const std::uint64_t seen = removals;
+
+        on_record(tag, &st.buffer[st.start], st.end - st.start);
+        if (seen != removals && !streams.count(tag)) {
+            return;
+        }
+    }
+
+    remove(tag);
+    if (on_complete) {
+        on_complete(tag);
+    }
+}
+
+posixcc::pipe_aggregator&
+posixcc::pipe_aggregator::set_on_complete(const completion_handler& h)
+{
+    on_complete = h;
+    return *this;
+}
+
+posixcc::pipe_aggregator::source
+posixcc::pipe_aggregator::add(auto_fd&& rfd)
+{
+    const int flags = fcntl(rfd, F_GETFL);
+    const source tag = next_source;
+
+    if (-1 == flags || -1 == fcntl(rfd, F_SETFL, flags | O_NONBLOCK)) {
+        throw std::runtime_error{errno_to_string(errno)};
+    }
+
+    loop.add(rfd, EPOLLIN, [this, tag](std::uint32_t) { fill(tag); });
+    streams[tag] = stream{std::move(rfd), std::vector<char>(buffer_size),
+                          0, 0, 0};
+    ++next_source;
+
+    return tag;
+}
+
+void
+posixcc::pipe_aggregator::remove(source tag)
+{
+    const auto s = streams.find(tag);
+
+    if (streams.end() == s) {
+        return;
+    }
+
+    try {
+        loop.remove(s->second.fd);
+    } catch (const std::runtime_error&) {
+    }
+
+    streams.erase(s);
+    ++removals;
+}
+
+std::size_t
+posixcc::pipe_aggregator::size() const noexcept
+{
+    return streams.size();
+}
+
+#ifdef PIPE_AGGREGATOR_TEST
+#include <string>
+#include <vector>
+#include "stfu/stfu.hh"
+
+//
+// Returns the read end of "p", taken over from it.
+//
+static posixcc::auto_fd
+take_rfd(posixcc::auto_pipe& p)
+{
+    posixcc::auto_fd fd{dup(p.get_rfd())};
+
+    p.close_rfd();
+    return fd;
+}
+
+static void
+record_tests()
+{
+    posixcc::reactor r;
+    posixcc::auto_pipe a, b;
+    std::vector<std::pair<posixcc::pipe_aggregator::source, std::string>>
+        records;
+    std::vector<posixcc::pipe_aggregator::source> completed;
+
+    // A small buffer, so that records span reads and outgrow it.
+    posixcc::pipe_aggregator g{r,
+        [&](posixcc::pipe_aggregator::source s, const char* d,
+            std::size_t l) {
+            records.emplace_back(s, std::string{d, l});
+        }, '\n', 4};
+    g.set_on_complete([&](posixcc::pipe_aggregator::source s) {
+        completed.push_back(s);
+    });
+
+    const auto sa = g.add(take_rfd(a));
+    const auto sb = g.add(take_rfd(b));
+    STFU_ASSERT(sa != sb && 2 == g.size());
+
+    write(a.get_wfd(), "one\ntw", 6);
+    write(b.get_wfd(), "a much longer record\n\n", 22);
+    while (r.run_once(std::chrono::milliseconds(0))) {
+    }
+    write(a.get_wfd(), "o\nthree", 7);
+    a.close_wfd();
+    while (r.run_once(std::chrono::milliseconds(0))) {
+    }
+
+    // The unterminated tail of "a" is passed on at EOF.
+    std::vector<std::string> from_a, from_b;
+    for (const auto& rec: records) {
+        (sa == rec.first ? from_a : from_b).push_back(rec.second);
+    }
+    STFU_ASSERT((std::vector<std::string>{"one", "two", "three"} == from_a));
+    STFU_ASSERT((std::vector<std::string>{"a much longer record", ""} ==
+                 from_b));
+    STFU_ASSERT(1 == completed.size() && sa == completed[0]);
+    STFU_ASSERT(1 == g.size());
+
+    // A removed source is closed, without completion.
+    g.remove(sb);
+    STFU_ASSERT(0 == g.size() && 0 == r.size());
+    STFU_PASS_IFF(1 == completed.size());
+}
+
+static void
+worker_tests()
+{
+    static const std::size_t workers = 50;
+    static const std::size_t lines = 1000;
+
+    posixcc::reactor r;
+    std::vector<posixcc::worker_process> children(workers);
+    std::map<posixcc::pipe_aggregator::source, std::size_t> next;
+    std::size_t completed = 0;
+    bool ordered = true;
+
+    posixcc::pipe_aggregator g{r,
+        [&](posixcc::pipe_aggregator::source s, const char* d,
+            std::size_t l) {
+            // Each worker's lines arrive whole and in order.
+            const std::string line{d, l};
+            ordered = ordered &&
+                ("line " + std::to_string(next[s]++)) == line;
+        }};
+    g.set_on_complete([&](posixcc::pipe_aggregator::source) {
+        ++completed;
+    });
+
+    for (auto& child: children) {
+        posixcc::auto_pipe p;
+
+        child.start([&p] {
+            p.close_rfd();
+            std::string out;
+            for (std::size_t i = 0; i < lines; ++i) {
+                out += "line " + std::to_string(i) + "\n";
+                if (0 == i % 97) {
+                    write(p.get_wfd(), out.data(), out.length());
+                    out.clear();
+                }
+            }
+            write(p.get_wfd(), out.data(), out.length());
+        });
+
+        p.close_wfd();
+        g.add(take_rfd(p));
+    }
+
+    r.run();
+    for (auto& child: children) {
+        child.join();
+    }
+
+    STFU_ASSERT(ordered && workers == next.size());
+    for (const auto& n: next) {
+        STFU_ASSERT(lines == n.second);
+    }
+    STFU_PASS_IFF(workers == completed);
+}
+
+extern "C" std::size_t
+unit_tests()
+{
+    stfu::test_group group{"pipe_aggregator tests",
+        "Tests of the pipe output aggregator."};
+    group.add_test(stfu::test{"records",
+            record_tests,
+            "Verify that records are split, tagged and completed."})
+         .add_test(stfu::test{"workers",
+            worker_tests,
+            "Verify that the output of many worker processes is merged."})
+         .set_timeout(std::chrono::seconds(30));
+
+    stfu::test_result_summary summary = group();
+    return summary.failed + summary.crashed + summary.timed_out +
+        summary.regressed;
+}
+#endif // PIPE_AGGREGATOR_TEST
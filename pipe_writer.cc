@@ -0,0 +1,440 @@
+//
+// Copyright (c) 2025 Bryan Phillippe
+//
+// This software is free to use for any purpose, provided this copyright
+// notice is preserved.
+//
+
+#include <algorithm>
+#include <cerrno>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/uio.h>
+
+#include <libposix.hh>
+
+//
+// Size of each buffer in the queue.
+//
+static const std::size_t chunk_size = 1 << 16;
+
+//
+// Most buffers written by a single writev() call.
+//
+static const int iov_limit = 64;
+
+posixcc::pipe_writer::pipe_writer(reactor& r, auto_fd&& wfd,
+                                  std::size_t max_queued):
+loop{r},
+fd{std::move(wfd)},
+limit{max_queued},
+high{max_queued / 2},
+low{max_queued / 8}
+{
+    const int flags = fcntl(fd, F_GETFL);
+
+    if (-1 == flags || -1 == fcntl(fd, F_SETFL, flags | O_NONBLOCK)) {
+        throw std::runtime_error{errno_to_string(errno)};
+    }
+
+    // Edge-triggered, so that an idle or blocked writer is never woken; an
+    // edge follows every write which left the descriptor full.
+    loop.add(fd, EPOLLOUT | EPOLLET, [this](std::uint32_t) { drain(); });
+}
+
+posixcc::pipe_writer::~pipe_writer()
+{
+    on_error = nullptr;
+    close();
+}
+
+void
+posixcc::pipe_writer::drain()
+{
+    struct iovec vectors[iov_limit];
+
+    while (queued) {
+        int n = 0;
+        for (auto c = chain.begin(); c != chain.end() && n < iov_limit;
+             ++c, ++n) {
+            const std::size_t skip = n ? 0 : offset;
+            vectors[n] = {c->data() + skip, c->size() - skip};
+        }
+
+        ssize_t l = writev(fd, vectors, n);
+        if (-1 == l) {
+            if (EINTR == errno) {
+                continue;
+            }
+            if (EAGAIN == errno) {
+                break;
+            }
+            fail(errno);
+            return;
+        }
+
+        // Release what was written; the last buffer is kept for reuse.
+        queued -= l;
+        while (0 < l) {
+            const std::size_t left = chain.front().size() - offset;
+
+            if (static_cast<std::size_t>(l) < left) {
+                offset += l;
+                break;
+            }
+
+            l -= left;
+            offset = 0;
+            if (1 < chain.size()) {
+                chain.pop_front();
+            } else {
+                chain.front().clear();
+            }
+        }
+    }
+
+    if (throttled && queued <= low) {
+        throttled = false;
+        if (on_low) {
+            on_low(*this);
+        }
+    }
+
+    if (finishing && !queued) {
+        close();
+    }
+}
+
+void
+posixcc::pipe_writer::enqueue(const char* data, std::size_t length)
+{
+    while (length) {
+        if (chain.empty() || chunk_size == chain.back().size()) {
+            chain.emplace_back();
+            chain.back().reserve(chunk_size);
+        }
+
+        auto& c = chain.back();
+        const std::size_t n = std::min(length, chunk_size - c.size());
+
+        c.insert(c.end(), data, data + n);
+        data += n;
+        length -= n;
+        queued += n;
+    }
+}
+
+void
+posixcc::pipe_writer::fail(int error)
+{
+    close();
+
+    // Last, as the callback may destroy the writer.
+    if (on_error) {
+        const auto f = on_error;
+        f(*this, error);
+    }
+}
+
+posixcc::pipe_writer&
+posixcc::pipe_writer::set_watermarks(std::size_t h, std::size_t l)
+{
+    if (l > h || h > limit) {
+        throw std::runtime_error{errno_to_string(EINVAL)};
+    }
+
+    high = h;
+    low = l;
+    return *this;
+}
+
+posixcc::pipe_writer&
+posixcc::pipe_writer::set_on_high(const std::function<void(pipe_writer&)>& f)
+{
+    on_high = f;
+    return *this;
+}
+
+posixcc::pipe_writer&
+posixcc::pipe_writer::set_on_low(const std::function<void(pipe_writer&)>& f)
+{
+    on_low = f;
+    return *this;
+}
+
+posixcc::pipe_writer&
+posixcc::pipe_writer::set_on_error(
+    const std::function<void(pipe_writer&, int)>& f)
+{
+    on_error = f;
+    return *this;
+}
+
+std::size_t
+posixcc::pipe_writer::write(const void* data, std::size_t length)
+{
+    const char* p = static_cast<const char*>(data);
+    std::size_t done = 0;
+
+    if (!fd || finishing) {
+        return 0;
+    }
+
+    // Nothing may overtake the queue; while it is empty, write directly.
+    while (!queued && done < length) {
+        const ssize_t l = ::write(fd, p + done, length - done);
+
+        if (0 <= l) {
+            done += l;
+        } else if (EAGAIN == errno) {
+            break;
+        } else if (EINTR != errno) {
+            fail(errno);
+            return 0;
+        }
+    }
+
+    const std::size_t n = std::min(length - done, limit - queued);
+    enqueue(p + done, n);
+
+    if (!throttled && high && queued >= high) {
+        throttled = true;
+        if (on_high) {
+            on_high(*this);
+        }
+    }
+
+    return done + n;
+}
+
+std::size_t
+posixcc::pipe_writer::get_queued() const noexcept
+{
+    return queued;
+}
+
+bool
+posixcc::pipe_writer::is_throttled() const noexcept
+{
+    return throttled;
+}
+
+bool
+posixcc::pipe_writer::is_open() const noexcept
+{
+    return static_cast<bool>(fd);
+}
+
+void
+posixcc::pipe_writer::finish()
+{
+    finishing = true;
+    if (!queued) {
+        close();
+    }
+}
+
+void
+posixcc::pipe_writer::close() noexcept
+{
+    if (!fd) {
+        return;
+    }
+
+    try {
+        loop.remove(fd);
+    } catch (const std::runtime_error&) {
+    }
+    fd.close();
+
+    chain.clear();
+    offset = 0;
+    queued = 0;
+}
+
+#ifdef PIPE_WRITER_TEST
+#include <csignal>
+#include <string>
+#include "stfu/stfu.hh"
+
+//
+// Returns the write end of "p", taken over from it.
+//
+static posixcc::auto_fd
+take_wfd(posixcc::auto_pipe& p)
+{
+    posixcc::auto_fd fd{dup(p.get_wfd())};
+
+    p.close_wfd();
+    fcntl(p.get_rfd(), F_SETFL, O_NONBLOCK);
+    return fd;
+}
+
+//
+// Reads everything available from "fd", checking that byte "i" of the
+// stream is "i % 251", which "total" counts.
+//
+static bool
+consume(int fd, std::size_t& total)
+{
+    char buffer[1 << 14];
+    ssize_t l;
+
+    while (0 < (l = read(fd, buffer, sizeof(buffer)))) {
+        for (ssize_t i = 0; i < l; ++i, ++total) {
+            if (static_cast<char>(total % 251) != buffer[i]) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+//
+// Writes as much of the pattern checked by consume() as "w" accepts,
+// starting at "produced".
+//
+static std::size_t
+produce(posixcc::pipe_writer& w, std::size_t& produced)
+{
+    char buffer[4096];
+    std::size_t accepted = 0;
+
+    for (;;) {
+        for (std::size_t i = 0; i < sizeof(buffer); ++i) {
+            buffer[i] = static_cast<char>((produced + i) % 251);
+        }
+
+        const std::size_t n = w.write(buffer, sizeof(buffer));
+        produced += n;
+        accepted += n;
+        if (n < sizeof(buffer)) {
+            return accepted;
+        }
+    }
+}
+
+static void
+backpressure_tests()
+{
+    posixcc::reactor r;
+    posixcc::auto_pipe p;
+    posixcc::pipe_writer w{r, take_wfd(p), 1 << 18};
+    int highs = 0, lows = 0;
+
+    w.set_watermarks(1 << 17, 1 << 15)
+     .set_on_high([&](posixcc::pipe_writer& x) {
+         STFU_ASSERT(x.is_throttled());
+         ++highs;
+     })
+     .set_on_low([&](posixcc::pipe_writer& x) {
+         STFU_ASSERT(!x.is_throttled());
+         ++lows;
+     });
+
+    // The pipe takes what it can, then the queue fills up to its limit,
+    // without the writer ever blocking.
+    std::size_t produced = 0;
+    produce(w, produced);
+    STFU_ASSERT((1 << 18) == w.get_queued());
+    STFU_ASSERT(produced > w.get_queued());
+    STFU_ASSERT(1 == highs && 0 == lows);
+    STFU_ASSERT(0 == w.write("x", 1));
+
+    // The queue drains as the consumer reads.
+    std::size_t consumed = 0;
+    while (consumed < produced) {
+        STFU_ASSERT(consume(p.get_rfd(), consumed));
+        r.run_once(std::chrono::milliseconds(100));
+    }
+    STFU_ASSERT(0 == w.get_queued() && 1 == lows);
+
+    // Finishing closes the pipe once the rest has been delivered.
+    produce(w, produced);
+    w.finish();
+    STFU_ASSERT(0 == w.write("x", 1));
+    while (w.is_open()) {
+        STFU_ASSERT(consume(p.get_rfd(), consumed));
+        r.run_once(std::chrono::milliseconds(100));
+    }
+    STFU_ASSERT(consume(p.get_rfd(), consumed));
+    STFU_ASSERT(0 == read(p.get_rfd(), &produced, 1));
+    STFU_ASSERT(0 == r.size());
+    STFU_PASS_IFF(produced == consumed && 2 == highs && 2 == lows);
+}
+
+static void
+slow_consumer_tests()
+{
+    static const std::size_t total = 1 << 23;
+
+    posixcc::reactor r;
+    posixcc::auto_pipe slow, fast;
+    posixcc::pipe_writer s{r, take_wfd(slow), 1 << 16};
+    posixcc::pipe_writer f{r, take_wfd(fast), 1 << 16};
+    std::size_t produced[2] = {0, 0}, consumed = 0;
+
+    // A consumer which never reads does not hold up another.
+    while (consumed < total) {
+        produce(s, produced[0]);
+        produce(f, produced[1]);
+        r.run_once(std::chrono::milliseconds(0));
+        STFU_ASSERT(consume(fast.get_rfd(), consumed));
+    }
+
+    STFU_ASSERT(s.is_throttled());
+    STFU_PASS_IFF(produced[0] < (1 << 18) && s.get_queued() == (1 << 16));
+}
+
+static void
+error_tests()
+{
+    posixcc::reactor r;
+    posixcc::auto_pipe p;
+    posixcc::pipe_writer w{r, take_wfd(p)};
+    int error = 0;
+
+    signal(SIGPIPE, SIG_IGN);
+    w.set_on_error([&](posixcc::pipe_writer& x, int e) {
+        STFU_ASSERT(!x.is_open());
+        error = e;
+    });
+
+    // The consumer goes away with data queued.
+    std::size_t produced = 0;
+    produce(w, produced);
+    STFU_ASSERT(w.get_queued());
+    p.close_rfd();
+    r.run_once(std::chrono::milliseconds(100));
+
+    STFU_ASSERT(!w.is_open() && 0 == w.get_queued());
+    STFU_ASSERT(0 == r.size());
+    STFU_PASS_IFF(EPIPE == error && 0 == w.write("x", 1));
+}
+
+extern "C" std::size_t
+unit_tests()
+{
+    stfu::test_group group{"pipe_writer tests",
+        "Tests of the non-blocking pipe writer."};
+    group.add_test(stfu::test{"backpressure",
+            backpressure_tests,
+            "Verify that data is queued up to the limit, drained in order, "
+            "and the watermark callbacks are made."})
+         .add_test(stfu::test{"slow consumer",
+            slow_consumer_tests,
+            "Verify that a consumer which does not read does not stall the "
+            "writers to others."})
+         .add_test(stfu::test{"errors",
+            error_tests,
+            "Verify that a consumer closing its end is reported."})
+         .set_timeout(std::chrono::seconds(30));
+
+    stfu::test_result_summary summary = group();
+    return summary.failed + summary.crashed + summary.timed_out +
+        summary.regressed;
+}
+#endif // PIPE_WRITER_TEST
@@ -265,6 +265,51 @@ unit_tests()
         ;
 
     stfu::test_result_summary summary = unit_tests();
-    return summary.failed + summary.crashed;
+    return summary.failed + summary.crashed + summary.timed_out +
+        summary.regressed;
 }
 #endif // PROCESS_TEST
+
+#ifdef PROCESS_BENCH
+#include "stfu/stfu.hh"
+
+extern "C" std::size_t
+unit_tests()
+{
+    using namespace std::chrono;
+
+    stfu::benchmark start_join{"start-join", [](std::size_t n) {
+            posixcc::worker_process worker;
+            for (std::size_t i = 0; i < n; ++i) {
+                worker.start([]{});
+                worker.join();
+            }
+        },
+        "Latency from starting a worker with an empty task, to having "
+        "joined it."
+    };
+    stfu::benchmark wake_up{"join wake-up", [](std::size_t n) {
+            posixcc::worker_process worker;
+            for (std::size_t i = 0; i < n; ++i) {
+                worker.start([]{ usleep(1000); });
+                worker.join();
+            }
+        },
+        "Latency of joining a worker which runs for 1ms; less the 1ms and "
+        "the start-join latency, this is the time join() takes to notice "
+        "that the worker finished."
+    };
+    start_join.set_samples(20);
+    wake_up.set_samples(20);
+
+    stfu::test_group group{"worker benchmarks",
+        "Cost of worker process operations."};
+    group.add_test(start_join)
+         .add_test(wake_up)
+         .set_jobs(1);
+
+    stfu::test_result_summary summary = group();
+    return summary.failed + summary.crashed + summary.timed_out +
+        summary.regressed;
+}
+#endif // PROCESS_BENCH
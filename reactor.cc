@@ -0,0 +1,266 @@
+//
+// Copyright (c) 2025 Bryan Phillippe
+//
+// This software is free to use for any purpose, provided this copyright
+// notice is preserved.
+//
+
+#include <algorithm>
+#include <cerrno>
+
+#include <unistd.h>
+#include <sys/epoll.h>
+
+#include <libposix.hh>
+
+//
+// Most events collected by a single epoll_wait() call.
+//
+static const int event_limit = 64;
+
+posixcc::reactor::reactor():
+epoll_fd{epoll_create1(EPOLL_CLOEXEC)}
+{
+    // The timer wheel is registration 0, which no descriptor is given.
+    struct epoll_event e{};
+    e.events = EPOLLIN;
+    e.data.u64 = 0;
+
+    if (!epoll_fd ||
+        -1 == epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wheel.get_fd(), &e)) {
+        throw std::runtime_error{errno_to_string(errno)};
+    }
+}
+
+int
+posixcc::reactor::get() const noexcept
+{
+    return epoll_fd.get();
+}
+
+posixcc::reactor&
+posixcc::reactor::add(int fd, std::uint32_t events, const handler& h)
+{
+    // Events are tagged by registration rather than by descriptor, so that
+    // stale events for a descriptor removed and reused within one batch
+    // are not delivered to its new handler.
+    struct epoll_event e{};
+    e.events = events;
+    e.data.u64 = next_id;
+
+    if (-1 == epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &e)) {
+        throw std::runtime_error{errno_to_string(errno)};
+    }
+
+    registered[fd] = next_id;
+    handlers[next_id] = std::make_shared<handler>(h);
+    ++next_id;
+
+    return *this;
+}
+
+posixcc::reactor&
+posixcc::reactor::modify(int fd, std::uint32_t events)
+{
+    const auto r = registered.find(fd);
+    struct epoll_event e{};
+
+    if (registered.end() == r) {
+        throw std::runtime_error{errno_to_string(ENOENT)};
+    }
+
+    e.events = events;
+    e.data.u64 = r->second;
+    if (-1 == epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &e)) {
+        throw std::runtime_error{errno_to_string(errno)};
+    }
+
+    return *this;
+}
+
+posixcc::reactor&
+posixcc::reactor::remove(int fd)
+{
+    const auto r = registered.find(fd);
+
+    if (registered.end() == r) {
+        throw std::runtime_error{errno_to_string(ENOENT)};
+    }
+
+    // The descriptor may already have been closed, which removes it from
+    // the epoll set implicitly.
+    if (-1 == epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr) &&
+        EBADF != errno && ENOENT != errno) {
+        throw std::runtime_error{errno_to_string(errno)};
+    }
+
+    handlers.erase(r->second);
+    registered.erase(r);
+
+    return *this;
+}
+
+posixcc::reactor::timer_id
+posixcc::reactor::add_timer(clock::duration after,
+                            const std::function<void()>& callback)
+{
+    return wheel.add(after, callback);
+}
+
+void
+posixcc::reactor::cancel_timer(timer_id id) noexcept
+{
+    wheel.cancel(id);
+}
+
+std::size_t
+posixcc::reactor::size() const noexcept
+{
+    return registered.size() + wheel.size();
+}
+
+std::size_t
+posixcc::reactor::run_once(std::chrono::milliseconds timeout)
+{
+    struct epoll_event events[event_limit];
+    std::size_t dispatched = 0;
+    const int wait = (0 > timeout.count()) ? -1 :
+        static_cast<int>(std::min<std::chrono::milliseconds::rep>(
+            timeout.count(), INT32_MAX));
+
+    int n = epoll_wait(epoll_fd, events, event_limit, wait);
+    if (-1 == n) {
+        if (EINTR != errno) {
+            throw std::runtime_error{errno_to_string(errno)};
+        }
+        n = 0;
+    }
+
+    for (int i = 0; i < n; ++i) {
+        if (0 == events[i].data.u64) {
+            dispatched += wheel.expire();
+            continue;
+        }
+
+        const auto h = handlers.find(events[i].data.u64);
+
+        // Keep the handler alive, even if it removes itself.
+        if (handlers.end() != h) {
+            const std::shared_ptr<handler> keep{h->second};
+            (*keep)(events[i].events);
+            ++dispatched;
+        }
+    }
+
+    return dispatched;
+}
+
+void
+posixcc::reactor::run()
+{
+    while (size()) {
+        run_once();
+    }
+}
+
+#ifdef REACTOR_TEST
+#include "stfu/stfu.hh"
+
+static void
+event_tests()
+{
+    posixcc::reactor r;
+    posixcc::auto_pipe p, q;
+    std::string got;
+
+    STFU_ASSERT(-1 != r.get());
+    STFU_ASSERT(0 == r.size());
+    STFU_ASSERT(0 == r.run_once(std::chrono::milliseconds(0)));
+
+    r.add(p.get_rfd(), EPOLLIN, [&](std::uint32_t events) {
+        char buffer[16];
+        STFU_ASSERT(events & EPOLLIN);
+        const ssize_t l = read(p.get_rfd(), buffer, sizeof(buffer));
+        got.append(buffer, l);
+    });
+    STFU_ASSERT(1 == r.size());
+
+    // Registering a descriptor twice fails.
+    bool thrown = false;
+    try {
+        r.add(p.get_rfd(), EPOLLIN, [](std::uint32_t) {});
+    } catch (const std::runtime_error&) {
+        thrown = true;
+    }
+    STFU_ASSERT(thrown);
+
+    write(p.get_wfd(), "abc", 3);
+    STFU_ASSERT(1 == r.run_once(std::chrono::milliseconds(100)));
+    STFU_ASSERT("abc" == got);
+
+    // A handler removing another pending handler, then all of them; events
+    // are reported in the order the descriptors became ready.
+    posixcc::auto_pipe o;
+    int calls = 0;
+    r.add(q.get_rfd(), EPOLLIN, [&](std::uint32_t) {
+        ++calls;
+        r.remove(o.get_rfd());
+        r.remove(p.get_rfd());
+        r.remove(q.get_rfd());
+    });
+    r.add(o.get_rfd(), EPOLLIN, [&](std::uint32_t) { ++calls; });
+    write(q.get_wfd(), "d", 1);
+    write(o.get_wfd(), "e", 1);
+    STFU_ASSERT(1 == r.run_once(std::chrono::milliseconds(100)));
+    STFU_ASSERT(0 == r.size());
+    STFU_PASS_IFF(1 == calls && "abc" == got);
+}
+
+static void
+timer_tests()
+{
+    using namespace std::chrono;
+
+    posixcc::reactor r;
+    std::string order;
+
+    // "b" is due long after the others, so that they can not fall due in
+    // the same round however late the process is scheduled.
+    const auto start = posixcc::reactor::clock::now();
+    r.add_timer(seconds(1), [&] { order += "b"; });
+    r.add_timer(milliseconds(10), [&] {
+        order += "a";
+        // Timers added by a timer are not fired in the same round.
+        r.add_timer(milliseconds(0), [&] { order += "c"; });
+    });
+    const auto cancelled = r.add_timer(milliseconds(20),
+                                       [&] { order += "x"; });
+    STFU_ASSERT(3 == r.size());
+    r.cancel_timer(cancelled);
+    r.cancel_timer(cancelled);
+    STFU_ASSERT(2 == r.size());
+
+    r.run();
+    const auto elapsed = posixcc::reactor::clock::now() - start;
+
+    STFU_ASSERT(elapsed >= seconds(1));
+    STFU_PASS_IFF("acb" == order);
+}
+
+extern "C" std::size_t
+unit_tests()
+{
+    stfu::test_group group{"reactor tests",
+        "Tests of the reactor event loop."};
+    group.add_test(stfu::test{"events",
+            event_tests,
+            "Verify the registration and dispatch of descriptor events."})
+         .add_test(stfu::test{"timers",
+            timer_tests,
+            "Verify that timers fire in order, and can be cancelled."});
+
+    stfu::test_result_summary summary = group();
+    return summary.failed + summary.crashed + summary.timed_out +
+        summary.regressed;
+}
+#endif // REACTOR_TEST
@@ -0,0 +1,532 @@
+//
+// Copyright (c) 2025 Bryan Phillippe
+//
+// This software is free to use for any purpose, provided this copyright
+// notice is preserved.
+//
+
+#include <cerrno>
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+
+#include <libposix.hh>
+
+//
+// Most bytes moved by a single splice() call.
+//
+static const std::size_t splice_limit = 1 << 16;
+
+static const unsigned int splice_flags = SPLICE_F_MOVE | SPLICE_F_NONBLOCK;
+
+//
+// Keeps a destination whose peer has gone from killing the process with
+// SIGPIPE, as splice() has no MSG_NOSIGNAL: the signal is blocked in the
+// calling thread while in scope, and any raised meanwhile is consumed before
+// the mask is restored. One already pending beforehand is left alone.
+//
+class sigpipe_guard {
+    sigset_t set;
+    sigset_t old;
+    bool pending{false};
+
+    public:
+
+    sigpipe_guard() noexcept
+    {
+        sigset_t p;
+
+        sigemptyset(&set);
+        sigaddset(&set, SIGPIPE);
+        pthread_sigmask(SIG_BLOCK, &set, &old);
+        pending = (0 == sigpending(&p) && sigismember(&p, SIGPIPE));
+    }
+
+    ~sigpipe_guard()
+    {
+        const int e = errno;
+
+        if (!pending) {
+            const struct timespec zero{0, 0};
+            while (-1 == sigtimedwait(&set, nullptr, &zero) &&
+                   EINTR == errno) {
+            }
+        }
+        pthread_sigmask(SIG_SETMASK, &old, nullptr);
+        errno = e;
+    }
+};
+
+//
+// Whether an error ends a direction of the relay, as the peer has gone,
+// rather than the whole relay.
+//
+static bool
+is_disconnect(int e)
+{
+    return EPIPE == e || ECONNRESET == e;
+}
+
+posixcc::relay::relay(reactor& r, auto_fd&& a, auto_fd&& b):
+loop{r}
+{
+    ends[0] = std::move(a);
+    ends[1] = std::move(b);
+    active = reactor::clock::now();
+
+    // Both ends are edge-triggered: each event pumps both directions as far
+    // as they go, so interest never needs to change with backpressure.
+    for (auto& fd: ends) {
+        const int flags = fcntl(fd, F_GETFL);
+
+        if (-1 == flags || -1 == fcntl(fd, F_SETFL, flags | O_NONBLOCK)) {
+            throw std::runtime_error{errno_to_string(errno)};
+        }
+    }
+
+    for (std::size_t i = 0; i < 2; ++i) {
+        try {
+            loop.add(ends[i], EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET,
+                     [this](std::uint32_t) {
+                         // Nothing may touch the relay once it has closed,
+                         // as its close callback may have destroyed it.
+                         if (!pump(0) || !pump(1) ||
+                             (eof[0] && eof[1] &&
+                              !buffered[0] && !buffered[1])) {
+                             close();
+                         }
+                     });
+        } catch (...) {
+            if (i) {
+                loop.remove(ends[0]);
+            }
+            throw;
+        }
+    }
+}
+
+posixcc::relay::~relay()
+{
+    on_close = nullptr;
+    close();
+}
+
+bool
+posixcc::relay::pump(int from)
+{
+    const int to = 1 - from;
+    const auto& pipe = buffers[from];
+    const sigpipe_guard guard;
+    bool progress = true;
+
+    while (progress) {
+        progress = false;
+
+        // Fill the pipe from the source, unless it is full.
+        if (!eof[from]) {
+            const ssize_t l = splice(ends[from], nullptr, pipe.get_wfd(),
+                                     nullptr, splice_limit, splice_flags);
+            if (0 < l) {
+                buffered[from] += l;
+                progress = true;
+            } else if (0 == l) {
+                eof[from] = true;
+            } else if (EINTR == errno) {
+                progress = true;
+            } else if (is_disconnect(errno)) {
+                eof[from] = true;
+            } else if (EAGAIN != errno) {
+                return false;
+            }
+        }
+
+        // Drain the pipe into the destination, as far as it accepts.
+        if (buffered[from]) {
+            const ssize_t l = splice(pipe.get_rfd(), nullptr, ends[to],
+                                     nullptr, buffered[from], splice_flags);
+            if (0 < l) {
+                buffered[from] -= l;
+                counts[from] += l;
+                progress = true;
+            } else if (-1 == l && EINTR == errno) {
+                progress = true;
+            } else if (-1 == l && is_disconnect(errno)) {
+                // Nothing more can be delivered this way; what is buffered
+                // is dropped, and the source no longer read.
+                eof[from] = true;
+                buffered[from] = 0;
+            } else if (-1 == l && EAGAIN != errno) {
+                return false;
+            }
+        }
+
+        if (progress) {
+            active = reactor::clock::now();
+        }
+    }
+
+    // Pass the end of this direction on once everything before it is
+    // delivered; a destination which is not a socket can not half-close.
+    if (eof[from] && !buffered[from] &&
+        -1 == ::shutdown(ends[to], SHUT_WR) &&
+        ENOTSOCK != errno && ENOTCONN != errno) {
+        return false;
+    }
+
+    return true;
+}
+
+void
+posixcc::relay::check_idle()
+{
+    const auto now = reactor::clock::now();
+
+    timer = 0;
+    if (now - active >= idle) {
+        close();
+    } else {
+        timer = loop.add_timer(active + idle - now, [this] { check_idle(); });
+    }
+}
+
+posixcc::relay&
+posixcc::relay::set_idle_timeout(reactor::clock::duration timeout)
+{
+    // Activity only moves the deadline; the timer catches up with it when
+    // it fires, rather than being rescheduled for every transfer.
+    loop.cancel_timer(timer);
+    timer = 0;
+    idle = timeout;
+
+    if (open && reactor::clock::duration::zero() < idle) {
+        timer = loop.add_timer(idle, [this] { check_idle(); });
+    }
+
+    return *this;
+}
+
+posixcc::relay&
+posixcc::relay::set_on_close(const std::function<void(relay&)>& f)
+{
+    on_close = f;
+    return *this;
+}
+
+std::uint64_t
+posixcc::relay::get_forward_bytes() const noexcept
+{
+    return counts[0];
+}
+
+std::uint64_t
+posixcc::relay::get_backward_bytes() const noexcept
+{
+    return counts[1];
+}
+
+bool
+posixcc::relay::is_open() const noexcept
+{
+    return open;
+}
+
+void
+posixcc::relay::close() noexcept
+{
+    if (!open) {
+        return;
+    }
+
+    open = false;
+    loop.cancel_timer(timer);
+    timer = 0;
+
+    for (auto& fd: ends) {
+        try {
+            loop.remove(fd);
+        } catch (const std::runtime_error&) {
+        }
+        fd.close();
+    }
+
+    for (auto& p: buffers) {
+        p.close();
+    }
+
+    // Last, as the callback may destroy the relay.
+    if (on_close) {
+        const auto f = on_close;
+        f(*this);
+    }
+}
+
+#ifdef RELAY_TEST
+#include <vector>
+#include "stfu/stfu.hh"
+
+//
+// A relay between a client and a backend, each connected to it by a pair
+// of UNIX stream sockets.
+//
+struct setup {
+    posixcc::reactor loop;
+    std::pair<posixcc::unix_stream_socket, posixcc::unix_stream_socket>
+        client{posixcc::unix_stream_socket::pair()};
+    std::pair<posixcc::unix_stream_socket, posixcc::unix_stream_socket>
+        backend{posixcc::unix_stream_socket::pair()};
+    posixcc::relay r{loop, client.second.release(), backend.second.release()};
+
+    //
+    // Runs the reactor until "done" holds, or nothing is left to run.
+    //
+    bool run_until(const std::function<bool()>& done)
+    {
+        for (int i = 0; i < 1000 && !done(); ++i) {
+            loop.run_once(std::chrono::milliseconds(10));
+        }
+        return done();
+    }
+};
+
+static void
+transfer_tests()
+{
+    setup s;
+    char buffer[16];
+    bool closed = false;
+
+    s.r.set_on_close([&closed](posixcc::relay&) { closed = true; });
+    STFU_ASSERT(s.r.is_open());
+
+    STFU_ASSERT(5 == s.client.first.send("hello", 5));
+    STFU_ASSERT(s.run_until([&] { return 5 == s.r.get_forward_bytes(); }));
+    STFU_ASSERT(5 == s.backend.first.recv(buffer, sizeof(buffer)));
+    STFU_ASSERT(0 == memcmp(buffer, "hello", 5));
+
+    STFU_ASSERT(3 == s.backend.first.send("hi!", 3));
+    STFU_ASSERT(s.run_until([&] { return 3 == s.r.get_backward_bytes(); }));
+    STFU_ASSERT(3 == s.client.first.recv(buffer, sizeof(buffer)));
+
+    // The client half-closes; the backend sees the end of its data, but
+    // can still reply.
+    STFU_ASSERT(4 == s.client.first.send("last", 4));
+    s.client.first.shutdown(SHUT_WR);
+    STFU_ASSERT(s.run_until([&] { return 9 == s.r.get_forward_bytes(); }));
+    STFU_ASSERT(4 == s.backend.first.recv(buffer, sizeof(buffer)));
+    STFU_ASSERT(0 == s.backend.first.recv(buffer, sizeof(buffer)));
+    STFU_ASSERT(s.r.is_open());
+
+    STFU_ASSERT(3 == s.backend.first.send("bye", 3));
+    s.backend.first.close();
+    STFU_ASSERT(s.run_until([&] { return closed; }));
+    STFU_ASSERT(3 == s.client.first.recv(buffer, sizeof(buffer)));
+    STFU_ASSERT(0 == s.client.first.recv(buffer, sizeof(buffer)));
+
+    STFU_ASSERT(!s.r.is_open());
+    STFU_ASSERT(6 == s.r.get_backward_bytes());
+    STFU_PASS_IFF(0 == s.loop.size());
+}
+
+static void
+backpressure_tests()
+{
+    static const std::size_t total = 4 << 20;
+
+    setup s;
+    std::vector<char> out(total), in;
+
+    for (std::size_t i = 0; i < total; ++i) {
+        out[i] = static_cast<char>(i * 7);
+    }
+
+    // With the backend not reading, the relay stops reading the client,
+    // which then can not send everything.
+    std::size_t sent = 0;
+    for (int i = 0; i < 100; ++i) {
+        const ssize_t l = s.client.first.send(&out[sent], total - sent);
+        if (0 < l) {
+            sent += l;
+        }
+        s.loop.run_once(std::chrono::milliseconds(0));
+    }
+    STFU_ASSERT(sent < total);
+    STFU_ASSERT(s.r.get_forward_bytes() < sent);
+
+    // Once the backend reads, everything comes through intact.
+    char buffer[65536];
+    while (in.size() < total) {
+        if (sent < total) {
+            const ssize_t l = s.client.first.send(&out[sent], total - sent);
+            if (0 < l) {
+                sent += l;
+            }
+        }
+        s.loop.run_once(std::chrono::milliseconds(10));
+
+        ssize_t l;
+        while (0 < (l = s.backend.first.recv(buffer, sizeof(buffer)))) {
+            in.insert(in.end(), buffer, buffer + l);
+        }
+    }
+
+    STFU_ASSERT(total == s.r.get_forward_bytes());
+    STFU_PASS_IFF(out == in);
+}
+
+static void
+reset_tests()
+{
+    setup s;
+    char buffer[16];
+    bool closed = false;
+
+    // SIGPIPE as a proxy would usually have it, killing the process.
+    signal(SIGPIPE, SIG_DFL);
+    s.r.set_on_close([&closed](posixcc::relay&) { closed = true; });
+
+    STFU_ASSERT(5 == s.client.first.send("hello", 5));
+    STFU_ASSERT(s.run_until([&] { return 5 == s.r.get_forward_bytes(); }));
+
+    // The backend goes away with data unread, and the client keeps
+    // sending; both directions end, and so does the relay.
+    s.backend.first.close();
+    STFU_ASSERT(5 == s.client.first.send("more!", 5));
+    STFU_ASSERT(s.run_until([&] { return closed; }));
+    STFU_ASSERT(0 == s.client.first.recv(buffer, sizeof(buffer)));
+
+    sigset_t pending;
+    STFU_ASSERT(0 == sigpending(&pending));
+    STFU_PASS_IFF(!sigismember(&pending, SIGPIPE) && 0 == s.loop.size());
+}
+
+static void
+idle_tests()
+{
+    using namespace std::chrono;
+
+    setup s;
+    const auto start = posixcc::reactor::clock::now();
+
+    s.r.set_idle_timeout(milliseconds(100));
+    STFU_ASSERT(1 == s.client.first.send("x", 1));
+
+    // Traffic half way keeps the relay open past the first deadline.
+    s.loop.run_once(milliseconds(50));
+    STFU_ASSERT(s.run_until([&] { return 1 == s.r.get_forward_bytes(); }));
+    STFU_ASSERT(s.run_until([&] {
+        return posixcc::reactor::clock::now() - start > milliseconds(60);
+    }));
+    STFU_ASSERT(1 == s.client.first.send("y", 1));
+
+    STFU_ASSERT(s.run_until([&] { return !s.r.is_open(); }));
+    const auto elapsed = posixcc::reactor::clock::now() - start;
+    STFU_ASSERT(elapsed >= milliseconds(160));
+    STFU_PASS_IFF(0 == s.loop.size());
+}
+
+extern "C" std::size_t
+unit_tests()
+{
+    stfu::test_group group{"relay tests",
+        "Tests of the splice relay."};
+    group.add_test(stfu::test{"transfer",
+            transfer_tests,
+            "Verify relaying in both directions, half-close and byte "
+            "counts."})
+         .add_test(stfu::test{"backpressure",
+            backpressure_tests,
+            "Verify that a relay reads no faster than its destination "
+            "accepts data."})
+         .add_test(stfu::test{"peer reset",
+            reset_tests,
+            "Verify that a peer going away mid-transfer closes the relay, "
+            "without SIGPIPE."})
+         .add_test(stfu::test{"idle timeout",
+            idle_tests,
+            "Verify that an idle relay is closed."})
+         .set_timeout(std::chrono::seconds(30));
+
+    stfu::test_result_summary summary = group();
+    return summary.failed + summary.crashed + summary.timed_out +
+        summary.regressed;
+}
+#endif // RELAY_TEST
+
+#ifdef RELAY_BENCH
+#include <vector>
+#include "stfu/stfu.hh"
+
+static const std::size_t chunk = 1 << 16;
+
+extern "C" std::size_t
+unit_tests()
+{
+    stfu::benchmark spliced{"splice relay", [](std::size_t n) {
+            posixcc::reactor loop;
+            auto client = posixcc::unix_stream_socket::pair();
+            auto backend = posixcc::unix_stream_socket::pair();
+            posixcc::relay r{loop, client.second.release(),
+                             backend.second.release()};
+            std::vector<char> buffer(chunk, 'x');
+
+            for (std::size_t i = 0; i < n; ++i) {
+                STFU_ASSERT(static_cast<ssize_t>(chunk) ==
+                    client.first.send(buffer.data(), chunk));
+
+                for (std::size_t got = 0; got < chunk; ) {
+                    loop.run_once(std::chrono::milliseconds(10));
+
+                    const ssize_t l = backend.first.recv(buffer.data(),
+                                                         chunk);
+                    if (0 < l) {
+                        got += l;
+                    }
+                }
+            }
+        },
+        "Relay 64 KiB chunks between two UNIX stream sockets with splice(), "
+        "driven by a reactor."
+    };
+    stfu::benchmark copied{"read/write", [](std::size_t n) {
+            auto client = posixcc::unix_stream_socket::pair();
+            auto backend = posixcc::unix_stream_socket::pair();
+            std::vector<char> buffer(chunk, 'x');
+            std::vector<char> copy(chunk);
+
+            client.second.set_blocking(true);
+            backend.second.set_blocking(true);
+            for (std::size_t i = 0; i < n; ++i) {
+                STFU_ASSERT(static_cast<ssize_t>(chunk) ==
+                    client.first.send(buffer.data(), chunk));
+
+                for (std::size_t got = 0; got < chunk; ) {
+                    const ssize_t l = client.second.recv(copy.data(),
+                                                         chunk - got);
+                    STFU_ASSERT(l == backend.second.send(copy.data(), l));
+                    STFU_ASSERT(l == backend.first.recv(buffer.data(), l,
+                                                        MSG_WAITALL));
+                    got += l;
+                }
+            }
+        },
+        "Reference for the above: relay the chunks through a user space "
+        "buffer with recv() and send()."
+    };
+    spliced.set_bytes_per_op(chunk);
+    copied.set_bytes_per_op(chunk);
+
+    stfu::test_group group{"relay benchmarks",
+        "Throughput of relaying between two sockets."};
+    group.add_test(spliced)
+         .add_test(copied)
+         .set_jobs(1);
+
+    stfu::test_result_summary summary = group();
+    return summary.failed + summary.crashed + summary.timed_out +
+        summary.regressed;
+}
+#endif // RELAY_BENCH
@@ -0,0 +1,424 @@
+//
+// Copyright (c) 2025 Bryan Phillippe
+//
+// This software is free to use for any purpose, provided this copyright
+// notice is preserved.
+//
+
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+
+#include <unistd.h>
+
+#include <libposix.hh>
+
+//
+// Returns a hidden name in the directory, unique to this process, for the
+// new contents of "name".
+//
+static std::string
+temp_name(const std::string& name)
+{
+    static std::atomic<unsigned long> counter{0};
+
+    return "." + name + "." + std::to_string(getpid()) + "." +
+        std::to_string(counter++) + ".tmp";
+}
+
+posixcc::file_replacer::file_replacer(const std::string& directory):
+directory_fd{open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC)}
+{
+    if (!directory_fd) {
+        throw std::runtime_error{errno_to_string(errno)};
+    }
+}
+
+posixcc::file_replacer::~file_replacer()
+{
+    discard();
+}
+
+void
+posixcc::file_replacer::discard() noexcept
+{
+    // Unnamed files go away with their descriptors.
+    for (const file& f: files) {
+        if (!f.temp_name.empty()) {
+            unlinkat(directory_fd, f.temp_name.c_str(), 0);
+        }
+    }
+    files.clear();
+}
+
+posixcc::file_replacer&
+posixcc::file_replacer::set_durability(batch_durability d) noexcept
+{
+    durability = d;
+    return *this;
+}
+
+posixcc::file_replacer&
+posixcc::file_replacer::add(const std::string& name, const void* data,
+                            std::size_t length, mode_t mode)
+{
+    if (name.empty() || "." == name || ".." == name ||
+        std::string::npos != name.find('/')) {
+        throw std::runtime_error{errno_to_string(EINVAL)};
+    }
+
+    file f{name,
+           openat(directory_fd, ".", O_TMPFILE | O_WRONLY | O_CLOEXEC, mode),
+           {}};
+
+    // Without O_TMPFILE, a hidden file stands in, until it is renamed or
+    // discarded.
+    if (!f.fd) {
+        if (EOPNOTSUPP != errno && EISDIR != errno && EINVAL != errno) {
+            throw std::runtime_error{errno_to_string(errno)};
+        }
+        f.temp_name = temp_name(name);
+        f.fd = openat(directory_fd, f.temp_name.c_str(),
+                      O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, mode);
+        if (!f.fd) {
+            throw std::runtime_error{errno_to_string(errno)};
+        }
+    }
+
+    const char* p = static_cast<const char*>(data);
+    std::size_t done = 0;
+
+    while (done < length) {
+        const ssize_t l = write(f.fd, p + done, length - done);
+
+        if (-1 == l) {
+            if (EINTR == errno) {
+                continue;
+            }
+            const int e = errno;
+            if (!f.temp_name.empty()) {
+                unlinkat(directory_fd, f.temp_name.c_str(), 0);
+            }
+            throw std::runtime_error{errno_to_string(e)};
+        }
+        done += l;
+    }
+
+    files.push_back(std::move(f));
+    return *this;
+}
+
+void
+posixcc::file_replacer::commit()
+{
+    try {
+        // All of the new data is durable before any of it is linked in.
+        if (batch_durability::file_system == durability) {
+            if (!files.empty() && -1 == syncfs(directory_fd)) {
+                throw std::runtime_error{errno_to_string(errno)};
+            }
+        } else {
+            for (const file& f: files) {
+                if (-1 == fdatasync(f.fd)) {
+                    throw std::runtime_error{errno_to_string(errno)};
+                }
+            }
+        }
+
+        // An unnamed file can not be linked over an existing name; it gets
+        // a hidden one, through /proc, first.
+        for (file& f: files) {
+            if (f.temp_name.empty()) {
+                const std::string path = "/proc/self/fd/" +
+                    std::to_string(f.fd.get());
+                const std::string name = temp_name(f.name);
+
+                if (-1 == linkat(AT_FDCWD, path.c_str(), directory_fd,
+                                 name.c_str(), AT_SYMLINK_FOLLOW)) {
+                    throw std::runtime_error{errno_to_string(errno)};
+                }
+                f.temp_name = name;
+            }
+
+            if (-1 == renameat(directory_fd, f.temp_name.c_str(),
+                               directory_fd, f.name.c_str())) {
+                throw std::runtime_error{errno_to_string(errno)};
+            }
+            f.temp_name.clear();
+        }
+
+        // One flush of the directory covers every rename.
+        if (!files.empty() && -1 == fsync(directory_fd)) {
+            throw std::runtime_error{errno_to_string(errno)};
+        }
+    } catch (...) {
+        discard();
+        throw;
+    }
+
+    files.clear();
+}
+
+std::size_t
+posixcc::file_replacer::size() const noexcept
+{
+    return files.size();
+}
+
+#ifdef REPLACE_TEST
+#include <dirent.h>
+#include <set>
+#include <sys/stat.h>
+#include "stfu/stfu.hh"
+
+//
+// Creates an empty directory to replace files in, returning its path.
+//
+static std::string
+temp_directory()
+{
+    char path[] = "/var/tmp/posixcc-replace-XXXXXX";
+
+    STFU_ASSERT(nullptr != mkdtemp(path));
+    return path;
+}
+
+//
+// Returns the names in "directory", removing them too with "remove".
+//
+static std::set<std::string>
+entries(const std::string& directory, bool remove = false)
+{
+    std::set<std::string> names;
+    DIR* d = opendir(directory.c_str());
+
+    STFU_ASSERT(nullptr != d);
+    while (const struct dirent* e = readdir(d)) {
+        const std::string name = e->d_name;
+        if ("." != name && ".." != name) {
+            names.insert(name);
+            if (remove) {
+                unlink((directory + "/" + name).c_str());
+            }
+        }
+    }
+    closedir(d);
+
+    if (remove) {
+        rmdir(directory.c_str());
+    }
+    return names;
+}
+
+static std::string
+contents(const std::string& path)
+{
+    const posixcc::auto_fd fd{open(path.c_str(), O_RDONLY)};
+    std::string data;
+    char buffer[4096];
+    ssize_t l;
+
+    STFU_ASSERT(fd);
+    while (0 < (l = read(fd, buffer, sizeof(buffer)))) {
+        data.append(buffer, l);
+    }
+    return data;
+}
+
+static void
+replace_tests()
+{
+    const std::string directory = temp_directory();
+
+    for (const auto d: {posixcc::batch_durability::file_system,
+                        posixcc::batch_durability::each_file}) {
+        posixcc::file_replacer replacer{directory};
+
+        replacer.set_durability(d);
+        for (int i = 0; i < 50; ++i) {
+            const std::string data(i * 100, static_cast<char>('a' + i % 26));
+            replacer.add("file" + std::to_string(i), data.data(),
+                         data.size(), 0600);
+        }
+        STFU_ASSERT(50 == replacer.size());
+
+        // Nothing is visible before the commit.
+        STFU_ASSERT(entries(directory).size() ==
+                    (posixcc::batch_durability::file_system == d ? 0 : 50));
+
+        replacer.commit();
+        STFU_ASSERT(0 == replacer.size());
+    }
+
+    // The second batch replaced the first, leaving nothing else behind.
+    STFU_ASSERT(50 == entries(directory).size());
+    for (int i = 0; i < 50; ++i) {
+        const std::string path = directory + "/file" + std::to_string(i);
+        struct stat s;
+
+        STFU_ASSERT(std::string(i * 100, static_cast<char>('a' + i % 26)) ==
+                    contents(path));
+        STFU_ASSERT(0 == stat(path.c_str(), &s) &&
+                    0600 == (s.st_mode & 0777));
+    }
+
+    // An empty batch commits nothing.
+    posixcc::file_replacer{directory}.commit();
+
+    entries(directory, true);
+    STFU_PASS();
+}
+
+static void
+discard_tests()
+{
+    const std::string directory = temp_directory();
+    const std::string path = directory + "/state";
+    {
+        posixcc::file_replacer replacer{directory};
+        replacer.add("state", "old", 3).commit();
+    }
+
+    // A batch never committed leaves the old contents, and nothing else.
+    {
+        posixcc::file_replacer replacer{directory};
+        replacer.add("state", "new", 3);
+    }
+    STFU_ASSERT("old" == contents(path));
+    STFU_ASSERT(1 == entries(directory).size());
+
+    // Names outside the directory are refused, as is a missing directory.
+    std::size_t thrown = 0;
+    for (const char* name: {"", ".", "..", "sub/state"}) {
+        try {
+            posixcc::file_replacer{directory}.add(name, "x", 1);
+        } catch (const std::runtime_error&) {
+            ++thrown;
+        }
+    }
+    try {
+        posixcc::file_replacer{directory + "/missing"};
+    } catch (const std::runtime_error&) {
+        ++thrown;
+    }
+
+    entries(directory, true);
+    STFU_PASS_IFF(5 == thrown);
+}
+
+extern "C" std::size_t
+unit_tests()
+{
+    stfu::test_group group{"replace tests",
+        "Tests of atomic batches of file replacements."};
+    group.add_test(stfu::test{"replace",
+            replace_tests,
+            "Verify that a batch replaces every file, with either kind of "
+            "durability."})
+         .add_test(stfu::test{"discard",
+            discard_tests,
+            "Verify that an uncommitted batch leaves the old files, and "
+            "that bad names are refused."})
+         .set_timeout(std::chrono::seconds(60));
+
+    stfu::test_result_summary summary = group();
+    return summary.failed + summary.crashed + summary.timed_out +
+        summary.regressed;
+}
+#endif // REPLACE_TEST
+
+#ifdef REPLACE_BENCH
+#include "stfu/stfu.hh"
+
+static const std::size_t file_size = 1024;
+static const std::size_t batch_size = 100;
+
+//
+// Replaces "name" in "directory" the usual way: writes a temporary file,
+// syncs it, renames it over the old one and syncs the directory.
+//
+static void
+replace_one(int directory, const std::string& name, const std::string& data)
+{
+    const std::string temp = name + ".tmp";
+    const posixcc::auto_fd fd{openat(directory, temp.c_str(),
+                                     O_WRONLY | O_CREAT | O_TRUNC, 0644)};
+
+    STFU_ASSERT(static_cast<ssize_t>(data.size()) ==
+                write(fd, data.data(), data.size()));
+    fsync(fd);
+    renameat(directory, temp.c_str(), directory, name.c_str());
+    fsync(directory);
+}
+
+extern "C" std::size_t
+unit_tests()
+{
+    // Outside of any test, a failure can only be counted.
+    char path[] = "/var/tmp/posixcc-replace-XXXXXX";
+    if (nullptr == mkdtemp(path)) {
+        return 1;
+    }
+    const std::string directory = path;
+    const posixcc::auto_fd directory_fd{open(path, O_RDONLY | O_DIRECTORY)};
+    if (!directory_fd) {
+        rmdir(path);
+        return 1;
+    }
+    const std::string data(file_size, 'x');
+
+    // An operation replaces a whole batch of files.
+    stfu::benchmark one_by_one{"one by one", [&](std::size_t n) {
+            for (std::size_t i = 0; i < n * batch_size; ++i) {
+                replace_one(directory_fd,
+                            "file" + std::to_string(i % batch_size), data);
+            }
+        },
+        "Replace 100 files of 1 KiB, each synced, renamed and its "
+        "directory synced."
+    };
+    const auto batched = [&](posixcc::batch_durability d) {
+        return [&, d](std::size_t n) {
+            posixcc::file_replacer replacer{directory};
+
+            replacer.set_durability(d);
+            for (std::size_t i = 0; i < n; ++i) {
+                for (std::size_t f = 0; f < batch_size; ++f) {
+                    replacer.add("file" + std::to_string(f), data.data(),
+                                 data.size());
+                }
+                replacer.commit();
+            }
+        };
+    };
+    stfu::benchmark batch_syncfs{"batch, syncfs",
+        batched(posixcc::batch_durability::file_system),
+        "Replace 100 files of 1 KiB as a batch, made durable with syncfs()."
+    };
+    stfu::benchmark batch_each{"batch, fdatasync",
+        batched(posixcc::batch_durability::each_file),
+        "Replace 100 files of 1 KiB as a batch, made durable with an "
+        "fdatasync() of each."
+    };
+    for (auto* b: {&one_by_one, &batch_syncfs, &batch_each}) {
+        b->set_bytes_per_op(file_size * batch_size);
+    }
+
+    stfu::test_group group{"replace benchmarks",
+        "Batched against one-by-one atomic file replacement."};
+    group.add_test(one_by_one)
+         .add_test(batch_syncfs)
+         .add_test(batch_each)
+         .set_jobs(1);
+
+    stfu::test_result_summary summary = group();
+
+    for (std::size_t f = 0; f < batch_size; ++f) {
+        unlinkat(directory_fd, ("file" + std::to_string(f)).c_str(), 0);
+    }
+    rmdir(path);
+
+    return summary.failed + summary.crashed + summary.timed_out +
+        summary.regressed;
+}
+#endif // REPLACE_BENCH
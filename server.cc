@@ -0,0 +1,478 @@
+//
+// Copyright (c) 2025 Bryan Phillippe
+//
+// This software is free to use for any purpose, provided this copyright
+// notice is preserved.
+//
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+
+#include <unistd.h>
+#include <poll.h>
+#include <sched.h>
+#include <sys/socket.h>
+#include <linux/filter.h>
+
+#include <libposix.hh>
+
+//
+// Longest pause before accepting again, after running out of descriptors or
+// buffers.
+//
+static const std::chrono::milliseconds max_backoff{100};
+
+//
+// Ends a worker on an error it can not serve past, reporting the failed
+// call on the standard error; an exception would instead unwind into the
+// code which forked the worker.
+//
+[[noreturn]] static void
+fail(const char* call)
+{
+    const int e = errno;
+
+    std::fprintf(stderr, "posixcc::prefork_server: %s: %s\n", call,
+                 errno_to_string(e).c_str());
+    _exit(EXIT_FAILURE);
+}
+
+//
+// Serves connections on a listening socket until the worker is stopped. A
+// handler which throws only loses its connection, and a lack of resources
+// only delays accepting, so that the worker and its listener stay in the
+// group.
+//
+static void
+serve(const posixcc::stream_socket& listener,
+      const std::function<void(posixcc::stream_socket&)>& handler)
+{
+    struct pollfd p{listener.get(), POLLIN, 0};
+    std::chrono::milliseconds backoff{0};
+
+    for (;;) {
+        if (-1 == poll(&p, 1, -1) && EINTR != errno) {
+            fail("poll");
+        }
+
+        // Accept whatever is pending; with a shared listener, other workers
+        // woken for the same connection come away empty-handed. The errors
+        // are told apart by errno, so accept4() is called directly.
+        for (;;) {
+            const int s = accept4(listener.get(), nullptr, nullptr,
+                                  SOCK_CLOEXEC | SOCK_NONBLOCK);
+
+            if (-1 == s) {
+                if (EINTR == errno || ECONNABORTED == errno) {
+                    continue;
+                }
+                if (EAGAIN == errno || EWOULDBLOCK == errno) {
+                    break;
+                }
+                if (EMFILE != errno && ENFILE != errno &&
+                    ENOBUFS != errno && ENOMEM != errno) {
+                    fail("accept4");
+                }
+
+                // Pending connections stay queued until resources are
+                // freed, e.g. by connections being closed.
+                backoff = std::min(max_backoff, std::max(
+                    std::chrono::milliseconds{1}, 2 * backoff));
+                std::this_thread::sleep_for(backoff);
+                break;
+            }
+            backoff = std::chrono::milliseconds{0};
+
+            posixcc::stream_socket connection{posixcc::auto_fd{s}};
+
+            try {
+                handler(connection);
+            } catch (...) {
+                // The connection is closed, as after any handler.
+            }
+        }
+    }
+}
+
+//
+// Attaches a program to the SO_REUSEPORT group of "s" which selects the
+// socket by the processor handling the incoming connection.
+//
+static void
+attach_cpu_steering(posixcc::socket& s, std::size_t count)
+{
+    struct sock_filter code[] = {
+        {BPF_LD | BPF_W | BPF_ABS, 0, 0,
+            static_cast<__u32>(SKF_AD_OFF + SKF_AD_CPU)},
+        {BPF_ALU | BPF_MOD | BPF_K, 0, 0, static_cast<__u32>(count)},
+        {BPF_RET | BPF_A, 0, 0, 0},
+    };
+    struct sock_fprog program{sizeof(code) / sizeof(code[0]), code};
+
+    if (-1 == setsockopt(s.get(), SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF,
+                         &program, sizeof(program))) {
+        throw std::runtime_error{errno_to_string(errno)};
+    }
+}
+
+posixcc::prefork_server::prefork_server(const socket_address& a,
+                                        std::size_t workers):
+address{a},
+count{workers ? workers :
+      static_cast<std::size_t>(std::max(1L, sysconf(_SC_NPROCESSORS_ONLN)))}
+{
+}
+
+posixcc::prefork_server::~prefork_server()
+{
+    stop();
+    join();
+}
+
+posixcc::prefork_server&
+posixcc::prefork_server::set_reuseport(bool enabled) noexcept
+{
+    reuseport = enabled;
+    return *this;
+}
+
+posixcc::prefork_server&
+posixcc::prefork_server::set_cpu_steering(bool enabled) noexcept
+{
+    steering = enabled;
+    return *this;
+}
+
+void
+posixcc::prefork_server::start(
+    const std::function<void(stream_socket&)>& handler)
+{
+    stop();
+    join();
+    workers.clear();
+
+    // All listeners are bound up front, so that binding errors surface here
+    // and the group is complete before any connection arrives. Later ones
+    // bind to the port the first was given.
+    std::vector<tcp_socket> listeners;
+    for (std::size_t i = 0; i < (reuseport ? count : 1); ++i) {
+        tcp_socket s{address.get_family()};
+
+        s.set_option(SOL_SOCKET, SO_REUSEADDR, 1);
+        if (reuseport) {
+            s.set_option(SOL_SOCKET, SO_REUSEPORT, 1);
+        }
+        s.bind(address);
+        s.listen();
+
+        address = s.get_local_address();
+        listeners.push_back(std::move(s));
+    }
+
+    if (reuseport && steering) {
+        attach_cpu_steering(listeners[0], count);
+    }
+
+    const long cpus = std::max(1L, sysconf(_SC_NPROCESSORS_ONLN));
+
+    workers.resize(count);
+    for (std::size_t i = 0; i < count; ++i) {
+        const std::size_t own = reuseport ? i : 0;
+
+        workers[i].start([&, i, own] {
+            for (std::size_t j = 0; j < listeners.size(); ++j) {
+                if (j != own) {
+                    listeners[j].close();
+                }
+            }
+
+            if (steering) {
+                cpu_set_t set;
+                CPU_ZERO(&set);
+                CPU_SET(i % cpus, &set);
+                sched_setaffinity(0, sizeof(set), &set);
+            }
+
+            serve(listeners[own], handler);
+        });
+
+        // The worker now holds its own listener; should it exit, its socket
+        // leaves the group rather than queueing connections nobody accepts.
+        if (reuseport) {
+            listeners[i].close();
+        }
+    }
+}
+
+const posixcc::socket_address&
+posixcc::prefork_server::get_address() const noexcept
+{
+    return address;
+}
+
+const std::vector<posixcc::worker_process>&
+posixcc::prefork_server::get_workers() const noexcept
+{
+    return workers;
+}
+
+void
+posixcc::prefork_server::stop() const
+{
+    for (const auto& w: workers) {
+        w.stop();
+    }
+}
+
+void
+posixcc::prefork_server::join() const
+{
+    for (const auto& w: workers) {
+        w.join();
+    }
+}
+
+#ifdef SERVER_TEST
+#include <set>
+#include "stfu/stfu.hh"
+
+//
+// Connects to the server "n" times, returning the set of worker process IDs
+// that answered.
+//
+static std::set<pid_t>
+connect_to(const posixcc::prefork_server& server, std::size_t n)
+{
+    std::set<pid_t> answered;
+
+    for (std::size_t i = 0; i < n; ++i) {
+        posixcc::tcp_socket client{server.get_address().get_family()};
+        client.set_blocking(true);
+        client.connect(server.get_address());
+
+        pid_t pid;
+        STFU_ASSERT(sizeof(pid) == client.recv(&pid, sizeof(pid),
+                                               MSG_WAITALL));
+        answered.insert(pid);
+    }
+
+    return answered;
+}
+
+//
+// Answers every connection with the ID of the worker process.
+//
+static void
+answer(posixcc::stream_socket& connection)
+{
+    const pid_t pid = getpid();
+    connection.send(&pid, sizeof(pid));
+}
+
+static std::set<pid_t>
+worker_ids(const posixcc::prefork_server& server)
+{
+    std::set<pid_t> ids;
+
+    for (const auto& w: server.get_workers()) {
+        ids.insert(w.get_id());
+    }
+
+    return ids;
+}
+
+static void
+handler_error_tests()
+{
+    posixcc::prefork_server server{
+        posixcc::socket_address::inet("127.0.0.1", 0), 1};
+    bool failed = false;
+
+    // The worker's first connection fails; later ones are still served.
+    server.start([&failed](posixcc::stream_socket& connection) {
+        if (!failed) {
+            failed = true;
+            throw std::runtime_error{"handler failure"};
+        }
+        answer(connection);
+    });
+
+    posixcc::tcp_socket client{server.get_address().get_family()};
+    client.set_blocking(true);
+    client.connect(server.get_address());
+    char c;
+    STFU_ASSERT(0 == client.recv(&c, 1));
+
+    const auto answered = connect_to(server, 3);
+    STFU_PASS_IFF(1 == answered.size() &&
+                  worker_ids(server) == answered);
+}
+
+static void
+reuseport_tests()
+{
+    posixcc::prefork_server server{
+        posixcc::socket_address::inet("127.0.0.1", 0), 3};
+
+    server.start(answer);
+    STFU_ASSERT(0 != server.get_address().get_port());
+    STFU_ASSERT(3 == server.get_workers().size());
+
+    // Connections from distinct ports hash to more than one worker.
+    const auto answered = connect_to(server, 30);
+    const auto ids = worker_ids(server);
+    STFU_ASSERT(1 < answered.size());
+    for (const pid_t pid: answered) {
+        STFU_ASSERT(ids.count(pid));
+    }
+
+    // The port can not be bound by another, non-SO_REUSEPORT socket.
+    bool thrown = false;
+    try {
+        posixcc::tcp_socket::listen_on(server.get_address());
+    } catch (const std::runtime_error&) {
+        thrown = true;
+    }
+    STFU_ASSERT(thrown);
+
+    server.stop();
+    server.join();
+    STFU_PASS_IFF(!server.get_workers()[0].is_running());
+}
+
+static void
+shared_accept_tests()
+{
+    posixcc::prefork_server server{
+        posixcc::socket_address::inet("127.0.0.1", 0), 3};
+
+    server.set_reuseport(false)
+          .start(answer);
+
+    const auto answered = connect_to(server, 10);
+    const auto ids = worker_ids(server);
+    for (const pid_t pid: answered) {
+        STFU_ASSERT(ids.count(pid));
+    }
+    STFU_PASS();
+}
+
+static void
+steering_tests()
+{
+    posixcc::prefork_server server{
+        posixcc::socket_address::inet("127.0.0.1", 0)};
+
+    server.set_cpu_steering(true)
+          .start(answer);
+
+    const auto answered = connect_to(server, 10);
+    const auto ids = worker_ids(server);
+    STFU_ASSERT(!answered.empty());
+    for (const pid_t pid: answered) {
+        STFU_ASSERT(ids.count(pid));
+    }
+    STFU_PASS();
+}
+
+extern "C" std::size_t
+unit_tests()
+{
+    stfu::test_group group{"server tests",
+        "Tests of the prefork server."};
+    group.add_test(stfu::test{"reuseport",
+            reuseport_tests,
+            "Verify that connections are balanced among workers listening "
+            "with SO_REUSEPORT."})
+         .add_test(stfu::test{"shared accept",
+            shared_accept_tests,
+            "Verify that workers can share a single listening socket."})
+         .add_test(stfu::test{"handler error",
+            handler_error_tests,
+            "Verify that a worker keeps serving after its handler throws."})
+         .add_test(stfu::test{"cpu steering",
+            steering_tests,
+            "Verify that connections are served with a CPU steering "
+            "program attached."})
+         .set_timeout(std::chrono::seconds(30));
+
+    stfu::test_result_summary summary = group();
+    return summary.failed + summary.crashed + summary.timed_out +
+        summary.regressed;
+}
+#endif // SERVER_TEST
+
+#ifdef SERVER_BENCH
+#include <memory>
+#include "stfu/stfu.hh"
+
+//
+// Returns a server of 4 workers answering each connection with a single
+// byte, started on first use so that it outlives the benchmark iterations;
+// it is stopped when the benchmark process exits.
+//
+static const posixcc::prefork_server&
+server(bool reuseport)
+{
+    static std::unique_ptr<posixcc::prefork_server> servers[2];
+    auto& s = servers[reuseport];
+
+    if (!s) {
+        s.reset(new posixcc::prefork_server{
+            posixcc::socket_address::inet("127.0.0.1", 0), 4});
+        s->set_reuseport(reuseport)
+          .start([](posixcc::stream_socket& connection) {
+              connection.send("x", 1);
+          });
+    }
+
+    return *s;
+}
+
+//
+// Opens "n" connections to the server, one after another, waiting for each
+// to be answered.
+//
+static void
+connections(const posixcc::prefork_server& s, std::size_t n)
+{
+    for (std::size_t i = 0; i < n; ++i) {
+        posixcc::tcp_socket client;
+        client.set_blocking(true);
+        client.connect(s.get_address());
+
+        char c;
+        STFU_ASSERT(1 == client.recv(&c, 1));
+    }
+}
+
+extern "C" std::size_t
+unit_tests()
+{
+    stfu::benchmark reuseport{"reuseport", [](std::size_t n) {
+            connections(server(true), n);
+        },
+        "Connections per second to 4 workers, each listening on a socket of "
+        "its own with SO_REUSEPORT."
+    };
+    stfu::benchmark shared{"shared accept", [](std::size_t n) {
+            connections(server(false), n);
+        },
+        "Connections per second to 4 workers, all accepting on one shared "
+        "listening socket."
+    };
+
+    stfu::test_group group{"server benchmarks",
+        "Connection rate of the prefork server designs."};
+    group.add_test(reuseport)
+         .add_test(shared)
+         .set_jobs(1);
+
+    stfu::test_result_summary summary = group();
+    return summary.failed + summary.crashed + summary.timed_out +
+        summary.regressed;
+}
+#endif // SERVER_BENCH
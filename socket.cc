@@ -0,0 +1,834 @@
+//
+// Copyright (c) 2025 Bryan Phillippe
+//
+// This software is free to use for any purpose, provided this copyright
+// notice is preserved.
+//
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include <libposix.hh>
+
+//
+// Most datagrams handed to a single sendmmsg/recvmmsg call; larger batches
+// are split into several calls.
+//
+static const std::size_t batch_limit = 64;
+
+//
+// Translates the result of a transfer on a non-blocking socket: would-block
+// conditions yield -1, other errors throw.
+//
+static ssize_t
+transferred(ssize_t l)
+{
+    if (-1 == l && EAGAIN != errno && EWOULDBLOCK != errno) {
+        throw std::runtime_error{errno_to_string(errno)};
+    }
+
+    return l;
+}
+
+posixcc::socket_address::socket_address(const struct sockaddr* a,
+                                        socklen_t l) noexcept:
+length{std::min<socklen_t>(l, sizeof(storage))}
+{
+    memcpy(&storage, a, length);
+}
+
+posixcc::socket_address
+posixcc::socket_address::inet(const std::string& host, unsigned short port)
+{
+    socket_address a;
+    auto in = reinterpret_cast<struct sockaddr_in*>(&a.storage);
+    auto in6 = reinterpret_cast<struct sockaddr_in6*>(&a.storage);
+
+    if (1 == inet_pton(AF_INET, host.c_str(), &in->sin_addr)) {
+        in->sin_family = AF_INET;
+        in->sin_port = htons(port);
+        a.length = sizeof(*in);
+    } else if (1 == inet_pton(AF_INET6, host.c_str(), &in6->sin6_addr)) {
+        in6->sin6_family = AF_INET6;
+        in6->sin6_port = htons(port);
+        a.length = sizeof(*in6);
+    } else {
+        throw std::runtime_error{"invalid address: " + host};
+    }
+
+    return a;
+}
+
+posixcc::socket_address
+posixcc::socket_address::local(const std::string& path)
+{
+    socket_address a;
+    auto un = reinterpret_cast<struct sockaddr_un*>(&a.storage);
+
+    if (path.length() >= sizeof(un->sun_path)) {
+        throw std::runtime_error{"path too long: " + path};
+    }
+
+    un->sun_family = AF_UNIX;
+    memcpy(un->sun_path, path.data(), path.length());
+    a.length = offsetof(struct sockaddr_un, sun_path) + path.length() +
+               ((path.empty() || '\0' != path[0]) ? 1 : 0);
+
+    return a;
+}
+
+int
+posixcc::socket_address::get_family() const noexcept
+{
+    return length ? storage.ss_family : AF_UNSPEC;
+}
+
+unsigned short
+posixcc::socket_address::get_port() const noexcept
+{
+    switch (get_family()) {
+    case AF_INET:
+        return ntohs(reinterpret_cast<const struct sockaddr_in*>(
+            &storage)->sin_port);
+
+    case AF_INET6:
+        return ntohs(reinterpret_cast<const struct sockaddr_in6*>(
+            &storage)->sin6_port);
+
+    default:
+        return 0;
+    }
+}
+
+const struct sockaddr*
+posixcc::socket_address::get() const noexcept
+{
+    return reinterpret_cast<const struct sockaddr*>(&storage);
+}
+
+struct sockaddr*
+posixcc::socket_address::get() noexcept
+{
+    return reinterpret_cast<struct sockaddr*>(&storage);
+}
+
+socklen_t
+posixcc::socket_address::get_length() const noexcept
+{
+    return length;
+}
+
+socklen_t
+posixcc::socket_address::get_capacity() const noexcept
+{
+    return sizeof(storage);
+}
+
+void
+posixcc::socket_address::set_length(socklen_t l) noexcept
+{
+    length = std::min<socklen_t>(l, sizeof(storage));
+}
+
+posixcc::socket::socket(int domain, int type, int protocol):
+fd{::socket(domain, type | SOCK_CLOEXEC | SOCK_NONBLOCK, protocol)}
+{
+    if (!fd) {
+        throw std::runtime_error{errno_to_string(errno)};
+    }
+}
+
+posixcc::socket::socket(auto_fd&& f) noexcept:
+fd{std::move(f)}
+{
+}
+
+posixcc::socket::operator bool() const noexcept
+{
+    return static_cast<bool>(fd);
+}
+
+int
+posixcc::socket::get() const noexcept
+{
+    return fd.get();
+}
+
+posixcc::socket_address
+posixcc::socket::get_local_address() const
+{
+    socket_address a;
+    socklen_t l = a.get_capacity();
+
+    if (-1 == getsockname(fd, a.get(), &l)) {
+        throw std::runtime_error{errno_to_string(errno)};
+    }
+
+    a.set_length(l);
+    return a;
+}
+
+posixcc::socket_address
+posixcc::socket::get_peer_address() const
+{
+    socket_address a;
+    socklen_t l = a.get_capacity();
+
+    if (-1 == getpeername(fd, a.get(), &l)) {
+        throw std::runtime_error{errno_to_string(errno)};
+    }
+
+    a.set_length(l);
+    return a;
+}
+
+posixcc::socket&
+posixcc::socket::set_blocking(bool blocking)
+{
+    const int flags = fcntl(fd, F_GETFL);
+
+    if (-1 == flags || -1 == fcntl(fd, F_SETFL, blocking ?
+            (flags & ~O_NONBLOCK) : (flags | O_NONBLOCK))) {
+        throw std::runtime_error{errno_to_string(errno)};
+    }
+
+    return *this;
+}
+
+posixcc::socket&
+posixcc::socket::set_option(int level, int name, int value)
+{
+    if (-1 == setsockopt(fd, level, name, &value, sizeof(value))) {
+        throw std::runtime_error{errno_to_string(errno)};
+    }
+
+    return *this;
+}
+
+int
+posixcc::socket::get_option(int level, int name) const
+{
+    int value = 0;
+    socklen_t l = sizeof(value);
+
+    if (-1 == getsockopt(fd, level, name, &value, &l)) {
+        throw std::runtime_error{errno_to_string(errno)};
+    }
+
+    return value;
+}
+
+posixcc::socket&
+posixcc::socket::bind(const socket_address& a)
+{
+    if (-1 == ::bind(fd, a.get(), a.get_length())) {
+        throw std::runtime_error{errno_to_string(errno)};
+    }
+
+    return *this;
+}
+
+bool
+posixcc::socket::connect(const socket_address& a)
+{
+    while (-1 == ::connect(fd, a.get(), a.get_length())) {
+        if (EINPROGRESS == errno || EAGAIN == errno) {
+            return false;
+        } else if (EINTR != errno) {
+            throw std::runtime_error{errno_to_string(errno)};
+        }
+    }
+
+    return true;
+}
+
+int
+posixcc::socket::get_error() const
+{
+    return get_option(SOL_SOCKET, SO_ERROR);
+}
+
+posixcc::auto_fd
+posixcc::socket::release() noexcept
+{
+    return auto_fd{fd.release()};
+}
+
+void
+posixcc::socket::close() noexcept
+{
+    fd.close();
+}
+
+posixcc::stream_socket&
+posixcc::stream_socket::listen(int backlog)
+{
+    if (-1 == ::listen(fd, backlog)) {
+        throw std::runtime_error{errno_to_string(errno)};
+    }
+
+    return *this;
+}
+
+posixcc::stream_socket
+posixcc::stream_socket::accept(socket_address* peer) const
+{
+    socket_address a;
+    socklen_t l = a.get_capacity();
+    int s;
+
+    while (-1 == (s = accept4(fd, a.get(), &l,
+                              SOCK_CLOEXEC | SOCK_NONBLOCK))) {
+        if (EAGAIN == errno || EWOULDBLOCK == errno) {
+            return stream_socket{auto_fd{}};
+        } else if (EINTR != errno && ECONNABORTED != errno) {
+            throw std::runtime_error{errno_to_string(errno)};
+        }
+    }
+
+    if (peer) {
+        a.set_length(l);
+        *peer = a;
+    }
+
+    return stream_socket{auto_fd{s}};
+}
+
+ssize_t
+posixcc::stream_socket::send(const void* data, std::size_t length,
+                             int flags) const
+{
+    ssize_t l;
+
+    do {
+        l = ::send(fd, data, length, flags | MSG_NOSIGNAL);
+    } while (-1 == l && EINTR == errno);
+
+    return transferred(l);
+}
+
+ssize_t
+posixcc::stream_socket::recv(void* data, std::size_t length, int flags) const
+{
+    ssize_t l;
+
+    do {
+        l = ::recv(fd, data, length, flags);
+    } while (-1 == l && EINTR == errno);
+
+    return transferred(l);
+}
+
+posixcc::stream_socket&
+posixcc::stream_socket::shutdown(int how)
+{
+    if (-1 == ::shutdown(fd, how)) {
+        throw std::runtime_error{errno_to_string(errno)};
+    }
+
+    return *this;
+}
+
+ssize_t
+posixcc::datagram_socket::send_to(const void* data, std::size_t length,
+                                  const socket_address& to, int flags) const
+{
+    ssize_t l;
+
+    do {
+        l = ::sendto(fd, data, length, flags | MSG_NOSIGNAL,
+                     to.get_length() ? to.get() : nullptr, to.get_length());
+    } while (-1 == l && EINTR == errno);
+
+    return transferred(l);
+}
+
+ssize_t
+posixcc::datagram_socket::recv_from(void* data, std::size_t length,
+                                    socket_address* from, int flags) const
+{
+    socket_address a;
+    socklen_t l = a.get_capacity();
+    ssize_t r;
+
+    do {
+        r = ::recvfrom(fd, data, length, flags, a.get(), &l);
+    } while (-1 == r && EINTR == errno);
+
+    if (from && -1 != r) {
+        a.set_length(l);
+        *from = a;
+    }
+
+    return transferred(r);
+}
+
+std::size_t
+posixcc::datagram_socket::send_batch(datagram* messages, std::size_t count,
+                                     int flags) const
+{
+    struct mmsghdr headers[batch_limit];
+    struct iovec vectors[batch_limit];
+    std::size_t done = 0;
+
+    while (done < count) {
+        const std::size_t n = std::min(count - done, batch_limit);
+
+        for (std::size_t i = 0; i < n; ++i) {
+            datagram& m = messages[done + i];
+
+            vectors[i] = {m.data, m.size};
+            headers[i] = {};
+            headers[i].msg_hdr.msg_iov = &vectors[i];
+            headers[i].msg_hdr.msg_iovlen = 1;
+            if (m.address.get_length()) {
+                headers[i].msg_hdr.msg_name = m.address.get();
+                headers[i].msg_hdr.msg_namelen = m.address.get_length();
+            }
+        }
+
+        int r;
+        do {
+            r = sendmmsg(fd, headers, n, flags | MSG_NOSIGNAL);
+        } while (-1 == r && EINTR == errno);
+
+        // Datagrams already sent are reported first; an error which
+        // persists surfaces on the next call.
+        if (-1 == r && done) {
+            break;
+        }
+        if (-1 == transferred(r)) {
+            break;
+        }
+
+        for (int i = 0; i < r; ++i) {
+            messages[done + i].length = headers[i].msg_len;
+        }
+
+        done += r;
+        if (static_cast<std::size_t>(r) < n) {
+            break;
+        }
+    }
+
+    return done;
+}
+
+std::size_t
+posixcc::datagram_socket::recv_batch(datagram* messages, std::size_t count,
+                                     int flags) const
+{
+    struct mmsghdr headers[batch_limit];
+    struct iovec vectors[batch_limit];
+    std::size_t done = 0;
+
+    while (done < count) {
+        const std::size_t n = std::min(count - done, batch_limit);
+
+        for (std::size_t i = 0; i < n; ++i) {
+            datagram& m = messages[done + i];
+
+            vectors[i] = {m.data, m.size};
+            headers[i] = {};
+            headers[i].msg_hdr.msg_iov = &vectors[i];
+            headers[i].msg_hdr.msg_iovlen = 1;
+            headers[i].msg_hdr.msg_name = m.address.get();
+            headers[i].msg_hdr.msg_namelen = m.address.get_capacity();
+        }
+
+        // Only wait (on a blocking socket) for the first datagram.
+        int r;
+        do {
+            r = recvmmsg(fd, headers, n,
+                         flags | (done ? MSG_DONTWAIT : 0), nullptr);
+        } while (-1 == r && EINTR == errno);
+
+        if (-1 == r && done) {
+            break;
+        }
+        if (-1 == transferred(r)) {
+            break;
+        }
+
+        for (int i = 0; i < r; ++i) {
+            datagram& m = messages[done + i];
+
+            m.length = headers[i].msg_len;
+            m.address.set_length(headers[i].msg_hdr.msg_namelen);
+            m.truncated = (0 != (headers[i].msg_hdr.msg_flags & MSG_TRUNC));
+        }
+
+        done += r;
+        if (static_cast<std::size_t>(r) < n) {
+            break;
+        }
+    }
+
+    return done;
+}
+
+posixcc::tcp_socket::tcp_socket(int family):
+stream_socket{family, SOCK_STREAM, IPPROTO_TCP}
+{
+}
+
+posixcc::tcp_socket
+posixcc::tcp_socket::listen_on(const socket_address& a, int backlog)
+{
+    tcp_socket s{a.get_family()};
+
+    s.set_option(SOL_SOCKET, SO_REUSEADDR, 1);
+    s.bind(a);
+    s.listen(backlog);
+
+    return s;
+}
+
+posixcc::tcp_socket&
+posixcc::tcp_socket::set_nodelay(bool enabled)
+{
+    set_option(IPPROTO_TCP, TCP_NODELAY, enabled ? 1 : 0);
+    return *this;
+}
+
+posixcc::udp_socket::udp_socket(int family):
+datagram_socket{family, SOCK_DGRAM, IPPROTO_UDP}
+{
+}
+
+posixcc::unix_stream_socket::unix_stream_socket():
+stream_socket{AF_UNIX, SOCK_STREAM}
+{
+}
+
+posixcc::unix_stream_socket::unix_stream_socket(auto_fd&& f) noexcept:
+stream_socket{std::move(f)}
+{
+}
+
+std::pair<posixcc::unix_stream_socket, posixcc::unix_stream_socket>
+posixcc::unix_stream_socket::pair()
+{
+    int fds[2];
+
+    if (-1 == socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK,
+                         0, fds)) {
+        throw std::runtime_error{errno_to_string(errno)};
+    }
+
+    return std::make_pair(unix_stream_socket{auto_fd{fds[0]}},
+                          unix_stream_socket{auto_fd{fds[1]}});
+}
+
+posixcc::unix_datagram_socket::unix_datagram_socket():
+datagram_socket{AF_UNIX, SOCK_DGRAM}
+{
+}
+
+posixcc::unix_datagram_socket::unix_datagram_socket(auto_fd&& f) noexcept:
+datagram_socket{std::move(f)}
+{
+}
+
+std::pair<posixcc::unix_datagram_socket, posixcc::unix_datagram_socket>
+posixcc::unix_datagram_socket::pair()
+{
+    int fds[2];
+
+    if (-1 == socketpair(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK,
+                         0, fds)) {
+        throw std::runtime_error{errno_to_string(errno)};
+    }
+
+    return std::make_pair(unix_datagram_socket{auto_fd{fds[0]}},
+                          unix_datagram_socket{auto_fd{fds[1]}});
+}
+
+#ifdef SOCKET_TEST
+#include <vector>
+#include <poll.h>
+#include "stfu/stfu.hh"
+
+//
+// Waits for a non-blocking socket to become ready.
+//
+static bool
+wait_for(const posixcc::socket& s, short events)
+{
+    struct pollfd p{s.get(), events, 0};
+    return 1 == poll(&p, 1, 1000);
+}
+
+static void
+address_tests()
+{
+    const auto v4 = posixcc::socket_address::inet("127.0.0.1", 8080);
+    STFU_ASSERT(AF_INET == v4.get_family());
+    STFU_ASSERT(8080 == v4.get_port());
+
+    const auto v6 = posixcc::socket_address::inet("::1", 443);
+    STFU_ASSERT(AF_INET6 == v6.get_family());
+    STFU_ASSERT(443 == v6.get_port());
+
+    const auto local = posixcc::socket_address::local("/tmp/socket");
+    STFU_ASSERT(AF_UNIX == local.get_family());
+    STFU_ASSERT(0 == local.get_port());
+
+    STFU_ASSERT(AF_UNSPEC == posixcc::socket_address{}.get_family());
+
+    bool thrown = false;
+    try {
+        posixcc::socket_address::inet("not an address", 0);
+    } catch (const std::runtime_error&) {
+        thrown = true;
+    }
+    STFU_PASS_IFF(thrown);
+}
+
+static void
+stream_tests()
+{
+    char buffer[16] = {'\0'};
+
+    // TCP over loopback, on an ephemeral port.
+    auto listener = posixcc::tcp_socket::listen_on(
+        posixcc::socket_address::inet("127.0.0.1", 0));
+    const auto bound = listener.get_local_address();
+    STFU_ASSERT(0 != bound.get_port());
+    STFU_ASSERT(O_NONBLOCK & fcntl(listener.get(), F_GETFL));
+    STFU_ASSERT(FD_CLOEXEC & fcntl(listener.get(), F_GETFD));
+
+    // Nothing pending yet.
+    STFU_ASSERT(!listener.accept());
+
+    posixcc::tcp_socket client;
+    client.set_nodelay(true);
+    if (!client.connect(bound)) {
+        STFU_ASSERT(wait_for(client, POLLOUT));
+        STFU_ASSERT(0 == client.get_error());
+    }
+
+    STFU_ASSERT(wait_for(listener, POLLIN));
+    posixcc::socket_address peer;
+    auto server = listener.accept(&peer);
+    STFU_ASSERT(server);
+    STFU_ASSERT(client.get_local_address().get_port() == peer.get_port());
+    STFU_ASSERT(O_NONBLOCK & fcntl(server.get(), F_GETFL));
+    STFU_ASSERT(FD_CLOEXEC & fcntl(server.get(), F_GETFD));
+
+    STFU_ASSERT(-1 == server.recv(buffer, sizeof(buffer)));
+    STFU_ASSERT(5 == client.send("hello", 5));
+    STFU_ASSERT(wait_for(server, POLLIN));
+    STFU_ASSERT(5 == server.recv(buffer, sizeof(buffer)));
+    STFU_ASSERT(0 == memcmp(buffer, "hello", 5));
+
+    // Half-close: the server sees EOF, but can still reply.
+    client.shutdown(SHUT_WR);
+    STFU_ASSERT(wait_for(server, POLLIN));
+    STFU_ASSERT(0 == server.recv(buffer, sizeof(buffer)));
+    STFU_ASSERT(3 == server.send("bye", 3));
+    STFU_ASSERT(wait_for(client, POLLIN));
+    STFU_ASSERT(3 == client.recv(buffer, sizeof(buffer)));
+
+    // A connected UNIX stream pair, set to blocking.
+    auto pair = posixcc::unix_stream_socket::pair();
+    pair.first.set_blocking(true);
+    STFU_ASSERT(!(O_NONBLOCK & fcntl(pair.first.get(), F_GETFL)));
+    STFU_ASSERT(2 == pair.second.send("ok", 2));
+    STFU_ASSERT(2 == pair.first.recv(buffer, sizeof(buffer)));
+
+    // Release hands over the descriptor.
+    const int fd = pair.first.get();
+    posixcc::auto_fd released{pair.first.release()};
+    STFU_ASSERT(!pair.first);
+    STFU_PASS_IFF(fd == released.get());
+}
+
+static void
+datagram_tests()
+{
+    static const std::size_t count = 100;
+
+    posixcc::udp_socket receiver;
+    receiver.bind(posixcc::socket_address::inet("127.0.0.1", 0));
+    const auto to = receiver.get_local_address();
+
+    posixcc::udp_socket sender;
+    sender.bind(posixcc::socket_address::inet("127.0.0.1", 0));
+
+    // Single datagrams.
+    char buffer[64];
+    posixcc::socket_address from;
+    STFU_ASSERT(-1 == receiver.recv_from(buffer, sizeof(buffer)));
+    STFU_ASSERT(4 == sender.send_to("ping", 4, to));
+    STFU_ASSERT(wait_for(receiver, POLLIN));
+    STFU_ASSERT(4 == receiver.recv_from(buffer, sizeof(buffer), &from));
+    STFU_ASSERT(sender.get_local_address().get_port() == from.get_port());
+
+    // More datagrams than fit in a single sendmmsg/recvmmsg call.
+    std::vector<std::size_t> payload(count);
+    std::vector<posixcc::datagram> out(count), in(count);
+    std::vector<std::size_t> received(count, 0);
+
+    for (std::size_t i = 0; i < count; ++i) {
+        payload[i] = i;
+        out[i].data = &payload[i];
+        out[i].size = sizeof(payload[i]);
+        out[i].address = to;
+        in[i].data = &received[i];
+        in[i].size = sizeof(received[i]);
+    }
+
+    STFU_ASSERT(count == sender.send_batch(out.data(), count));
+    STFU_ASSERT(sizeof(std::size_t) == out[count - 1].length);
+
+    std::size_t n = 0;
+    while (n < count && wait_for(receiver, POLLIN)) {
+        n += receiver.recv_batch(&in[n], count - n);
+    }
+    STFU_ASSERT(count == n);
+    STFU_ASSERT(0 == receiver.recv_batch(in.data(), 1));
+
+    for (std::size_t i = 0; i < count; ++i) {
+        STFU_ASSERT(i == received[i]);
+        STFU_ASSERT(sizeof(std::size_t) == in[i].length);
+        STFU_ASSERT(!in[i].truncated);
+        STFU_ASSERT(sender.get_local_address().get_port() ==
+            in[i].address.get_port());
+    }
+
+    // A datagram which can not be sent, past the first sendmmsg() call:
+    // those before it are reported sent, and it fails on its own.
+    std::vector<char> oversized(1 << 17);
+    out.resize(batch_limit + 1);
+    out[batch_limit].data = oversized.data();
+    out[batch_limit].size = oversized.size();
+    STFU_ASSERT(batch_limit == sender.send_batch(out.data(), out.size()));
+
+    bool thrown = false;
+    try {
+        sender.send_batch(&out[batch_limit], 1);
+    } catch (const std::runtime_error&) {
+        thrown = true;
+    }
+    STFU_ASSERT(thrown);
+
+    // A truncated datagram on a UNIX datagram pair.
+    auto pair = posixcc::unix_datagram_socket::pair();
+    char small[2];
+    posixcc::datagram d;
+    d.data = small;
+    d.size = sizeof(small);
+    STFU_ASSERT(4 == pair.first.send_to("long", 4, posixcc::socket_address{}));
+    STFU_ASSERT(1 == pair.second.recv_batch(&d, 1));
+    STFU_PASS_IFF(d.truncated && 2 == d.length);
+}
+
+extern "C" std::size_t
+unit_tests()
+{
+    stfu::test_group group{"socket tests",
+        "Tests of socket functionality."};
+    group.add_test(stfu::test{"socket_address",
+            address_tests,
+            "Tests of socket address construction and inspection."})
+         .add_test(stfu::test{"stream sockets",
+            stream_tests,
+            "Tests of TCP and UNIX stream sockets: listening, accepting, "
+            "transferring and shutting down."})
+         .add_test(stfu::test{"datagram sockets",
+            datagram_tests,
+            "Tests of UDP and UNIX datagram sockets, single and batched."});
+
+    stfu::test_result_summary summary = group();
+    return summary.failed + summary.crashed + summary.timed_out +
+        summary.regressed;
+}
+#endif // SOCKET_TEST
+
+#ifdef SOCKET_BENCH
+#include <vector>
+#include "stfu/stfu.hh"
+
+//
+// Sends and receives "n" datagrams of "size" bytes over loopback UDP,
+// "batch" at a time, either with one system call per datagram (batch 1) or
+// with sendmmsg/recvmmsg.
+//
+static void
+loopback(std::size_t n, std::size_t size, std::size_t batch)
+{
+    posixcc::udp_socket receiver;
+    receiver.bind(posixcc::socket_address::inet("127.0.0.1", 0));
+    receiver.set_blocking(true);
+
+    posixcc::udp_socket sender;
+    sender.connect(receiver.get_local_address());
+    sender.set_blocking(true);
+
+    std::vector<char> buffer(size * batch, 'x');
+    std::vector<posixcc::datagram> out(batch), in(batch);
+    for (std::size_t i = 0; i < batch; ++i) {
+        out[i].data = in[i].data = &buffer[i * size];
+        out[i].size = in[i].size = size;
+    }
+
+    for (std::size_t done = 0; done < n; ) {
+        const std::size_t k = std::min(batch, n - done);
+
+        if (1 == batch) {
+            STFU_ASSERT(static_cast<ssize_t>(size) ==
+                sender.send_to(buffer.data(), size, posixcc::socket_address{}));
+            STFU_ASSERT(static_cast<ssize_t>(size) ==
+                receiver.recv_from(buffer.data(), size));
+        } else {
+            STFU_ASSERT(k == sender.send_batch(out.data(), k));
+            for (std::size_t r = 0; r < k; ) {
+                r += receiver.recv_batch(&in[r], k - r);
+            }
+        }
+
+        done += k;
+    }
+}
+
+extern "C" std::size_t
+unit_tests()
+{
+    static const std::size_t size = 64;
+
+    stfu::benchmark single{"single", [](std::size_t n) {
+            loopback(n, size, 1);
+        },
+        "Send and receive 64-byte datagrams over loopback UDP, with a "
+        "sendto() and a recvfrom() per datagram."
+    };
+    stfu::benchmark batched{"batched", [](std::size_t n) {
+            loopback(n, size, 32);
+        },
+        "Send and receive 64-byte datagrams over loopback UDP, 32 at a time "
+        "with sendmmsg() and recvmmsg()."
+    };
+    single.set_bytes_per_op(size);
+    batched.set_bytes_per_op(size);
+
+    stfu::test_group group{"socket benchmarks",
+        "Datagrams per second over loopback, single versus batched."};
+    group.add_test(single)
+         .add_test(batched)
+         .set_jobs(1);
+
+    stfu::test_result_summary summary = group();
+    return summary.failed + summary.crashed + summary.timed_out +
+        summary.regressed;
+}
+#endif // SOCKET_BENCH
@@ -9,18 +9,38 @@
 
 #include <iostream>
 #include <iomanip>
+#include <fstream>
+#include <sstream>
 #include <streambuf>
 #include <string>
 #include <functional>
 #include <chrono>
+#include <memory>
 #include <utility>
 #include <vector>
+#include <map>
+#include <algorithm>
+#include <cmath>
 #include <stdexcept>
 
 #include <unistd.h>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
 #include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/resource.h>
 #include <sys/wait.h>
 
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#endif
+
 #define STFU_VERSION    "1.0.0"
 
 //
@@ -65,7 +85,86 @@ namespace stfu {
         SKIPPED,
         PASS,
         FAIL,
-        CRASH
+        CRASH,
+        TIMEOUT
+    };
+
+    //
+    // Where a test routine runs: in a subprocess of its own, which isolates
+    // it from the rest of the tests and detects crashes, or directly in the
+    // process running the tests, which saves a pipe() and a fork() per test.
+    // DEFAULT defers to the test group, whose own default is FORKED.
+    //
+
+    enum class isolation {
+        DEFAULT,
+        FORKED,
+        IN_PROCESS
+    };
+
+    //
+    // Outcome of comparing a benchmark against its baseline.
+    //
+
+    enum class baseline_result {
+        NONE,
+        SAME,
+        REGRESSED,
+        IMPROVED
+    };
+
+    //
+    // Statistics of a benchmark run. Each sample is the mean time, in
+    // seconds, of one operation over "iterations" consecutive operations.
+    //
+
+    struct benchmark_stats {
+        std::size_t iterations{0};
+        std::vector<double> samples{};
+        double min{0};
+        double median{0};
+        double mean{0};
+        double p99{0};
+        double stddev{0};
+        double ops_per_second{0};
+
+        // Throughput, if the benchmark declared the bytes per operation.
+        std::size_t bytes_per_op{0};
+        double bytes_per_second{0};
+
+        // Relative change of the median against the baseline, and the
+        // two-sided p-value of a Mann-Whitney U test on the samples.
+        baseline_result baseline{baseline_result::NONE};
+        double change{0};
+        double p_value{1};
+    };
+
+    //
+    // Resources consumed by the test routine, as reported when reaping it.
+    // The maximum resident set size is in kilobytes.
+    //
+
+    struct resource_usage {
+        std::chrono::duration<double> user_time{};
+        std::chrono::duration<double> system_time{};
+        long max_rss{0};
+        long minor_faults{0};
+        long major_faults{0};
+        long voluntary_switches{0};
+        long involuntary_switches{0};
+    };
+
+    //
+    // Hardware performance counters of the test routine, if they were
+    // requested. Counters which are not available read as -1.
+    //
+
+    struct perf_counters {
+        bool enabled{false};
+        long long cycles{-1};
+        long long instructions{-1};
+        long long branch_misses{-1};
+        long long cache_misses{-1};
     };
 
     //
@@ -76,6 +175,9 @@ namespace stfu {
         test_result result{test_result::DIDNT_RUN};
         std::string message{};
         std::chrono::duration<double> runtime{};
+        resource_usage usage{};
+        perf_counters counters{};
+        benchmark_stats benchmark{};
     };
 
     //
@@ -88,6 +190,9 @@ namespace stfu {
         std::size_t passed{0};
         std::size_t failed{0};
         std::size_t crashed{0};
+        std::size_t timed_out{0};
+        std::size_t regressed{0};
+        std::size_t improved{0};
     };
 
     //
@@ -110,10 +215,34 @@ namespace stfu {
 
         test& set_enable(bool) noexcept;
 
+        //
+        // Limits the wall-clock time the test routine may run for; a test
+        // exceeding it has its process group killed, and yields a TIMEOUT
+        // result. A zero timeout (the default) defers to the test group's.
+        //
+        test& set_timeout(std::chrono::duration<double>) noexcept;
+
+        //
+        // Enables sampling hardware performance counters (cycles,
+        // instructions, branch and cache misses) around the test routine.
+        //
+        test& set_perf_counters(bool) noexcept;
+
+        //
+        // Selects whether the test routine runs in a subprocess. An
+        // IN_PROCESS routine which crashes takes the caller down with it,
+        // and its timeout is not enforced.
+        //
+        test& set_isolation(isolation) noexcept;
+
         test_result_data operator()() const;
 
         protected:
 
+        friend class test_group;
+
+        using deadline_clock = std::chrono::steady_clock;
+
         test_routine fn;
 
         mutable int filedes[2] = { -1, -1 };
@@ -122,14 +251,99 @@ namespace stfu {
             write_end = 1
         };
 
+        //
+        // State of an in-flight execution of the test routine.
+        //
+        mutable pid_t child{-1};
+        mutable int pidfd{-1};
+        mutable bool eof{false};
+        mutable std::string received;
+        mutable std::chrono::high_resolution_clock::time_point started;
+        mutable std::chrono::duration<double> limit{};
+        mutable deadline_clock::time_point deadline{};
+
         std::string name;
         std::string description;
         bool enabled = true;
+        bool perf = false;
+        isolation isolated = isolation::DEFAULT;
+        std::chrono::duration<double> timeout{};
 
         void write_result(test_result) const noexcept;
         void write_result(test_result, const std::string&) const noexcept;
+        void write_result(test_result, const std::string&,
+                          const std::string&) const noexcept;
         test_result_data read_result() const noexcept;
         void close_handle(pipe_end) const noexcept;
+
+        //
+        // Asynchronous execution: launch() forks the test routine, and
+        // reap() collects its result once the child has exited or its
+        // timeout (else the given default) has expired. await() blocks until
+        // at least one of the running tests may be reaped.
+        //
+        bool launch(std::chrono::duration<double> = {},
+                    bool = false) const noexcept;
+        bool reap(test_result_data&) const noexcept;
+        void drain() const noexcept;
+        static void await(const std::vector<const test*>&) noexcept;
+
+        //
+        // Synchronous execution of the test routine in the calling process.
+        //
+        test_result_data run_in_process(bool = false) const;
+    };
+
+    //
+    // A test which measures the performance of a routine rather than its
+    // correctness. The routine is given a number of operations to perform;
+    // that count is scaled up until a sample takes at least the minimum
+    // sample time, so that even nanosecond-scale operations can be timed.
+    //
+    // After a warmup period, samples are taken until the configured number
+    // have been collected, or the time budget is spent. The benchmark passes
+    // if the routine completes; it may still fail via STFU_ASSERT() or
+    // STFU_FAIL(), but should not call STFU_PASS().
+    //
+
+    class benchmark: public test {
+        public:
+
+        using benchmark_routine = std::function<void(std::size_t)>;
+
+        benchmark(const char* name,
+                  benchmark_routine routine,
+                  const char* description = "");
+
+        benchmark& set_warmup(std::chrono::duration<double>) noexcept;
+        benchmark& set_samples(std::size_t) noexcept;
+        benchmark& set_time_budget(std::chrono::duration<double>) noexcept;
+        benchmark& set_min_sample_time(std::chrono::duration<double>)
+            noexcept;
+
+        //
+        // Declares the number of bytes each operation processes, so that
+        // the throughput is reported as well.
+        //
+        benchmark& set_bytes_per_op(std::size_t) noexcept;
+
+        protected:
+
+        //
+        // Settings are shared with the test routine, which keeps them
+        // available to copies of the benchmark held as a plain test.
+        //
+        struct settings {
+            std::chrono::duration<double> warmup{0.1};
+            std::size_t samples{100};
+            std::chrono::duration<double> time_budget{1.0};
+            std::chrono::duration<double> min_sample_time{0.001};
+            std::size_t bytes_per_op{0};
+        };
+
+        std::shared_ptr<settings> config;
+
+        static void run(const benchmark_routine&, const settings&);
     };
 
     //
@@ -141,10 +355,68 @@ namespace stfu {
 
         using fixture = std::function<bool()>;
 
+        //
+        // Groups take the defaults below from the environment, unless they
+        // are built inside a test routine, where they would otherwise pick
+        // up the settings meant for the suite running that test.
+        //
         explicit test_group(const char* name,
                             const char* description = "") noexcept;
 
         test_group& set_verbose(bool) noexcept;
+
+        //
+        // Sets the maximum number of tests run concurrently. A value of 0
+        // selects the number of online processors. The default is taken
+        // from the STFU_JOBS environment variable, or 1 if it is not set.
+        //
+        test_group& set_jobs(std::size_t) noexcept;
+
+        //
+        // Sets the timeout of tests in the group which have none of their
+        // own. A zero timeout (the default) leaves them unbounded.
+        //
+        test_group& set_timeout(std::chrono::duration<double>) noexcept;
+
+        //
+        // Enables hardware performance counters for all tests in the group.
+        //
+        test_group& set_perf_counters(bool) noexcept;
+
+        //
+        // Sets where tests in the group run, unless they specify otherwise.
+        //
+        test_group& set_isolation(isolation) noexcept;
+
+        //
+        // Appends the samples of every benchmark in the group to a record
+        // file, which may later serve as a baseline. The default is taken
+        // from the STFU_RECORD environment variable.
+        //
+        test_group& set_record_file(const std::string&);
+
+        //
+        // Compares every benchmark in the group against its samples in a
+        // baseline (record) file. A benchmark whose median time changed by
+        // more than the threshold (default 0.05, i.e. 5%), with a
+        // statistically significant difference in its samples, is reported
+        // as regressed or improved. Defaults are taken from the STFU_BASELINE
+        // and STFU_THRESHOLD environment variables.
+        //
+        test_group& set_baseline_file(const std::string&);
+        test_group& set_regression_threshold(double) noexcept;
+
+        //
+        // Runs only the tests of shard "index" (counting from 0) out of
+        // "count" shards, so that a suite may be split across processes or
+        // hosts. Tests are partitioned by a hash of their names, or, given
+        // a record file with their runtimes, balanced by duration. Defaults
+        // are taken from the STFU_SHARD_INDEX, STFU_SHARD_COUNT and
+        // STFU_SHARD_RUNTIMES environment variables.
+        //
+        test_group& set_shard(std::size_t index, std::size_t count) noexcept;
+        test_group& set_shard_runtimes(const std::string&);
+
         test_group& add_test(const test&);
 
         test_group& add_before_all(const fixture&);
@@ -166,6 +438,16 @@ namespace stfu {
         std::string name;
         std::string description;
         bool verbose = true;
+        std::size_t jobs = 1;
+        bool perf = false;
+        isolation isolated = isolation::FORKED;
+        std::chrono::duration<double> timeout{};
+        std::string record_file;
+        std::string baseline_file;
+        double threshold = 0.05;
+        std::size_t shard_index = 0;
+        std::size_t shard_count = 1;
+        std::string shard_runtimes;
     };
 }
 
@@ -179,7 +461,18 @@ namespace stfu_private {
     // course of the test routine).
     //
 
-    class pass {};
+    class pass {
+        public:
+
+        pass() = default;
+        explicit pass(std::string) noexcept;
+
+        const std::string& get_data() const noexcept;
+
+        protected:
+
+        std::string data;
+    };
 
     //
     // The base type for all failure results. Can not be instantiated
@@ -231,6 +524,100 @@ namespace stfu_private {
         explicit fixture_exception(const char *);
     };
 
+    //
+    // Compute the statistics of a set of benchmark samples.
+    //
+
+    void summarize(stfu::benchmark_stats&);
+
+    //
+    // Whether the calling process is running a test routine.
+    //
+
+    bool& in_test() noexcept;
+
+    //
+    // Two-sided p-value of the Mann-Whitney U test on two sets of samples,
+    // using the normal approximation with a correction for ties.
+    //
+
+    double mann_whitney(const std::vector<double>&,
+                        const std::vector<double>&);
+
+    //
+    // Record files hold one record per line, with fields separated by tabs:
+    //
+    //   bench <group> <test> <iterations> <samples...>
+    //   time <group> <test> <seconds>
+    //
+    // Benchmark samples are separated by spaces. Lines of any other kind
+    // are ignored, and the latest record of a kind for a test wins.
+    //
+
+    using baseline = std::map<std::string, std::vector<double>>;
+    using runtimes = std::map<std::string, double>;
+
+    std::map<std::string, std::string> load_records(const std::string& path,
+                                                    const std::string& kind,
+                                                    const std::string& group);
+    void append_record(const std::string& path, const std::string& kind,
+                       const std::string& group, const std::string& test,
+                       const std::string& fields);
+
+    baseline load_baseline(const std::string& path, const std::string& group);
+    runtimes load_runtimes(const std::string& path, const std::string& group);
+    void record_benchmark(const std::string& path, const std::string& group,
+                          const std::string& test,
+                          const stfu::benchmark_stats&);
+    void record_runtime(const std::string& path, const std::string& group,
+                        const std::string& test,
+                        std::chrono::duration<double>);
+
+    //
+    // Assign each of the named tests of a group to one of "count" shards.
+    // Without runtimes, a test's shard follows from a hash of its group and
+    // test names; with runtimes, tests are assigned longest first to the
+    // shard with the least total runtime so far, and those without a
+    // recorded runtime are taken to last as long as the mean.
+    //
+
+    std::vector<std::size_t> assign_shards(const std::string& group,
+                                           const std::vector<std::string>&,
+                                           std::size_t count,
+                                           const runtimes&);
+
+    //
+    // A group of hardware performance counters measuring the calling
+    // process, opened only if enabled. Any counter which can not be opened
+    // (e.g. for lack of permission) is reported as unavailable.
+    //
+
+    class perf_group {
+        public:
+
+        explicit perf_group(bool) noexcept;
+        ~perf_group();
+
+        perf_group(const perf_group&) = delete;
+        perf_group& operator=(const perf_group&) = delete;
+
+        void start() noexcept;
+        void stop() noexcept;
+
+        //
+        // The counter values as a line of the result protocol, or an empty
+        // string if not enabled.
+        //
+        std::string report() const;
+
+        protected:
+
+        static const int count = 4;
+
+        bool enabled;
+        int fds[count] = { -1, -1, -1, -1 };
+    };
+
     class widthbuf: public std::streambuf {
         public:
 
@@ -290,6 +677,10 @@ operator<<(std::ostream& out, const stfu::test_result_data& d)
     case stfu::test_result::CRASH:
         out << "\aCRASH";
         break;
+
+    case stfu::test_result::TIMEOUT:
+        out << "\aTIMEOUT";
+        break;
     }
 
     if (!d.message.empty()) {
@@ -299,6 +690,90 @@ operator<<(std::ostream& out, const stfu::test_result_data& d)
     return out;
 }
 
+//
+// Print performance counters as space-separated key=value pairs.
+//
+
+inline std::ostream&
+operator<<(std::ostream& out, const stfu::perf_counters& c)
+{
+    auto value = [&out](const char* name, long long v) -> std::ostream& {
+        out << name << "=";
+        if (v < 0) {
+            return out << "n/a";
+        }
+        return out << v;
+    };
+
+    value("cycles", c.cycles) << " ";
+    value("instructions", c.instructions) << " ";
+    value("branch-misses", c.branch_misses) << " ";
+    value("cache-misses", c.cache_misses);
+
+    return out;
+}
+
+//
+// Print resource usage as space-separated key=value pairs.
+//
+
+inline std::ostream&
+operator<<(std::ostream& out, const stfu::resource_usage& u)
+{
+    out << "user=" << u.user_time.count() << "s"
+        << " sys=" << u.system_time.count() << "s"
+        << " maxrss=" << u.max_rss << "KB"
+        << " minflt=" << u.minor_faults
+        << " majflt=" << u.major_faults
+        << " nvcsw=" << u.voluntary_switches
+        << " nivcsw=" << u.involuntary_switches;
+
+    return out;
+}
+
+//
+// Print benchmark statistics as space-separated key=value pairs.
+//
+
+inline std::ostream&
+operator<<(std::ostream& out, const stfu::benchmark_stats& b)
+{
+    out << "samples=" << b.samples.size()
+        << " iterations=" << b.iterations
+        << " min=" << b.min
+        << " median=" << b.median
+        << " mean=" << b.mean
+        << " p99=" << b.p99
+        << " stddev=" << b.stddev
+        << " ops/s=" << b.ops_per_second;
+
+    if (b.bytes_per_op) {
+        out << " bytes/s=" << b.bytes_per_second;
+    }
+
+    switch (b.baseline) {
+    case stfu::baseline_result::NONE:
+        return out;
+
+    case stfu::baseline_result::SAME:
+        out << " - baseline=SAME";
+        break;
+
+    case stfu::baseline_result::REGRESSED:
+        out << " - baseline=\aREGRESSED";
+        break;
+
+    case stfu::baseline_result::IMPROVED:
+        out << " - baseline=IMPROVED";
+        break;
+    }
+
+    out << " change=" << std::showpos << b.change * 100 << std::noshowpos
+        << "% p=" << b.p_value;
+
+    return out;
+}
+
 //
 // test class implementation
 //
@@ -317,6 +792,10 @@ stfu::test::~test()
             ::close(i);
         }
     }
+
+    if (-1 != pidfd) {
+        ::close(pidfd);
+    }
 }
 
 inline const std::string&
@@ -344,6 +823,27 @@ stfu::test::set_enable(bool b) noexcept
     return *this;
 }
 
+inline stfu::test&
+stfu::test::set_timeout(std::chrono::duration<double> d) noexcept
+{
+    timeout = d;
+    return *this;
+}
+
+inline stfu::test&
+stfu::test::set_perf_counters(bool b) noexcept
+{
+    perf = b;
+    return *this;
+}
+
+inline stfu::test&
+stfu::test::set_isolation(isolation i) noexcept
+{
+    isolated = i;
+    return *this;
+}
+
 inline void
 stfu::test::write_result(test_result r) const noexcept
 {
@@ -352,6 +852,17 @@ stfu::test::write_result(test_result r) const noexcept
 
 inline void
 stfu::test::write_result(test_result r, const std::string& m) const noexcept
+{
+    write_result(r, m, "");
+}
+
+//
+// The result protocol: "PASS" or "FAIL", followed by the message on the
+// same line. Any further lines carry additional data as "key value".
+//
+inline void
+stfu::test::write_result(test_result r, const std::string& m,
+                         const std::string& d) const noexcept
 {
     switch (r) {
     case test_result::PASS:
@@ -366,6 +877,11 @@ stfu::test::write_result(test_result r, const std::string& m) const noexcept
         ::write(filedes[write_end], m.c_str(), m.length());
     }
 
+    if (!d.empty()) {
+        ::write(filedes[write_end], "\n", 1);
+        ::write(filedes[write_end], d.c_str(), d.length());
+    }
+
     close_handle(write_end);
 }
 
@@ -373,26 +889,51 @@ inline stfu::test_result_data
 stfu::test::read_result() const noexcept
 {
     test_result_data r;
-    char buffer[128];
-    ssize_t l;
-    std::string message;
-
-    l = ::read(filedes[read_end], buffer, sizeof(buffer));
-
-    if (l < 1) {
-        message = "Test system failure";
-    } else {
-        message.assign(buffer, l);
-    }
+    const std::size_t eol = received.find('\n');
+    const std::string status = received.substr(0, eol);
 
-    if (0 == message.compare(0, 4, "PASS")) {
+    if (0 == status.compare(0, 4, "PASS")) {
         r.result = test_result::PASS;
     } else {
         r.result = test_result::FAIL;
     }
 
-    if (4 < l) {
-        r.message = message.substr(4);
+    if (4 < status.length()) {
+        r.message = status.substr(4);
+    }
+
+    if (std::string::npos == eol) {
+        return r;
+    }
+
+    std::istringstream data{received.substr(eol + 1)};
+    std::string line;
+
+    while (std::getline(data, line)) {
+        std::istringstream fields{line};
+        std::string key;
+        double sample;
+
+        fields >> key;
+        if ("iterations" == key) {
+            fields >> r.benchmark.iterations;
+        } else if ("bytes" == key) {
+            fields >> r.benchmark.bytes_per_op;
+        } else if ("samples" == key) {
+            while (fields >> sample) {
+                r.benchmark.samples.push_back(sample);
+            }
+        } else if ("perf" == key) {
+            r.counters.enabled = true;
+            fields >> r.counters.cycles
+                   >> r.counters.instructions
+                   >> r.counters.branch_misses
+                   >> r.counters.cache_misses;
+        }
+    }
+
+    if (!r.benchmark.samples.empty()) {
+        stfu_private::summarize(r.benchmark);
     }
 
     return r;
@@ -408,8 +949,6 @@ stfu::test::close_handle(pipe_end e) const noexcept
 inline stfu::test_result_data
 stfu::test::operator()() const
 {
-    using namespace std::chrono;
-
     stfu::test_result_data r;
 
     if (!enabled) {
@@ -417,109 +956,539 @@ stfu::test::operator()() const
         return r;
     }
 
-    if (0 != ::pipe(filedes)) {
+    if (isolation::IN_PROCESS == isolated) {
+        return run_in_process();
+    }
+
+    if (!launch({}, perf)) {
         return r;
     }
 
-    auto t1 = high_resolution_clock::now();
+    const std::vector<const test*> running{this};
+    while (!reap(r)) {
+        await(running);
+    }
+
+    return r;
+}
+
+inline bool
+stfu::test::launch(std::chrono::duration<double> d, bool counted) const
+    noexcept
+{
+    if (0 != ::pipe(filedes)) {
+        return false;
+    }
+
+    eof = false;
+    received.clear();
+    started = std::chrono::high_resolution_clock::now();
+    limit = (timeout.count() > 0) ? timeout : d;
+    deadline = deadline_clock::now() +
+        std::chrono::duration_cast<deadline_clock::duration>(limit);
 
-    switch (pid_t pid = ::fork()) {
+    switch (child = ::fork()) {
     // Error case
     case -1:
-        break;
+        close_handle(read_end);
+        close_handle(write_end);
+        return false;
 
     // Child
     case 0:
         close_handle(read_end);
 
-        try {
-            fn();
-        } catch (const stfu_private::pass&) {
-            write_result(test_result::PASS);
-            ::exit(0);
-        } catch (const stfu_private::fail& e) {
-            write_result(test_result::FAIL, e.get_message());
-            ::exit(0);
+        // Run in a process group of its own, so that a timeout also takes
+        // out anything the test routine started.
+        ::setpgid(0, 0);
+#ifdef __linux__
+        ::prctl(PR_SET_PDEATHSIG, SIGKILL);
+#endif
+
+        {
+            stfu_private::perf_group counters{perf || counted};
+
+            stfu_private::in_test() = true;
+            try {
+                counters.start();
+                fn();
+            } catch (const stfu_private::pass& p) {
+                counters.stop();
+                write_result(test_result::PASS, "",
+                             p.get_data() + counters.report());
+                ::exit(0);
+            } catch (const stfu_private::fail& e) {
+                counters.stop();
+                write_result(test_result::FAIL, e.get_message(),
+                             counters.report());
+                ::exit(0);
+            }
         }
         ::exit(-1);
 
     // Parent
     default:
         close_handle(write_end);
+        ::setpgid(child, child);
+
+        // The result is drained as it arrives, so that a large result can
+        // never block the child on a full pipe.
+        ::fcntl(filedes[read_end], F_SETFL,
+                ::fcntl(filedes[read_end], F_GETFL) | O_NONBLOCK);
+
+        // Where available, a pidfd signals the exit of the child directly.
+#if defined(__linux__) && defined(SYS_pidfd_open)
+        pidfd = static_cast<int>(::syscall(SYS_pidfd_open, child, 0));
+#endif
+        return true;
+    }
+}
 
-        int stat_loc;
-
-        // Test ran; default result is FAIL.
-        r.result = stfu::test_result::FAIL;
+inline void
+stfu::test::drain() const noexcept
+{
+    char buffer[4096];
+    ssize_t l;
 
-        // Unable to reap the child.
-        if (::waitpid(pid, &stat_loc, 0) != pid) {
+    while (-1 != filedes[read_end] && !eof) {
+        l = ::read(filedes[read_end], buffer, sizeof(buffer));
+        if (0 < l) {
+            received.append(buffer, l);
+        } else if (0 == l) {
+            eof = true;
+        } else if (EINTR != errno) {
             break;
         }
+    }
+}
 
-        // Iff the child exited with 0, read the test result.
-        if (WIFEXITED(stat_loc) && (0 == WEXITSTATUS(stat_loc))) {
-            r = read_result();
-            break;
+inline bool
+stfu::test::reap(test_result_data& r) const noexcept
+{
+    using namespace std::chrono;
+
+    int stat_loc;
+    struct rusage ru{};
+    bool expired = false;
+
+    drain();
+
+    pid_t pid = ::wait4(child, &stat_loc, WNOHANG, &ru);
+    if (0 == pid || (-1 == pid && EINTR == errno)) {
+        if (limit.count() <= 0 || deadline_clock::now() < deadline) {
+            return false;
         }
 
-        // Any signal-termination condition is considered a CRASH.
-        if (WIFSIGNALED(stat_loc)) {
-            r.result = stfu::test_result::CRASH;
+        ::kill(-child, SIGKILL);
+        ::kill(child, SIGKILL);
+        while (-1 == (pid = ::wait4(child, &stat_loc, 0, &ru)) &&
+               EINTR == errno) {
+        }
+        expired = true;
+    }
 
-            const int signal = WTERMSIG(stat_loc);
-            if (signal < NSIG) {
-                r.message.append("crashed with: ")
-                         .append(::strsignal(signal));
-            }
-            break;
+    drain();
+    close_handle(read_end);
+    if (-1 != pidfd) {
+        ::close(pidfd);
+        pidfd = -1;
+    }
+
+    // Test ran; default result is FAIL.
+    r.result = stfu::test_result::FAIL;
+
+    // Iff the child exited with 0, read the test result.
+    if (pid != child) {
+        // Unable to reap the child.
+    } else if (expired) {
+        std::ostringstream m;
+        m << "timed out after " << limit.count() << "s";
+        r.result = stfu::test_result::TIMEOUT;
+        r.message = m.str();
+    } else if (WIFEXITED(stat_loc) && (0 == WEXITSTATUS(stat_loc))) {
+        r = read_result();
+
+    // Any signal-termination condition is considered a CRASH.
+    } else if (WIFSIGNALED(stat_loc)) {
+        r.result = stfu::test_result::CRASH;
+
+        const int signal = WTERMSIG(stat_loc);
+        if (signal < NSIG) {
+            r.message.append("crashed with: ")
+                     .append(::strsignal(signal));
         }
     }
 
-    auto t2 = high_resolution_clock::now();
+    if (pid == child) {
+        auto seconds = [](const struct timeval& tv) {
+            return duration<double>(tv.tv_sec + tv.tv_usec / 1e6);
+        };
 
-    r.runtime = duration_cast<duration<double>>(t2 - t1);
+        r.usage.user_time = seconds(ru.ru_utime);
+        r.usage.system_time = seconds(ru.ru_stime);
+        r.usage.max_rss = ru.ru_maxrss;
+        r.usage.minor_faults = ru.ru_minflt;
+        r.usage.major_faults = ru.ru_majflt;
+        r.usage.voluntary_switches = ru.ru_nvcsw;
+        r.usage.involuntary_switches = ru.ru_nivcsw;
+    }
 
-    return r;
-}
+    child = -1;
+    received.clear();
 
-//
-// test_group implementation
-//
+    auto t2 = high_resolution_clock::now();
 
-inline
-stfu::test_group::test_group(const char* n, const char* d) noexcept:
-    name{n}, description{d}
-{
-}
+    r.runtime = duration_cast<duration<double>>(t2 - started);
 
-inline stfu::test_group&
-stfu::test_group::set_verbose(bool b) noexcept
-{
-    verbose = b;
-    return *this;
+    return true;
 }
 
-inline stfu::test_group&
-stfu::test_group::add_test(const stfu::test& test)
+inline stfu::test_result_data
+stfu::test::run_in_process(bool counted) const
 {
-    tests.push_back(test);
-    return *this;
-}
+    using namespace std::chrono;
 
-inline stfu::test_group&
-stfu::test_group::add_before_all(const fixture& f)
-{
-    before_all.push_back(f);
-    return *this;
-}
+    test_result_data r;
+    struct rusage before{};
+    struct rusage after{};
+    stfu_private::perf_group counters{perf || counted};
 
-inline stfu::test_group&
-stfu::test_group::add_before_each(const fixture& f)
-{
-    before_each.push_back(f);
-    return *this;
-}
+    // The result is composed in the same form it would take on the pipe.
+    ::getrusage(RUSAGE_SELF, &before);
+    started = high_resolution_clock::now();
+
+    const bool nested = stfu_private::in_test();
+    stfu_private::in_test() = true;
+
+    try {
+        counters.start();
+        fn();
+        counters.stop();
+        received = "FAIL";
+    } catch (const stfu_private::pass& p) {
+        counters.stop();
+        received = "PASS\n" + p.get_data() + counters.report();
+    } catch (const stfu_private::fail& e) {
+        counters.stop();
+        received = "FAIL" + e.get_message() + "\n" + counters.report();
+    } catch (...) {
+        // Would have terminated a forked test.
+        counters.stop();
+        received.clear();
+    }
+
+    stfu_private::in_test() = nested;
+
+    const auto t2 = high_resolution_clock::now();
+    ::getrusage(RUSAGE_SELF, &after);
+
+    if (received.empty()) {
+        r.result = test_result::CRASH;
+        r.message = "crashed with: uncaught exception";
+    } else {
+        r = read_result();
+    }
+    received.clear();
+
+    auto seconds = [](const struct timeval& a, const struct timeval& b) {
+        return duration<double>((a.tv_sec - b.tv_sec) +
+                                (a.tv_usec - b.tv_usec) / 1e6);
+    };
+
+    r.usage.user_time = seconds(after.ru_utime, before.ru_utime);
+    r.usage.system_time = seconds(after.ru_stime, before.ru_stime);
+    r.usage.max_rss = after.ru_maxrss;
+    r.usage.minor_faults = after.ru_minflt - before.ru_minflt;
+    r.usage.major_faults = after.ru_majflt - before.ru_majflt;
+    r.usage.voluntary_switches = after.ru_nvcsw - before.ru_nvcsw;
+    r.usage.involuntary_switches = after.ru_nivcsw - before.ru_nivcsw;
+    r.runtime = duration_cast<duration<double>>(t2 - started);
+
+    return r;
+}
+
+inline void
+stfu::test::await(const std::vector<const test*>& running) noexcept
+{
+    using namespace std::chrono;
+
+    // Without a pidfd, polling bounds the time taken to notice a child which
+    // exited without closing its result pipe (e.g. a grandchild inherited
+    // it), or which is about to exit having closed it.
+    static const int tick_ms = 100;
+    static const int exiting_ms = 1;
+
+    std::vector<struct pollfd> fds;
+    int wait_ms = -1;
+
+    auto bound = [&wait_ms](int ms) {
+        wait_ms = (-1 == wait_ms) ? ms : std::min(wait_ms, ms);
+    };
+
+    for (const auto t: running) {
+        if (!t->eof) {
+            fds.push_back({t->filedes[read_end], POLLIN, 0});
+        }
+
+        if (-1 != t->pidfd) {
+            fds.push_back({t->pidfd, POLLIN, 0});
+        } else {
+            bound(t->eof ? exiting_ms : tick_ms);
+        }
+
+        if (t->limit.count() > 0) {
+            const auto left = duration_cast<milliseconds>(
+                t->deadline - deadline_clock::now()).count();
+            bound(static_cast<int>(std::max<decltype(left)>(left + 1, 0)));
+        }
+    }
+
+    ::poll(fds.data(), fds.size(), wait_ms);
+}
+
+//
+// benchmark class implementation
+//
+
+inline
+stfu::benchmark::benchmark(const char* n, benchmark_routine f,
+                           const char* d):
+    test{n, nullptr, d}, config{std::make_shared<settings>()}
+{
+    const std::shared_ptr<settings> c{config};
+
+    fn = [f, c]() { run(f, *c); };
+}
+
+inline stfu::benchmark&
+stfu::benchmark::set_warmup(std::chrono::duration<double> d) noexcept
+{
+    config->warmup = d;
+    return *this;
+}
+
+inline stfu::benchmark&
+stfu::benchmark::set_samples(std::size_t n) noexcept
+{
+    config->samples = std::max<std::size_t>(n, 1);
+    return *this;
+}
+
+inline stfu::benchmark&
+stfu::benchmark::set_time_budget(std::chrono::duration<double> d) noexcept
+{
+    config->time_budget = d;
+    return *this;
+}
+
+inline stfu::benchmark&
+stfu::benchmark::set_min_sample_time(std::chrono::duration<double> d)
+    noexcept
+{
+    config->min_sample_time = d;
+    return *this;
+}
+
+inline stfu::benchmark&
+stfu::benchmark::set_bytes_per_op(std::size_t n) noexcept
+{
+    config->bytes_per_op = n;
+    return *this;
+}
+
+inline void
+stfu::benchmark::run(const benchmark_routine& f, const settings& c)
+{
+    using namespace std::chrono;
+    using clock = steady_clock;
+
+    static const std::size_t max_iterations = 1000000000;
+    std::size_t iterations = 1;
+
+    auto timed = [&f](std::size_t n) {
+        const auto t1 = clock::now();
+        f(n);
+        return duration_cast<duration<double>>(clock::now() - t1);
+    };
+
+    // Warm up, meanwhile scaling the iteration count until a single sample
+    // is long enough to be measured reliably.
+    const auto warm = clock::now() + duration_cast<clock::duration>(c.warmup);
+    for (;;) {
+        const auto t = timed(iterations);
+
+        if (t < c.min_sample_time && iterations < max_iterations) {
+            const double scale = (t.count() > 0) ?
+                c.min_sample_time.count() / t.count() * 1.2 : 10.0;
+            iterations = static_cast<std::size_t>(
+                iterations * std::min(std::max(scale, 2.0), 10.0));
+        } else if (clock::now() >= warm) {
+            break;
+        }
+    }
+
+    std::ostringstream data;
+    data << std::setprecision(9)
+         << "iterations " << iterations << "\n"
+         << "bytes " << c.bytes_per_op << "\n"
+         << "samples";
+
+    const auto start = clock::now();
+    for (std::size_t i = 0; i < c.samples; ++i) {
+        data << " " << timed(iterations).count() / iterations;
+
+        if (c.time_budget.count() > 0 &&
+                clock::now() - start >= c.time_budget) {
+            break;
+        }
+    }
+    data << "\n";
+
+    throw stfu_private::pass{data.str()};
+}
+
+//
+// test_group implementation
+//
+
+inline
+stfu::test_group::test_group(const char* n, const char* d) noexcept:
+    name{n}, description{d}
+{
+    if (stfu_private::in_test()) {
+        return;
+    }
+
+    const char* j = ::getenv("STFU_JOBS");
+    const char* r = ::getenv("STFU_RECORD");
+    const char* b = ::getenv("STFU_BASELINE");
+    const char* t = ::getenv("STFU_THRESHOLD");
+    const char* si = ::getenv("STFU_SHARD_INDEX");
+    const char* sc = ::getenv("STFU_SHARD_COUNT");
+    const char* sr = ::getenv("STFU_SHARD_RUNTIMES");
+
+    if (j && *j) {
+        set_jobs(std::strtoul(j, nullptr, 10));
+    }
+
+    if (r) {
+        record_file = r;
+    }
+
+    if (b) {
+        baseline_file = b;
+    }
+
+    if (t && *t) {
+        threshold = std::strtod(t, nullptr);
+    }
+
+    if (si && *si && sc && *sc) {
+        set_shard(std::strtoul(si, nullptr, 10),
+                  std::strtoul(sc, nullptr, 10));
+    }
+
+    if (sr) {
+        shard_runtimes = sr;
+    }
+}
+
+inline stfu::test_group&
+stfu::test_group::set_verbose(bool b) noexcept
+{
+    verbose = b;
+    return *this;
+}
+
+inline stfu::test_group&
+stfu::test_group::set_jobs(std::size_t j) noexcept
+{
+    if (0 == j) {
+        const long n = ::sysconf(_SC_NPROCESSORS_ONLN);
+        j = (n > 0) ? static_cast<std::size_t>(n) : 1;
+    }
+
+    jobs = j;
+    return *this;
+}
+
+inline stfu::test_group&
+stfu::test_group::set_timeout(std::chrono::duration<double> d) noexcept
+{
+    timeout = d;
+    return *this;
+}
+
+inline stfu::test_group&
+stfu::test_group::set_perf_counters(bool b) noexcept
+{
+    perf = b;
+    return *this;
+}
+
+inline stfu::test_group&
+stfu::test_group::set_isolation(isolation i) noexcept
+{
+    isolated = (isolation::DEFAULT == i) ? isolation::FORKED : i;
+    return *this;
+}
+
+inline stfu::test_group&
+stfu::test_group::set_record_file(const std::string& f)
+{
+    record_file = f;
+    return *this;
+}
+
+inline stfu::test_group&
+stfu::test_group::set_baseline_file(const std::string& f)
+{
+    baseline_file = f;
+    return *this;
+}
+
+inline stfu::test_group&
+stfu::test_group::set_regression_threshold(double t) noexcept
+{
+    threshold = t;
+    return *this;
+}
+
+inline stfu::test_group&
+stfu::test_group::set_shard(std::size_t index, std::size_t count) noexcept
+{
+    shard_count = std::max<std::size_t>(count, 1);
+    shard_index = std::min(index, shard_count - 1);
+    return *this;
+}
+
+inline stfu::test_group&
+stfu::test_group::set_shard_runtimes(const std::string& f)
+{
+    shard_runtimes = f;
+    return *this;
+}
+
+inline stfu::test_group&
+stfu::test_group::add_test(const stfu::test& test)
+{
+    tests.push_back(test);
+    return *this;
+}
+
+inline stfu::test_group&
+stfu::test_group::add_before_all(const fixture& f)
+{
+    before_all.push_back(f);
+    return *this;
+}
+
+inline stfu::test_group&
+stfu::test_group::add_before_each(const fixture& f)
+{
+    before_each.push_back(f);
+    return *this;
+}
 
 inline stfu::test_group&
 stfu::test_group::add_after_all(const fixture& f)
@@ -543,73 +1512,147 @@ stfu::test_group::operator()(std::ostream& out) const
     stfu_private::widthstream wrapped_comment{75, out};
     test_result_summary results;
 
+    // Select the tests of this shard.
+    std::vector<test> selected;
+
+    if (1 < shard_count) {
+        std::vector<std::string> names;
+        for (const auto& t: tests) {
+            names.push_back(t.get_name());
+        }
+
+        const auto shard = stfu_private::assign_shards(name, names,
+            shard_count, shard_runtimes.empty() ? stfu_private::runtimes{} :
+            stfu_private::load_runtimes(shard_runtimes, name));
+
+        for (std::size_t i = 0; i < tests.size(); ++i) {
+            if (shard_index == shard[i]) {
+                selected.push_back(tests[i]);
+            }
+        }
+    } else {
+        selected = tests;
+    }
+
+    // Results are kept per test, so that they can be printed in the order
+    // the tests were added no matter in which order they complete.
+    std::vector<test_result_data> data(selected.size());
+    std::vector<bool> finished(selected.size(), false);
+    std::vector<std::size_t> running;
+    std::size_t next = 0;
+    std::size_t printed = 0;
+
     // Initialize based on all the tests yet to run.
-    results.didnt_run = tests.size();
+    results.didnt_run = selected.size();
 
     if (verbose) {
         out << "#" << std::endl
             << "# STFU version " STFU_VERSION << std::endl
             << "#" << std::endl
-            << "# Running " << tests.size() << " test(s) "
-            << "in group: " << name << std::endl;
+            << "# Running " << selected.size() << " test(s) "
+            << "in group: " << name;
+
+        if (1 < shard_count) {
+            out << " (shard " << shard_index << " of " << shard_count << ")";
+        }
+
+        out << std::endl;
 
         out << "#" << std::endl
             << "# " << description << std::endl
             << "#" << std::endl;
     }
 
-    try {
+    // Significance level at which a change of a benchmark is reported.
+    static const double alpha = 0.01;
 
-        // Run global prefixes.
-        for (const auto &f: before_all) {
-            if (!f()) {
-                throw fixture_exception("before_all");
-            }
+    const stfu_private::baseline reference{baseline_file.empty() ?
+        stfu_private::baseline{} :
+        stfu_private::load_baseline(baseline_file, name)};
+
+    // Record results, and compare benchmark results.
+    auto measure = [&](std::size_t i) {
+        auto& b = data[i].benchmark;
+        const auto previous = reference.find(selected[i].get_name());
+
+        if (!record_file.empty() &&
+            stfu::test_result::SKIPPED != data[i].result &&
+            stfu::test_result::DIDNT_RUN != data[i].result) {
+            stfu_private::record_runtime(record_file, name,
+                                         selected[i].get_name(),
+                                         data[i].runtime);
         }
 
-        // Run all tests.
-        for (const auto &t: tests) {
+        if (b.samples.empty()) {
+            return;
+        }
 
-            // Run per-test prefixes.
-            for (const auto &f: before_each) {
-                if (!f()) {
-                    throw fixture_exception("before_each");
-                }
-            }
+        if (!record_file.empty()) {
+            stfu_private::record_benchmark(record_file, name,
+                                           selected[i].get_name(), b);
+        }
 
-            // Run the test routine.
-            const auto r = t();
-            --results.didnt_run;
+        if (reference.end() == previous || previous->second.empty()) {
+            return;
+        }
 
-            // Account for results summary.
-            switch (r.result) {
-            case stfu::test_result::DIDNT_RUN: // Not expected
-                ++results.didnt_run;
-                break;
+        stfu::benchmark_stats was;
+        was.samples = previous->second;
+        stfu_private::summarize(was);
 
-            case stfu::test_result::SKIPPED:
-                ++results.skipped;
-                break;
+        b.change = (was.median > 0) ? b.median / was.median - 1 : 0;
+        b.p_value = stfu_private::mann_whitney(b.samples, was.samples);
+        b.baseline = stfu::baseline_result::SAME;
 
-            case stfu::test_result::PASS:
-                ++results.passed;
-                break;
+        if (b.p_value < alpha && b.change > threshold) {
+            b.baseline = stfu::baseline_result::REGRESSED;
+            ++results.regressed;
+        } else if (b.p_value < alpha && b.change < -threshold) {
+            b.baseline = stfu::baseline_result::IMPROVED;
+            ++results.improved;
+        }
+    };
 
-            case stfu::test_result::FAIL:
-                ++results.failed;
-                break;
+    // Account for results summary.
+    auto account = [&](std::size_t i) {
+        measure(i);
 
-            case stfu::test_result::CRASH:
-                ++results.crashed;
-                break;
-            }
+        --results.didnt_run;
 
-            // Run per-test postfixes.
-            for (const auto &f: after_each) {
-                if (!f()) {
-                    throw fixture_exception("after_each");
-                }
-            }
+        switch (data[i].result) {
+        case stfu::test_result::DIDNT_RUN: // Not expected
+            ++results.didnt_run;
+            break;
+
+        case stfu::test_result::SKIPPED:
+            ++results.skipped;
+            break;
+
+        case stfu::test_result::PASS:
+            ++results.passed;
+            break;
+
+        case stfu::test_result::FAIL:
+            ++results.failed;
+            break;
+
+        case stfu::test_result::CRASH:
+            ++results.crashed;
+            break;
+
+        case stfu::test_result::TIMEOUT:
+            ++results.timed_out;
+            break;
+        }
+
+        finished[i] = true;
+    };
+
+    // Print every finished test not preceded by one still outstanding.
+    auto print_finished = [&]() {
+        for (; printed < selected.size() && finished[printed]; ++printed) {
+            const auto& t = selected[printed];
+            const auto& r = data[printed];
 
             if (verbose) {
                 out << "# " << t.get_name() << ": " << std::endl;
@@ -619,13 +1662,103 @@ stfu::test_group::operator()(std::ostream& out) const
 
             out << std::setw(20) << std::left << t.get_name()
                 << r
-                << " - in " << r.runtime.count() << "s"
-                << std::endl;
+                << " - in " << r.runtime.count() << "s";
+
+            if (!r.benchmark.samples.empty()) {
+                out << " - " << r.benchmark;
+            }
+
+            out << std::endl;
+
+            if (r.counters.enabled) {
+                out << "#   perf: " << r.counters << std::endl;
+            }
 
             if (verbose) {
+                if (stfu::test_result::SKIPPED != r.result &&
+                    stfu::test_result::DIDNT_RUN != r.result) {
+                    out << "#   usage: " << r.usage << std::endl;
+                }
                 out << std::endl;
             }
         }
+    };
+
+    auto complete = [&](std::size_t i) {
+        account(i);
+
+        // Run per-test postfixes.
+        for (const auto &f: after_each) {
+            if (!f()) {
+                throw fixture_exception("after_each");
+            }
+        }
+
+        print_finished();
+    };
+
+    try {
+
+        // Run global prefixes.
+        for (const auto &f: before_all) {
+            if (!f()) {
+                throw fixture_exception("before_all");
+            }
+        }
+
+        // Run all tests, up to "jobs" of them at a time.
+        while (next < selected.size() || !running.empty()) {
+
+            while (next < selected.size() && running.size() < jobs) {
+                const std::size_t i = next++;
+
+                // Run per-test prefixes.
+                for (const auto &f: before_each) {
+                    if (!f()) {
+                        throw fixture_exception("before_each");
+                    }
+                }
+
+                // Start the test routine.
+                const isolation where = (isolation::DEFAULT ==
+                    selected[i].isolated) ? isolated : selected[i].isolated;
+
+                if (!selected[i].is_enabled()) {
+                    data[i].result = stfu::test_result::SKIPPED;
+                    complete(i);
+                } else if (isolation::IN_PROCESS == where) {
+                    data[i] = selected[i].run_in_process(perf);
+                    complete(i);
+                } else if (selected[i].launch(timeout, perf)) {
+                    running.push_back(i);
+                } else {
+                    complete(i);
+                }
+            }
+
+            // Collect the results of any finished test routines.
+            bool progress = false;
+
+            for (std::size_t k = 0; k < running.size();) {
+                const std::size_t i = running[k];
+
+                if (selected[i].reap(data[i])) {
+                    running.erase(running.begin() + k);
+                    complete(i);
+                    progress = true;
+                } else {
+                    ++k;
+                }
+            }
+
+            if (!progress && !running.empty()) {
+                std::vector<const test*> waiting;
+                for (const auto i: running) {
+                    waiting.push_back(&selected[i]);
+                }
+                test::await(waiting);
+            }
+        }
 
         // Run global postfixes.
         for (const auto &f: after_all) {
@@ -636,11 +1769,24 @@ stfu::test_group::operator()(std::ostream& out) const
     }
 
     catch (stfu_private::fixture_exception& e) {
+
+        // Tests already in flight are allowed to finish, but no further
+        // fixtures are run.
+        for (const auto i: running) {
+            const std::vector<const test*> waiting{&selected[i]};
+            while (!selected[i].reap(data[i])) {
+                test::await(waiting);
+            }
+            account(i);
+        }
+        print_finished();
+
         out << "# ERROR - failure in fixture: " << e.what() << std::endl;
     }
 
     if (verbose) {
-        std::size_t failures = results.failed + results.crashed;
+        std::size_t failures = results.failed + results.crashed +
+                               results.timed_out + results.regressed;
 
         out << "# Summary: " << name << " completed with " << failures
             << ((1 == failures) ? " failure" : " failures") << std::endl;
@@ -649,6 +1795,370 @@ stfu::test_group::operator()(std::ostream& out) const
     return results;
 }
 
+inline
+stfu_private::pass::pass(std::string d) noexcept:
+    data{std::move(d)}
+{
+}
+
+inline const std::string&
+stfu_private::pass::get_data() const noexcept
+{
+    return data;
+}
+
+inline bool&
+stfu_private::in_test() noexcept
+{
+    static bool b = false;
+    return b;
+}
+
+inline void
+stfu_private::summarize(stfu::benchmark_stats& b)
+{
+    std::vector<double> sorted{b.samples};
+    const std::size_t n = sorted.size();
+    double sum = 0;
+    double squares = 0;
+
+    std::sort(sorted.begin(), sorted.end());
+
+    for (const auto x: sorted) {
+        sum += x;
+    }
+    b.mean = sum / n;
+
+    for (const auto x: sorted) {
+        squares += (x - b.mean) * (x - b.mean);
+    }
+
+    b.min = sorted.front();
+    b.median = (n % 2) ? sorted[n / 2] :
+        (sorted[n / 2 - 1] + sorted[n / 2]) / 2;
+    b.p99 = sorted[static_cast<std::size_t>(std::ceil(0.99 * n)) - 1];
+    b.stddev = (n > 1) ? std::sqrt(squares / (n - 1)) : 0;
+    b.ops_per_second = (b.mean > 0) ? 1 / b.mean : 0;
+    b.bytes_per_second = b.ops_per_second * b.bytes_per_op;
+}
+
+inline double
+stfu_private::mann_whitney(const std::vector<double>& a,
+                           const std::vector<double>& b)
+{
+    const double n1 = a.size();
+    const double n2 = b.size();
+    const double n = n1 + n2;
+    std::vector<std::pair<double, bool>> all;
+    double rank_sum = 0;
+    double ties = 0;
+
+    if (a.empty() || b.empty()) {
+        return 1;
+    }
+
+    for (const auto x: a) {
+        all.emplace_back(x, true);
+    }
+    for (const auto x: b) {
+        all.emplace_back(x, false);
+    }
+    std::sort(all.begin(), all.end());
+
+    // Rank the combined samples, giving tied values their average rank.
+    for (std::size_t i = 0; i < all.size();) {
+        std::size_t j = i;
+        while (j < all.size() && all[j].first == all[i].first) {
+            ++j;
+        }
+
+        const double t = j - i;
+        const double rank = (i + 1 + j) / 2.0;
+        for (std::size_t k = i; k < j; ++k) {
+            if (all[k].second) {
+                rank_sum += rank;
+            }
+        }
+        ties += t * t * t - t;
+        i = j;
+    }
+
+    const double u = rank_sum - n1 * (n1 + 1) / 2;
+    const double mu = n1 * n2 / 2;
+    const double sigma = std::sqrt(n1 * n2 / 12 *
+                                   ((n + 1) - ties / (n * (n - 1))));
+
+    if (sigma <= 0) {
+        return 1;
+    }
+
+    const double z = std::max(std::fabs(u - mu) - 0.5, 0.0) / sigma;
+
+    return std::erfc(z / std::sqrt(2.0));
+}
+
+inline std::map<std::string, std::string>
+stfu_private::load_records(const std::string& path, const std::string& kind,
+                           const std::string& group)
+{
+    std::map<std::string, std::string> records;
+    std::ifstream in{path};
+    std::string line;
+
+    while (std::getline(in, line)) {
+        std::istringstream fields{line};
+        std::string k, g, t, rest;
+
+        if (std::getline(fields, k, '\t') && kind == k &&
+            std::getline(fields, g, '\t') && group == g &&
+            std::getline(fields, t, '\t') &&
+            std::getline(fields, rest)) {
+            records[t] = rest;
+        }
+    }
+
+    return records;
+}
+
+inline void
+stfu_private::append_record(const std::string& path, const std::string& kind,
+                            const std::string& group, const std::string& test,
+                            const std::string& fields)
+{
+    auto field = [](std::string s) {
+        std::replace(s.begin(), s.end(), '\t', ' ');
+        std::replace(s.begin(), s.end(), '\n', ' ');
+        return s;
+    };
+
+    const std::string line{kind + "\t" + field(group) + "\t" +
+                           field(test) + "\t" + fields + "\n"};
+
+    // A single append keeps records intact when several processes share
+    // the file.
+    const int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (-1 != fd) {
+        ::write(fd, line.c_str(), line.length());
+        ::close(fd);
+    }
+}
+
+inline stfu_private::baseline
+stfu_private::load_baseline(const std::string& path, const std::string& group)
+{
+    baseline b;
+
+    for (const auto& r: load_records(path, "bench", group)) {
+        std::istringstream fields{r.second};
+        std::string iterations, samples;
+        double x;
+
+        std::getline(fields, iterations, '\t');
+        std::getline(fields, samples);
+
+        std::istringstream values{samples};
+        auto& v = b[r.first];
+        while (values >> x) {
+            v.push_back(x);
+        }
+    }
+
+    return b;
+}
+
+inline stfu_private::runtimes
+stfu_private::load_runtimes(const std::string& path, const std::string& group)
+{
+    runtimes t;
+
+    for (const auto& r: load_records(path, "time", group)) {
+        std::istringstream fields{r.second};
+        double x;
+
+        if (fields >> x) {
+            t[r.first] = x;
+        }
+    }
+
+    return t;
+}
+
+inline void
+stfu_private::record_benchmark(const std::string& path,
+                               const std::string& group,
+                               const std::string& test,
+                               const stfu::benchmark_stats& b)
+{
+    std::ostringstream fields;
+
+    fields << std::setprecision(9) << b.iterations << "\t";
+    for (std::size_t i = 0; i < b.samples.size(); ++i) {
+        fields << (i ? " " : "") << b.samples[i];
+    }
+
+    append_record(path, "bench", group, test, fields.str());
+}
+
+inline void
+stfu_private::record_runtime(const std::string& path,
+                             const std::string& group,
+                             const std::string& test,
+                             std::chrono::duration<double> d)
+{
+    std::ostringstream fields;
+
+    fields << std::setprecision(9) << d.count();
+
+    append_record(path, "time", group, test, fields.str());
+}
+
+inline std::vector<std::size_t>
+stfu_private::assign_shards(const std::string& group,
+                            const std::vector<std::string>& names,
+                            std::size_t count,
+                            const runtimes& times)
+{
+    std::vector<std::size_t> shard(names.size());
+    std::vector<std::uint64_t> hash(names.size());
+
+    // FNV-1a, so that assignments agree on every host.
+    for (std::size_t i = 0; i < names.size(); ++i) {
+        std::uint64_t h = 14695981039346656037ULL;
+        for (const char c: group + '\t' + names[i]) {
+            h = (h ^ static_cast<unsigned char>(c)) * 1099511628211ULL;
+        }
+        hash[i] = h;
+        shard[i] = h % count;
+    }
+
+    if (times.empty()) {
+        return shard;
+    }
+
+    double total = 0;
+    for (const auto& t: times) {
+        total += t.second;
+    }
+
+    std::vector<std::pair<double, std::size_t>> order;
+    for (std::size_t i = 0; i < names.size(); ++i) {
+        const auto t = times.find(names[i]);
+        order.emplace_back((times.end() == t) ? total / times.size() :
+                           t->second, i);
+    }
+
+    // Longest first; ties broken by hash rather than by order of addition.
+    std::sort(order.begin(), order.end(),
+              [&hash](const std::pair<double, std::size_t>& a,
+                      const std::pair<double, std::size_t>& b) {
+                  return (a.first != b.first) ? a.first > b.first :
+                         hash[a.second] < hash[b.second];
+              });
+
+    std::vector<double> load(count, 0);
+    for (const auto& o: order) {
+        const std::size_t least = std::min_element(load.begin(), load.end()) -
+                                  load.begin();
+        shard[o.second] = least;
+        load[least] += o.first;
+    }
+
+    return shard;
+}
+
+inline
+stfu_private::perf_group::perf_group(bool e) noexcept:
+    enabled{e}
+{
+#ifdef __linux__
+    static const unsigned long long events[count] = {
+        PERF_COUNT_HW_CPU_CYCLES,
+        PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_BRANCH_MISSES,
+        PERF_COUNT_HW_CACHE_MISSES
+    };
+
+    if (!enabled) {
+        return;
+    }
+
+    for (int i = 0; i < count; ++i) {
+        struct perf_event_attr attr;
+
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = events[i];
+        attr.disabled = (0 == i);
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_ID;
+
+        // The first counter leads the group; without it, there is none.
+        fds[i] = static_cast<int>(::syscall(SYS_perf_event_open, &attr, 0,
+                                            -1, fds[0], 0));
+        if (-1 == fds[0]) {
+            break;
+        }
+    }
+#endif
+}
+
+inline
+stfu_private::perf_group::~perf_group()
+{
+    for (int i: fds) {
+        if (-1 != i) {
+            ::close(i);
+        }
+    }
+}
+
+inline void
+stfu_private::perf_group::start() noexcept
+{
+#ifdef __linux__
+    if (-1 != fds[0]) {
+        ::ioctl(fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ::ioctl(fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+#endif
+}
+
+inline void
+stfu_private::perf_group::stop() noexcept
+{
+#ifdef __linux__
+    if (-1 != fds[0]) {
+        ::ioctl(fds[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+    }
+#endif
+}
+
+inline std::string
+stfu_private::perf_group::report() const
+{
+    std::ostringstream line;
+
+    if (!enabled) {
+        return "";
+    }
+
+    line << "perf";
+    for (int i: fds) {
+        unsigned long long value[2];
+
+        if (-1 != i && sizeof(value) == ::read(i, value, sizeof(value))) {
+            line << " " << static_cast<long long>(value[0]);
+        } else {
+            line << " -1";
+        }
+    }
+    line << "\n";
+
+    return line.str();
+}
+
 inline const std::string&
 stfu_private::fail::get_message() const noexcept
 {
@@ -5,9 +5,14 @@
 // notice is preserved.
 //
 
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
 #include <iostream>
 #include <sstream>
 #include <string>
+#include <chrono>
+#include <vector>
 #include <unistd.h>
 
 #include "stfu.hh"
@@ -145,6 +150,7 @@ main(int argc, char* argv[])
                                 [&](){ ++fixture_out; return true; }})
                       .add_after_each(stfu::test_group::fixture{
                                 [&](){ ++fixture_out; return true; }})
+                      .set_jobs(1)
                       .set_verbose(false);
 
                 std::ostringstream output;
@@ -183,6 +189,388 @@ main(int argc, char* argv[])
             "Verify behavior of exceptional fixtures."
     };
 
+    stfu::test parallel{"parallel", []
+            {
+                using namespace std::chrono;
+
+                stfu::test_group nested{"nested", "nested tests"};
+
+                nested.add_test(stfu::test{"(slow)",
+                                [](){ ::usleep(300000); STFU_PASS(); }})
+                      .add_test(stfu::test{"(medium)",
+                                [](){ ::usleep(200000); STFU_PASS(); }})
+                      .add_test(stfu::test{"(fast)",
+                                [](){ ::usleep(100000); STFU_PASS(); }})
+                      .set_jobs(3)
+                      .set_verbose(false);
+
+                std::ostringstream output;
+                const auto t1 = steady_clock::now();
+                stfu::test_result_summary summary = nested(output);
+                const auto t2 = steady_clock::now();
+                const std::string s{output.str()};
+
+                STFU_ASSERT(3 == summary.passed);
+                STFU_ASSERT(s.find("(slow)") < s.find("(medium)"));
+                STFU_ASSERT(s.find("(medium)") < s.find("(fast)"));
+                STFU_PASS_IFF(t2 - t1 < milliseconds(500));
+            },
+            "Verify that tests run concurrently when jobs are configured, "
+            "and that results are still printed in the order the tests were "
+            "added."
+    };
+
+    stfu::test benchmark{"benchmark", []
+            {
+                volatile std::size_t sink = 0;
+                stfu::benchmark b{"", [&sink](std::size_t n)
+                        {
+                            for (std::size_t i = 0; i < n; ++i) {
+                                sink = sink + i;
+                            }
+                        }};
+
+                b.set_warmup(std::chrono::milliseconds(0))
+                 .set_samples(10)
+                 .set_min_sample_time(std::chrono::microseconds(100));
+
+                const auto r = b();
+                const auto& s = r.benchmark;
+
+                STFU_ASSERT(stfu::test_result::PASS == r.result);
+                STFU_ASSERT(10 == s.samples.size());
+                STFU_ASSERT(1 < s.iterations);
+                STFU_ASSERT(s.min <= s.median && s.median <= s.p99);
+                STFU_PASS_IFF(0 < s.ops_per_second);
+            },
+            "Verify that a benchmark scales its iteration count and reports "
+            "statistics for the requested number of samples."
+    };
+
+    stfu::test benchmark_fail{"benchmark fail", []
+            {
+                stfu::benchmark b{"", [](std::size_t) { STFU_FAIL(); }};
+
+                const auto r = b();
+
+                STFU_ASSERT(stfu::test_result::FAIL == r.result);
+                STFU_PASS_IFF(r.benchmark.samples.empty());
+            },
+            "Verify that a benchmark routine can fail."
+    };
+
+    stfu::test timeout{"timeout", []
+            {
+                using namespace std::chrono;
+
+                stfu::test t{"", []{ ::sleep(10); STFU_PASS(); }};
+                t.set_timeout(milliseconds(200));
+
+                const auto r = t();
+
+                STFU_ASSERT(stfu::test_result::TIMEOUT == r.result);
+                STFU_PASS_IFF(r.runtime < seconds(1));
+            },
+            "Verify that a test running past its timeout is killed and "
+            "reported as such."
+    };
+
+    stfu::test group_timeout{"group timeout", []
+            {
+                using namespace std::chrono;
+
+                stfu::test_group nested{"nested", "nested tests"};
+                int filedes[2];
+                char c;
+
+                // The write end is held by the test and its grandchild, so
+                // EOF is only seen once both have been killed.
+                STFU_ASSERT(0 == ::pipe(filedes));
+
+                nested.add_test(stfu::test{"(hang)", [&filedes]
+                                {
+                                    if (0 == ::fork()) {
+                                        ::sleep(1);
+                                        ::write(filedes[1], "x", 1);
+                                        ::_exit(0);
+                                    }
+                                    ::sleep(10);
+                                }})
+                      .add_test(stfu::test{"(quick)",
+                                [](){ STFU_PASS(); }})
+                      .set_timeout(milliseconds(200))
+                      .set_verbose(false);
+
+                std::ostringstream output;
+                stfu::test_result_summary summary = nested(output);
+
+                ::close(filedes[1]);
+                const ssize_t l = ::read(filedes[0], &c, 1);
+                ::close(filedes[0]);
+
+                STFU_ASSERT(1 == summary.timed_out);
+                STFU_ASSERT(1 == summary.passed);
+                STFU_ASSERT(std::string::npos !=
+                            output.str().find("TIMEOUT"));
+                STFU_PASS_IFF(0 == l);
+            },
+            "Verify that the group timeout applies to its tests, and that "
+            "a timeout takes out the whole process group of the test."
+    };
+
+    stfu::test usage{"resource usage", []
+            {
+                static const std::size_t size = 32 << 20;
+
+                stfu::test t{"", []
+                        {
+                            std::string s(size, 'x');
+                            STFU_PASS_IFF(size == s.size());
+                        }};
+
+                const auto r = t();
+
+                STFU_ASSERT(stfu::test_result::PASS == r.result);
+                STFU_ASSERT(static_cast<long>(size >> 10) <= r.usage.max_rss);
+                STFU_PASS_IFF(0 < r.usage.minor_faults);
+            },
+            "Verify that the resource usage of the test routine is "
+            "reported."
+    };
+
+    stfu::test counters{"perf counters", []
+            {
+                stfu::test t{"", []{ STFU_PASS(); }};
+
+                const auto r = t.set_perf_counters(true)();
+                const auto& c = r.counters;
+
+                // Counters may legitimately be unavailable (-1), e.g. in a
+                // container or virtual machine.
+                STFU_ASSERT(stfu::test_result::PASS == r.result);
+                STFU_ASSERT(c.enabled);
+                STFU_PASS_IFF(-1 == c.instructions || 0 < c.instructions);
+            },
+            "Verify that hardware performance counters are reported when "
+            "requested, or are reported as unavailable."
+    };
+
+    stfu::test baseline{"baseline", []
+            {
+                using namespace std::chrono;
+
+                char path[] = "/tmp/stfu-baseline.XXXXXX";
+                ::close(::mkstemp(path));
+
+                // Run a benchmark doing "scale" times the work per operation,
+                // either recording it or comparing it against the record.
+                auto run = [&path](std::size_t scale, bool compare) {
+                    stfu::benchmark b{"(bench)", [scale](std::size_t n)
+                            {
+                                volatile std::size_t sink = 0;
+                                for (std::size_t i = 0; i < n * scale; ++i) {
+                                    sink = sink + i;
+                                }
+                            }};
+                    b.set_warmup(milliseconds(0))
+                     .set_samples(20)
+                     .set_min_sample_time(microseconds(200));
+
+                    stfu::test_group nested{"nested", "nested tests"};
+                    nested.add_test(b)
+                          .set_jobs(1)
+                          .set_verbose(false);
+                    if (compare) {
+                        nested.set_record_file("")
+                              .set_baseline_file(path);
+                    } else {
+                        nested.set_record_file(path)
+                              .set_baseline_file("");
+                    }
+
+                    std::ostringstream output;
+                    return nested(output);
+                };
+
+                run(4, false);
+                const auto faster = run(1, true);
+                const auto slower = run(16, true);
+                ::unlink(path);
+
+                STFU_ASSERT(1 == faster.passed);
+                STFU_ASSERT(1 == faster.improved && 0 == faster.regressed);
+                STFU_PASS_IFF(1 == slower.regressed && 0 == slower.improved);
+            },
+            "Verify that benchmarks are recorded, and that regressions and "
+            "improvements against a baseline are detected."
+    };
+
+    stfu::test in_process{"in process", []
+            {
+                using stfu::test_result;
+
+                int runs = 0;
+                stfu::test pass{"", [&runs]{ ++runs; STFU_PASS(); }};
+                stfu::test fail{"", []{ STFU_ASSERT(0 == 1); }};
+                stfu::test implicit{"", []{}};
+                stfu::test thrown{"", []{ throw std::runtime_error{""}; }};
+
+                for (auto t: {&pass, &fail, &implicit, &thrown}) {
+                    t->set_isolation(stfu::isolation::IN_PROCESS);
+                }
+
+                const auto failed = fail();
+
+                STFU_ASSERT(test_result::PASS == pass().result && 1 == runs);
+                STFU_ASSERT(test_result::FAIL == failed.result);
+                STFU_ASSERT(std::string::npos !=
+                            failed.message.find("0 == 1"));
+                STFU_ASSERT(test_result::FAIL == implicit().result);
+                STFU_PASS_IFF(test_result::CRASH == thrown().result);
+            },
+            "Verify the results of test routines run in-process."
+    };
+
+    stfu::test group_isolation{"group isolation", []
+            {
+                int in_process = 0, forked = 0;
+                stfu::test_group nested{"nested", "nested tests"};
+
+                nested.add_test(stfu::test{"(in process)",
+                                [&](){ ++in_process; STFU_PASS(); }})
+                      .add_test(stfu::test{"(forked)",
+                                [&](){ ++forked; STFU_PASS(); }}
+                                .set_isolation(stfu::isolation::FORKED))
+                      .set_isolation(stfu::isolation::IN_PROCESS)
+                      .set_verbose(false);
+
+                std::ostringstream output;
+                stfu::test_result_summary summary = nested(output);
+
+                STFU_ASSERT(2 == summary.passed);
+                STFU_PASS_IFF(1 == in_process && 0 == forked);
+            },
+            "Verify that tests follow the isolation of their group, unless "
+            "they specify their own."
+    };
+
+    stfu::test sharding{"sharding", []
+            {
+                const std::size_t shards = 3;
+                std::vector<int> runs(20, 0);
+                std::size_t total = 0;
+
+                for (std::size_t i = 0; i < shards; ++i) {
+                    stfu::test_group nested{"nested", "nested tests"};
+
+                    for (std::size_t j = 0; j < runs.size(); ++j) {
+                        nested.add_test(stfu::test{std::to_string(j).c_str(),
+                                        [&runs, j](){
+                                            ++runs[j];
+                                            STFU_PASS();
+                                        }});
+                    }
+                    nested.set_isolation(stfu::isolation::IN_PROCESS)
+                          .set_shard(i, shards)
+                          .set_record_file("")
+                          .set_shard_runtimes("")
+                          .set_verbose(false);
+
+                    std::ostringstream output;
+                    total += nested(output).passed;
+                }
+
+                STFU_ASSERT(runs.size() == total);
+                STFU_PASS_IFF(std::all_of(runs.begin(), runs.end(),
+                                          [](int r){ return 1 == r; }));
+            },
+            "Verify that the shards of a group together run every test "
+            "exactly once."
+    };
+
+    stfu::test shard_runtimes{"shard runtimes", []
+            {
+                char path[] = "/tmp/stfu-runtimes.XXXXXX";
+                ::close(::mkstemp(path));
+
+                // One long test and five short ones, recorded on a run.
+                {
+                    stfu::test_group nested{"nested", "nested tests"};
+                    nested.add_test(stfu::test{"(long)", []{ STFU_PASS(); }})
+                          .set_isolation(stfu::isolation::IN_PROCESS)
+                          .set_shard(0, 1)
+                          .set_record_file(path)
+                          .set_verbose(false);
+
+                    std::ostringstream output;
+                    nested(output);
+                }
+                {
+                    std::ofstream record{path, std::ios::app};
+                    record << "time\tnested\t(long)\t10\n";
+                    for (int i = 0; i < 5; ++i) {
+                        record << "time\tnested\t(short " << i << ")\t1\n";
+                    }
+                }
+
+                std::vector<std::size_t> sizes;
+                for (std::size_t i = 0; i < 2; ++i) {
+                    stfu::test_group nested{"nested", "nested tests"};
+
+                    nested.add_test(stfu::test{"(long)", []{ STFU_PASS(); }});
+                    for (int j = 0; j < 5; ++j) {
+                        nested.add_test(stfu::test{
+                                ("(short " + std::to_string(j) + ")").c_str(),
+                                []{ STFU_PASS(); }});
+                    }
+                    nested.set_isolation(stfu::isolation::IN_PROCESS)
+                          .set_shard(i, 2)
+                          .set_record_file("")
+                          .set_shard_runtimes(path)
+                          .set_verbose(false);
+
+                    std::ostringstream output;
+                    sizes.push_back(nested(output).passed);
+                }
+                ::unlink(path);
+
+                std::sort(sizes.begin(), sizes.end());
+                STFU_PASS_IFF(1 == sizes[0] && 5 == sizes[1]);
+            },
+            "Verify that recorded runtimes balance shards by duration "
+            "rather than by count."
+    };
+
+    stfu::test nested_environment{"nested environment", []
+            {
+                // Runs in a subprocess of its own, which the variables
+                // do not outlive.
+                ::setenv("STFU_SHARD_INDEX", "1", 1);
+                ::setenv("STFU_SHARD_COUNT", "1000", 1);
+                ::setenv("STFU_RECORD", "/nonexistent/record", 1);
+
+                stfu::test_group nested{"nested", "nested tests"};
+
+                for (int i = 0; i < 10; ++i) {
+                    nested.add_test(stfu::test{std::to_string(i).c_str(),
+                                    []{ STFU_PASS(); }});
+                }
+                nested.set_isolation(stfu::isolation::IN_PROCESS)
+                      .set_verbose(false);
+
+                std::ostringstream output;
+                STFU_PASS_IFF(10 == nested(output).passed);
+            },
+            "Verify that a group built inside a test routine ignores the "
+            "environment."
+    };
+
+    // Tests which only inspect objects need no subprocess of their own.
+    for (auto t: {&default_result, &default_values, &enable_disable,
+                  &name_test, &description_test}) {
+        t->set_isolation(stfu::isolation::IN_PROCESS);
+    }
+
     //
     // Group of all the unit tests (all expected to PASS).
     //
@@ -205,6 +593,19 @@ main(int argc, char* argv[])
                   "Anonymously defined test"})
               .add_test(fixtures)
               .add_test(fixtures_errors)
+              .add_test(parallel)
+              .add_test(benchmark)
+              .add_test(benchmark_fail)
+              .add_test(timeout)
+              .add_test(group_timeout)
+              .add_test(usage)
+              .add_test(counters)
+              .add_test(baseline)
+              .add_test(in_process)
+              .add_test(group_isolation)
+              .add_test(sharding)
+              .add_test(shard_runtimes)
+              .add_test(nested_environment)
               .set_verbose(false);
 
     //
@@ -274,6 +675,29 @@ main(int argc, char* argv[])
         "segmentation fault will appear as a test failure."
     };
 
+    stfu::test hang{"hung test", []
+        {
+            ::pause();
+        },
+        "Demonstration of a test which never completes, and is killed when "
+        "its timeout expires."
+    };
+    hang.set_timeout(std::chrono::seconds(1));
+
+    stfu::benchmark string_append{"string append", [](std::size_t n)
+        {
+            std::string s;
+            for (std::size_t i = 0; i < n; ++i) {
+                s.append(1, 'x');
+            }
+        },
+        "Demonstration of a benchmark. The routine is handed the number of "
+        "operations to perform, which is scaled up until each sample is long "
+        "enough to time; the result is reported as the time per operation. "
+        "Hardware performance counters are sampled as well, where available."
+    };
+    string_append.set_perf_counters(true);
+
     stfu::test_group examples{"examples",
         "Examples of various uses and failure conditions."};
 
@@ -287,11 +711,14 @@ main(int argc, char* argv[])
             .add_test(pass_iff)
             .add_test(failed_assertion)
             .add_test(crash_case)
+            .add_test(hang)
+            .add_test(string_append)
             .set_verbose(true);
 
     if (1 == argc) {
         stfu::test_result_summary summary = unit_tests();
-        return static_cast<int>(summary.failed + summary.crashed);
+        return static_cast<int>(summary.failed + summary.crashed +
+                                summary.timed_out + summary.regressed);
     }
 
     std::string arg{argv[1]};
@@ -0,0 +1,503 @@
+//
+// Copyright (c) 2025 Bryan Phillippe
+//
+// This software is free to use for any purpose, provided this copyright
+// notice is preserved.
+//
+
+#include <algorithm>
+#include <cerrno>
+#include <iterator>
+
+#include <unistd.h>
+#include <sys/timerfd.h>
+
+#include <libposix.hh>
+
+constexpr std::size_t posixcc::timer_wheel::levels;
+constexpr std::size_t posixcc::timer_wheel::slot_bits;
+constexpr std::size_t posixcc::timer_wheel::slots;
+
+//
+// Marks the end of a list of nodes.
+//
+static const std::uint32_t none = UINT32_MAX;
+
+//
+// Ticks spanned by the whole wheel; timers further out are parked in its
+// last level, and moved down as it turns.
+//
+static const std::uint64_t horizon = UINT64_C(1) << 32;
+
+posixcc::timer_wheel::timer_wheel(std::chrono::nanoseconds r):
+timer_fd{timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK)},
+resolution{std::max(r, std::chrono::nanoseconds(1))},
+start{clock::now()},
+free_list{none}
+{
+    if (!timer_fd) {
+        throw std::runtime_error{errno_to_string(errno)};
+    }
+
+    std::fill(std::begin(heads), std::end(heads), none);
+}
+
+std::uint64_t
+posixcc::timer_wheel::tick_of(clock::time_point t) const noexcept
+{
+    return (t <= start) ? 0 : (t - start) / resolution;
+}
+
+void
+posixcc::timer_wheel::link(std::uint32_t i) noexcept
+{
+    node& n = nodes[i];
+    const std::uint64_t delta = std::min(n.expires - current, horizon - 1);
+    const std::uint64_t expires = current + delta;
+    std::size_t level = 0;
+
+    // The level is that of the highest tick digit in which the expiry
+    // differs from now; the slot is the value of that digit.
+    while (level + 1 < levels &&
+           delta >= (UINT64_C(1) << (slot_bits * (level + 1)))) {
+        ++level;
+    }
+
+    const std::size_t slot = (expires >> (slot_bits * level)) & (slots - 1);
+    std::uint32_t& head = heads[level * slots + slot];
+
+    n.slot = level * slots + slot;
+    n.prev = none;
+    n.next = head;
+    if (none != head) {
+        nodes[head].prev = i;
+    }
+    head = i;
+    occupied[level][slot / 64] |= UINT64_C(1) << (slot % 64);
+}
+
+void
+posixcc::timer_wheel::unlink(std::uint32_t i) noexcept
+{
+    node& n = nodes[i];
+
+    if (none != n.prev) {
+        nodes[n.prev].next = n.next;
+    } else {
+        heads[n.slot] = n.next;
+        if (none == n.next) {
+            const std::size_t slot = n.slot % slots;
+            occupied[n.slot / slots][slot / 64] &=
+                ~(UINT64_C(1) << (slot % 64));
+        }
+    }
+
+    if (none != n.next) {
+        nodes[n.next].prev = n.prev;
+    }
+
+    n.slot = none;
+}
+
+void
+posixcc::timer_wheel::release(std::uint32_t i) noexcept
+{
+    node& n = nodes[i];
+
+    // A new generation invalidates IDs handed out for this node.
+    n.callback = nullptr;
+    n.generation = std::max<std::uint32_t>(n.generation + 1, 1);
+    n.next = free_list;
+    free_list = i;
+    --pending;
+}
+
+void
+posixcc::timer_wheel::cascade(std::size_t level) noexcept
+{
+    const std::size_t slot = (current >> (slot_bits * level)) & (slots - 1);
+    std::uint32_t i = heads[level * slots + slot];
+
+    heads[level * slots + slot] = none;
+    occupied[level][slot / 64] &= ~(UINT64_C(1) << (slot % 64));
+
+    while (none != i) {
+        const std::uint32_t next = nodes[i].next;
+        link(i);
+        i = next;
+    }
+}
+
+void
+posixcc::timer_wheel::rearm()
+{
+    std::uint64_t wake = 0;
+
+    // The next tick worth waking up for: that of the next occupied slot of
+    // the first level, or else the next time a slot of a higher level is
+    // due to move down. Timers a rotation ahead only wake up the wheel once
+    // it has turned.
+    for (std::size_t level = 0; pending && level < levels; ++level) {
+        const std::size_t shift = slot_bits * level;
+        const std::uint64_t base = (current >> shift) &
+                                   ~std::uint64_t(slots - 1);
+        const std::size_t at = (current >> shift) & (slots - 1);
+        std::uint64_t candidate = 0;
+
+        for (std::size_t w = 0; w < slots / 64 && !candidate; ++w) {
+            std::uint64_t bits = occupied[level][w];
+            if (w * 64 + 63 <= at) {
+                bits = 0;
+            } else if (w * 64 <= at) {
+                bits &= ~UINT64_C(0) << (at - w * 64 + 1);
+            }
+            if (bits) {
+                candidate = (base + w * 64 + __builtin_ctzll(bits)) << shift;
+            }
+        }
+
+        if (!candidate) {
+            for (std::size_t w = 0; w < slots / 64; ++w) {
+                if (occupied[level][w]) {
+                    candidate = (base + slots) << shift;
+                    break;
+                }
+            }
+        }
+
+        if (candidate && (!wake || candidate < wake)) {
+            wake = candidate;
+        }
+    }
+
+    if (wake == armed) {
+        return;
+    }
+
+    struct itimerspec spec{};
+    if (wake) {
+        const auto at = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            start.time_since_epoch()) + resolution * wake;
+
+        spec.it_value.tv_sec = at.count() / 1000000000;
+        spec.it_value.tv_nsec = at.count() % 1000000000;
+    }
+
+    if (-1 == timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &spec, nullptr)) {
+        throw std::runtime_error{errno_to_string(errno)};
+    }
+
+    armed = wake;
+}
+
+const posixcc::auto_fd&
+posixcc::timer_wheel::get_fd() const noexcept
+{
+    return timer_fd;
+}
+
+posixcc::timer_wheel::timer_id
+posixcc::timer_wheel::add(clock::duration after,
+                          const std::function<void()>& callback)
+{
+    // Round up, so as never to expire early, and never within the current
+    // tick.
+    const auto due = clock::now() + std::max(after, clock::duration::zero());
+    const std::uint64_t expires = (due - start + resolution -
+                                   clock::duration(1)) / resolution;
+    std::uint32_t i;
+
+    if (none != free_list) {
+        i = free_list;
+        free_list = nodes[i].next;
+    } else {
+        if (nodes.size() >= none) {
+            throw std::runtime_error{errno_to_string(ENOMEM)};
+        }
+        i = nodes.size();
+        nodes.push_back(node{0, 1, none, none, none, nullptr});
+    }
+
+    node& n = nodes[i];
+    n.expires = std::max(expires, current + 1);
+    n.callback = callback;
+    ++pending;
+    link(i);
+    rearm();
+
+    return (static_cast<std::uint64_t>(n.generation) << 32) | i;
+}
+
+bool
+posixcc::timer_wheel::cancel(timer_id id) noexcept
+{
+    const std::uint32_t i = id & UINT32_MAX;
+
+    if (i >= nodes.size() || nodes[i].generation != (id >> 32) ||
+        none == nodes[i].slot) {
+        return false;
+    }
+
+    unlink(i);
+    release(i);
+
+    // A timer armed for a cancelled timeout merely wakes up early.
+    return true;
+}
+
+std::size_t
+posixcc::timer_wheel::size() const noexcept
+{
+    return pending;
+}
+
+std::size_t
+posixcc::timer_wheel::expire()
+{
+    std::uint64_t expirations;
+    std::size_t fired = 0;
+
+    ssize_t l;
+    do {
+        l = read(timer_fd, &expirations, sizeof(expirations));
+    } while (-1 == l && EINTR == errno);
+
+    // Once the timerfd has fired, it is no longer armed.
+    if (static_cast<ssize_t>(sizeof(expirations)) == l) {
+        armed = 0;
+    }
+
+    const std::uint64_t now = tick_of(clock::now());
+    while (current < now && pending) {
+        // Skip ahead to the next occupied slot of the first level, or the
+        // next turn of the wheel, whichever comes first.
+        const std::size_t at = current & (slots - 1);
+        std::uint64_t next = (current | (slots - 1)) + 1;
+
+        for (std::size_t s = at + 1; s < slots; ++s) {
+            if (occupied[0][s / 64] >> (s % 64) & 1) {
+                next = (current & ~std::uint64_t(slots - 1)) + s;
+                break;
+            }
+            if (!occupied[0][s / 64] && 0 == s % 64) {
+                s += 63;
+            }
+        }
+        current = std::min(next, now);
+
+        // Move timers down from the levels which turned.
+        if (0 == (current & (slots - 1))) {
+            std::size_t level = 1;
+            while (level < levels &&
+                   0 == ((current >> (slot_bits * (level - 1))) &
+                         (slots - 1))) {
+                ++level;
+            }
+            while (--level) {
+                cascade(level);
+            }
+        }
+
+        // Timers added by callbacks land in later slots.
+        std::uint32_t& head = heads[current & (slots - 1)];
+        while (none != head) {
+            const std::uint32_t i = head;
+            auto callback = std::move(nodes[i].callback);
+
+            unlink(i);
+            release(i);
+            callback();
+            ++fired;
+        }
+    }
+
+    if (!pending) {
+        current = now;
+    }
+
+    rearm();
+    return fired;
+}
+
+#ifdef TIMER_TEST
+#include <poll.h>
+#include <vector>
+#include "stfu/stfu.hh"
+
+//
+// Waits for the wheel's timerfd, and expires timers, until "done" holds.
+//
+static bool
+run_until(posixcc::timer_wheel& w, const std::function<bool()>& done)
+{
+    for (int i = 0; i < 10000 && !done(); ++i) {
+        struct pollfd p{w.get_fd().get(), POLLIN, 0};
+        poll(&p, 1, 100);
+        w.expire();
+    }
+    return done();
+}
+
+static void
+expiry_tests()
+{
+    using namespace std::chrono;
+
+    // A fine resolution, so that the timers span all but the last level.
+    posixcc::timer_wheel w{microseconds(10)};
+    const auto start = posixcc::timer_wheel::clock::now();
+    std::vector<std::pair<int, posixcc::timer_wheel::clock::duration>> fired;
+
+    STFU_ASSERT(w.get_fd());
+    STFU_ASSERT(0 == w.size());
+    STFU_ASSERT(0 == w.expire());
+
+    for (const int ms: {700, 1, 50, 5, 0}) {
+        w.add(milliseconds(ms), [&fired, &start, ms] {
+            fired.emplace_back(ms,
+                posixcc::timer_wheel::clock::now() - start);
+        });
+    }
+    STFU_ASSERT(5 == w.size());
+
+    STFU_ASSERT(run_until(w, [&] { return 5 == fired.size(); }));
+    STFU_ASSERT(0 == w.size());
+
+    int previous = -1;
+    for (const auto& f: fired) {
+        STFU_ASSERT(f.first > previous);
+        STFU_ASSERT(f.second >= milliseconds(f.first));
+        previous = f.first;
+    }
+
+    // The wheel sleeps once idle.
+    struct pollfd p{w.get_fd().get(), POLLIN, 0};
+    STFU_PASS_IFF(0 == poll(&p, 1, 20));
+}
+
+static void
+cancel_tests()
+{
+    using namespace std::chrono;
+
+    posixcc::timer_wheel w;
+    int fired = 0;
+
+    const auto a = w.add(milliseconds(5), [&fired] { ++fired; });
+    const auto b = w.add(milliseconds(10), [&fired] { fired += 10; });
+    STFU_ASSERT(0 != a && 0 != b && a != b);
+    STFU_ASSERT(w.cancel(b));
+    STFU_ASSERT(!w.cancel(b));
+    STFU_ASSERT(1 == w.size());
+
+    // A callback cancelling a pending timer, and adding another.
+    posixcc::timer_wheel::timer_id d = 0;
+    w.add(milliseconds(20), [&] {
+        STFU_ASSERT(w.cancel(d));
+        w.add(milliseconds(0), [&fired] { fired += 100; });
+    });
+    d = w.add(milliseconds(21), [&fired] { fired += 1000; });
+
+    STFU_ASSERT(run_until(w, [&] { return 0 == w.size(); }));
+    STFU_ASSERT(!w.cancel(a));
+
+    // Node reuse does not revive old IDs.
+    const auto e = w.add(milliseconds(1), [] {});
+    STFU_ASSERT(!w.cancel(a) && !w.cancel(d));
+    STFU_ASSERT(w.cancel(e));
+    STFU_PASS_IFF(101 == fired);
+}
+
+static void
+volume_tests()
+{
+    using namespace std::chrono;
+
+    static const std::size_t count = 1000000;
+
+    posixcc::timer_wheel w;
+    std::vector<posixcc::timer_wheel::timer_id> ids(count);
+    std::size_t fired = 0;
+
+    // A million timeouts over the next hour, mostly cancelled.
+    for (std::size_t i = 0; i < count; ++i) {
+        ids[i] = w.add(milliseconds((i * 7919) % 3600000),
+                       [&fired] { ++fired; });
+    }
+    STFU_ASSERT(count == w.size());
+
+    for (std::size_t i = 0; i < count; ++i) {
+        if (i % 1000) {
+            STFU_ASSERT(w.cancel(ids[i]));
+        }
+    }
+    STFU_ASSERT(count / 1000 == w.size());
+
+    // Those due within the first 100ms fire.
+    std::size_t due = 0;
+    for (std::size_t i = 0; i < count; i += 1000) {
+        due += ((i * 7919) % 3600000 < 100);
+    }
+    STFU_ASSERT(0 < due);
+    STFU_PASS_IFF(run_until(w, [&] { return due == fired; }));
+}
+
+extern "C" std::size_t
+unit_tests()
+{
+    stfu::test_group group{"timer tests",
+        "Tests of the timer wheel."};
+    group.add_test(stfu::test{"expiry",
+            expiry_tests,
+            "Verify that timers across the levels of the wheel expire in "
+            "order, and not early."})
+         .add_test(stfu::test{"cancel",
+            cancel_tests,
+            "Verify that timers can be cancelled, including from callbacks."})
+         .add_test(stfu::test{"volume",
+            volume_tests,
+            "Verify a million pending timers."})
+         .set_timeout(std::chrono::seconds(30));
+
+    stfu::test_result_summary summary = group();
+    return summary.failed + summary.crashed + summary.timed_out +
+        summary.regressed;
+}
+#endif // TIMER_TEST
+
+#ifdef TIMER_BENCH
+#include <vector>
+#include "stfu/stfu.hh"
+
+extern "C" std::size_t
+unit_tests()
+{
+    using namespace std::chrono;
+
+    static const std::size_t background = 1000000;
+
+    // A million other timeouts pending, added before the benchmark starts.
+    posixcc::timer_wheel w;
+    for (std::size_t i = 0; i < background; ++i) {
+        w.add(seconds(1 + i % 3600), [] {});
+    }
+
+    stfu::benchmark add_cancel{"add-cancel", [&w](std::size_t n) {
+            for (std::size_t i = 0; i < n; ++i) {
+                w.cancel(w.add(milliseconds(i % 60000), [] {}));
+            }
+        },
+        "Add a timeout and cancel it again, with a million others pending."
+    };
+    add_cancel.set_samples(20);
+
+    stfu::test_group group{"timer benchmarks",
+        "Cost of timer wheel operations."};
+    group.add_test(add_cancel)
+         .set_jobs(1);
+
+    stfu::test_result_summary summary = group();
+    return summary.failed + summary.crashed + summary.timed_out +
+        summary.regressed;
+}
+#endif // TIMER_BENCH
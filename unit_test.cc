@@ -1,18 +1,239 @@
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+
 #include <libposix.hh>
 #include "../stfu/stfu.hh"
 
+//
+// A test module running in its own worker process. Output of the module is
+// captured, so that the output of modules running concurrently can be
+// printed in the order the modules were given; its failure count is sent
+// back through a separate pipe.
+//
+struct module_run {
+    explicit module_run(const char *p):
+        path{p}
+    {
+    }
+
+    const char *path;
+    posixcc::worker_process worker{};
+    posixcc::auto_pipe output{};
+    posixcc::auto_pipe result{};
+    std::chrono::steady_clock::time_point started{};
+    std::string text{};
+    std::string count{};
+    bool timed_out{false};
+    bool done{false};
+};
+
+static void
+usage(const char *prog)
+{
+    std::cerr << "Usage: " << prog << " [-j jobs] [-t timeout] module..."
+              << std::endl
+              << "  -j jobs     modules run at once (default: all)" << std::endl
+              << "  -t timeout  seconds before a module is killed "
+                 "(default: 300, 0 for none)" << std::endl;
+}
+
+static void
+set_nonblocking(int fd)
+{
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+}
+
+//
+// Read whatever is currently available on a non-blocking descriptor.
+//
+static void
+drain(int fd, std::string &into)
+{
+    char buffer[4096];
+    ssize_t l;
+
+    while (-1 != fd) {
+        l = read(fd, buffer, sizeof(buffer));
+        if (0 < l) {
+            into.append(buffer, l);
+        } else if (-1 == l && EINTR == errno) {
+            continue;
+        } else {
+            break;
+        }
+    }
+}
+
+static void
+start(module_run &m)
+{
+    typedef std::size_t (*unit_test_fn)();
+
+    m.started = std::chrono::steady_clock::now();
+    m.worker.start([&m] {
+        // Own process group, so that a timeout takes out the whole module.
+        setpgid(0, 0);
+
+        m.output.close_rfd();
+        m.result.close_rfd();
+        dup2(m.output.get_wfd(), STDOUT_FILENO);
+        dup2(m.output.get_wfd(), STDERR_FILENO);
+        m.output.close_wfd();
+
+        std::size_t failures{1};
+        try {
+            const auto &mod = posixcc::load_modsymbol("unit_tests", m.path);
+            const auto run_tests = posixcc::get_symbol<unit_test_fn>(mod);
+
+            failures = run_tests();
+        } catch (const std::exception &e) {
+            std::cerr << "# ERROR - " << e.what() << std::endl;
+        }
+
+        std::cout.flush();
+        write(m.result.get_wfd(), &failures, sizeof(failures));
+    });
+
+    // Also set from the parent, so that it is in place before any kill.
+    setpgid(m.worker.get_id(), m.worker.get_id());
+
+    m.output.close_wfd();
+    m.result.close_wfd();
+    set_nonblocking(m.output.get_rfd());
+    set_nonblocking(m.result.get_rfd());
+}
+
+//
+// Collect the outcome of a module whose worker has exited, returning its
+// failure count.
+//
+static std::size_t
+finish(module_run &m)
+{
+    std::size_t failures{1};
+
+    drain(m.output.get_rfd(), m.text);
+    drain(m.result.get_rfd(), m.count);
+    m.output.close();
+    m.result.close();
+
+    if (m.count.size() == sizeof(failures)) {
+        memcpy(&failures, m.count.data(), sizeof(failures));
+    } else if (m.timed_out) {
+        m.text.append("# ERROR - ").append(m.path)
+              .append(" timed out\n");
+    } else {
+        m.text.append("# ERROR - ").append(m.path)
+              .append(" exited without a result\n");
+    }
+
+    m.done = true;
+    return failures;
+}
+
 int
 main(int argc, char* argv[])
 {
+    using namespace std::chrono;
+
     std::size_t failure_count{0};
+    std::size_t jobs{0};
+    long timeout{300};
+    int c;
+
+    while (-1 != (c = getopt(argc, argv, "j:t:h"))) {
+        switch (c) {
+        case 'j':
+            jobs = std::strtoul(optarg, nullptr, 10);
+            break;
+
+        case 't':
+            timeout = std::strtol(optarg, nullptr, 10);
+            break;
+
+        case 'h':
+            usage(argv[0]);
+            return 0;
+
+        default:
+            usage(argv[0]);
+            return -1;
+        }
+    }
+
+    std::vector<std::unique_ptr<module_run>> modules;
+    for (int i = optind; i < argc; ++i) {
+        modules.emplace_back(new module_run{argv[i]});
+    }
+
+    if (0 == jobs) {
+        jobs = modules.size();
+    }
+
+    std::size_t next{0};
+    std::size_t printed{0};
+    std::size_t running{0};
+
+    while (printed < modules.size()) {
+
+        // Start as many modules as there are free jobs.
+        for (; next < modules.size() && running < jobs; ++next, ++running) {
+            start(*modules[next]);
+        }
+
+        // Wait for output, results or the next timeout check.
+        std::vector<struct pollfd> fds;
+        for (std::size_t i = printed; i < next; ++i) {
+            if (!modules[i]->done) {
+                fds.push_back({modules[i]->output.get_rfd(), POLLIN, 0});
+                fds.push_back({modules[i]->result.get_rfd(), POLLIN, 0});
+            }
+        }
+        poll(fds.data(), fds.size(), 100);
+
+        for (std::size_t i = printed; i < next; ++i) {
+            module_run &m = *modules[i];
+
+            if (m.done) {
+                continue;
+            }
+
+            drain(m.output.get_rfd(), m.text);
+            drain(m.result.get_rfd(), m.count);
 
-    for (int i = 1; i < argc; ++i) {
-        const auto &mod = posixcc::load_modsymbol("unit_tests", argv[i]);
+            if (!m.worker.is_running()) {
+                failure_count += finish(m);
+                --running;
+            } else if (0 < timeout &&
+                       steady_clock::now() - m.started > seconds(timeout)) {
+                kill(-static_cast<pid_t>(m.worker.get_id()), SIGKILL);
+                m.worker.join();
+                m.timed_out = true;
+                failure_count += finish(m);
+                --running;
+            }
+        }
 
-        typedef std::size_t (*unit_test_fn)();
-        const auto run_tests = posixcc::get_symbol<unit_test_fn>(mod);
+        // Output of the first unfinished module is passed through as it
+        // arrives; everything after it is held back until its turn.
+        for (; printed < next; ++printed) {
+            module_run &m = *modules[printed];
 
-        failure_count += run_tests();
+            std::cout << m.text << std::flush;
+            m.text.clear();
+            if (!m.done) {
+                break;
+            }
+        }
     }
 
     return static_cast<int>(-failure_count);